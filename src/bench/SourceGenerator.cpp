@@ -0,0 +1,161 @@
+#include "SourceGenerator.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace ty
+{
+
+namespace
+{
+
+//! Keeps every value, including intermediate ones, at most this large in magnitude
+constexpr int64_t value_limit = int64_t(1) << 30;
+
+class SourceWriter
+{
+public:
+    SourceWriter(SourceShape const& shape, SourceStats& stats)
+        : m_shape{ shape }, m_state{ shape.seed }, m_stats{ stats }
+    {}
+
+    std::string run()
+    {
+        // Definitions average a few dozen bytes
+        m_out.reserve(m_shape.target_bytes + 256);
+        while (m_out.size() < m_shape.target_bytes)
+        {
+            definition();
+        }
+        return std::move(m_out);
+    }
+
+private:
+    struct Definition
+    {
+        int32_t value;
+        bool    is_function;
+    };
+
+    // splitmix64
+    uint64_t next()
+    {
+        auto z = (m_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    //! True with probability percent / 100
+    bool chance(unsigned percent) { return next() % 100 < percent; }
+
+    void definition()
+    {
+        auto const is_function = chance(30);
+        name(m_definitions.size(), is_function);
+        m_out += is_function ? " = @() -> {" : " = {";
+        auto const value = expression(0);
+        m_out += "}\n";
+        m_definitions.push_back(Definition{ static_cast<int32_t>(value), is_function });
+        ++m_stats.definitions;
+        m_stats.functions += is_function;
+    }
+
+    void name(size_t index, bool is_function)
+    {
+        m_out += is_function ? 'f' : 'v';
+        m_out += std::to_string(index);
+    }
+
+    //! Appends an expression and returns its value
+    int64_t expression(unsigned depth)
+    {
+        if (depth >= m_shape.max_depth || !chance(60))
+        {
+            return primary();
+        }
+        auto const left = expression(depth + 1);
+        m_out += "   ";
+        auto const op = m_out.size() - 2;
+        auto const nested = depth + 1 < m_shape.max_depth && chance(30);
+        if (nested)
+        {
+            m_out += '(';
+        }
+        auto const right = nested ? expression(depth + 1) : primary();
+        if (nested)
+        {
+            m_out += ')';
+        }
+        // With both operands within the limit, one of the two results is too
+        auto const sum = left + right;
+        auto const use_add = sum <= value_limit && sum >= -value_limit;
+        m_out[op] = use_add ? '+' : '-';
+        return use_add ? sum : left - right;
+    }
+
+    int64_t primary()
+    {
+        if (m_definitions.empty() || chance(40))
+        {
+            auto const value = static_cast<int64_t>(next() % 1000);
+            if (chance(10))
+            {
+                m_out += '-';
+                m_out += std::to_string(value);
+                return -value;
+            }
+            m_out += std::to_string(value);
+            return value;
+        }
+        auto const index = pick();
+        auto const& d = m_definitions[index];
+        name(index, d.is_function);
+        if (d.is_function)
+        {
+            m_out += "()";
+        }
+        ++m_stats.references;
+        return d.value;
+    }
+
+    //! Index of a referenced definition, among the most recent ones
+    size_t pick()
+    {
+        auto const count = std::min<size_t>(std::max(m_shape.identifiers, 1u), m_definitions.size());
+        size_t rank = 0;
+        if (m_shape.distribution == IdentifierDistribution::uniform)
+        {
+            rank = next() % count;
+        }
+        else
+        {
+            // Uniform over a random number of low bits: rank r has probability ~ 1 / r
+            unsigned bits = 0;
+            while ((size_t(1) << bits) < count)
+            {
+                ++bits;
+            }
+            auto const width = static_cast<unsigned>(next() % (bits + 1));
+            rank = (next() & ((uint64_t(1) << width) - 1)) % count;
+        }
+        return m_definitions.size() - 1 - rank;
+    }
+
+    SourceShape const&      m_shape;
+    uint64_t                m_state;
+    SourceStats&            m_stats;
+    std::string             m_out;
+    std::vector<Definition> m_definitions;
+};
+
+} // namespace
+
+std::string generate_source(SourceShape const& shape, SourceStats* stats)
+{
+    SourceStats local;
+    SourceWriter writer{ shape, stats ? *stats : local };
+    return writer.run();
+}
+
+} // namespace ty
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ty
+{
+
+//! How references are spread over the definitions a new one may use
+enum class IdentifierDistribution
+{
+    uniform,    //!< Every candidate equally likely
+    skewed      //!< Recent definitions far more likely, roughly Zipf with s = 1
+};
+
+//! Shape of a synthetic tylang source
+struct SourceShape
+{
+    size_t                  target_bytes = 1 << 20;     //!< Generation stops at the first definition reaching it
+    unsigned                max_depth = 4;              //!< Nesting depth of binary expressions
+    unsigned                identifiers = 64;           //!< Candidates for a reference: the most recent definitions
+    IdentifierDistribution  distribution = IdentifierDistribution::skewed;
+    uint64_t                seed = 1;
+};
+
+//! Statistics of a generated source
+struct SourceStats
+{
+    size_t  definitions = 0;
+    size_t  functions = 0;
+    size_t  references = 0;     //!< Symbols and calls
+};
+
+//! Synthesises a valid tylang module of value and function definitions.
+//! The output depends only on 'shape', not on the platform or standard library: random
+//! numbers come from a fixed splitmix64 sequence and no floating point is used. Each
+//! definition only references earlier ones and the generator keeps every intermediate
+//! value within i32, so the whole module folds and generates without errors.
+std::string generate_source(SourceShape const& shape, SourceStats* stats = nullptr);
+
+} // namespace ty
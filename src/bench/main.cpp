@@ -0,0 +1,341 @@
+#include "bench/SourceGenerator.h"
+#include "parse/Parse.h"
+#include "cgen/LLVM_IR_Generator.h"
+#include "token/TokenList.h"
+#include "token/FastLexer.h"
+#include "common/ProcessStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using namespace ty;
+
+//! Counts the generated IR and discards it, so codegen is timed without I/O
+class CountingSink : public OutputSink
+{
+public:
+    size_t bytes() { flush(); return m_bytes; }
+
+protected:
+    void flush_buffer(char const*, size_t size) override { m_bytes += size; }
+
+private:
+    size_t m_bytes = 0;
+};
+
+struct Options
+{
+    std::vector<size_t>     sizes{ 1 << 10, 64 << 10, 1 << 20 };
+    SourceShape             shape;
+    unsigned                iterations = 3;
+    size_t                  lookups = 1 << 20;
+};
+
+//! Times of every iteration of one stage
+struct Timings
+{
+    std::vector<double> seconds;
+
+    double best() const { return *std::min_element(seconds.begin(), seconds.end()); }
+
+    double median() const
+    {
+        auto sorted = seconds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+};
+
+//! Runs 'body' 'iterations' times and records how long each run took.
+//! 'setup' runs before each of them and isn't timed.
+template <typename S, typename F>
+Timings measure(unsigned iterations, S&& setup, F&& body)
+{
+    Timings t;
+    for (unsigned i = 0; i < iterations; ++i)
+    {
+        setup();
+        auto const start = std::chrono::steady_clock::now();
+        body();
+        auto const stop = std::chrono::steady_clock::now();
+        t.seconds.push_back(std::chrono::duration<double>(stop - start).count());
+    }
+    return t;
+}
+
+template <typename F>
+Timings measure(unsigned iterations, F&& body)
+{
+    return measure(iterations, [] {}, body);
+}
+
+//! Parses sizes like 4096, 64K or 100M (binary multiples)
+bool parse_size(char const* text, size_t& size)
+{
+    char* end = nullptr;
+    auto const value = std::strtoull(text, &end, 10);
+    size_t scale = 1;
+    if (*end == 'K' || *end == 'k')
+    {
+        scale = size_t(1) << 10;
+        ++end;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        scale = size_t(1) << 20;
+        ++end;
+    }
+    if (end == text || *end != '\0' || value == 0)
+    {
+        return false;
+    }
+    size = static_cast<size_t>(value) * scale;
+    return true;
+}
+
+bool parse_sizes(char const* text, std::vector<size_t>& sizes)
+{
+    sizes.clear();
+    std::string const list = text;
+    size_t begin = 0;
+    while (begin <= list.size())
+    {
+        auto end = list.find(',', begin);
+        if (end == std::string::npos)
+        {
+            end = list.size();
+        }
+        size_t size = 0;
+        if (!parse_size(list.substr(begin, end - begin).c_str(), size))
+        {
+            return false;
+        }
+        sizes.push_back(size);
+        begin = end + 1;
+    }
+    return !sizes.empty();
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const* arg = argv[i];
+        auto const value = [&](char const* prefix) -> char const*
+        {
+            auto const n = std::strlen(prefix);
+            return std::strncmp(arg, prefix, n) == 0 ? arg + n : nullptr;
+        };
+        char const* v = nullptr;
+        if ((v = value("--sizes=")))
+        {
+            if (!parse_sizes(v, options.sizes))
+            {
+                fprintf(stderr, "Invalid size list '%s' (e.g. 1K,64K,100M)\n", v);
+                return false;
+            }
+        }
+        else if ((v = value("--depth=")))
+        {
+            options.shape.max_depth = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+        }
+        else if ((v = value("--identifiers=")))
+        {
+            options.shape.identifiers = static_cast<unsigned>(std::strtoul(v, nullptr, 10));
+        }
+        else if ((v = value("--distribution=")))
+        {
+            if (std::string("uniform") == v)
+            {
+                options.shape.distribution = IdentifierDistribution::uniform;
+            }
+            else if (std::string("skewed") == v)
+            {
+                options.shape.distribution = IdentifierDistribution::skewed;
+            }
+            else
+            {
+                fprintf(stderr, "Unsupported distribution '%s' (uniform, skewed)\n", v);
+                return false;
+            }
+        }
+        else if ((v = value("--seed=")))
+        {
+            options.shape.seed = std::strtoull(v, nullptr, 10);
+        }
+        else if ((v = value("--iterations=")))
+        {
+            options.iterations = std::max(1u, static_cast<unsigned>(std::strtoul(v, nullptr, 10)));
+        }
+        else if ((v = value("--lexer=")))
+        {
+            auto& engine = Global<LexerSettings>().engine;
+            if (!engine_from_string(v, engine) || !is_engine_supported(engine))
+            {
+                fprintf(stderr, "Unsupported lexer '%s' (reference, table, sse2, avx2, dfa, auto, checked)\n", v);
+                return false;
+            }
+        }
+        else if ((v = value("--lookups=")))
+        {
+            options.lookups = std::max<size_t>(1, std::strtoull(v, nullptr, 10));
+        }
+        else
+        {
+            fprintf(stderr, "usage: tybench [--sizes=1K,64K,1M] [--depth=4] [--identifiers=64]\n"
+                            "               [--distribution=skewed|uniform] [--seed=1] [--iterations=3] [--lookups=1048576]\n"
+                            "               [--lexer=auto]\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+char const* to_string(IdentifierDistribution d)
+{
+    return d == IdentifierDistribution::uniform ? "uniform" : "skewed";
+}
+
+//! Writes one stage as a JSON member; rates use the best iteration
+void print_stage(char const* name, Timings const& t, size_t bytes, size_t tokens, size_t nodes, bool last)
+{
+    auto const best = std::max(t.best(), 1e-9);
+    printf("        \"%s\": { \"best_s\": %.9f, \"median_s\": %.9f, \"mb_per_s\": %.3f, \"tokens_per_s\": %.0f, \"ns_per_node\": %.3f }%s\n",
+        name, t.best(), t.median(), bytes / best / (1 << 20), tokens / best, nodes ? best * 1e9 / nodes : 0.0, last ? "" : ",");
+}
+
+void print_lookups(Timings const& t, size_t lookups)
+{
+    printf("        \"symbol_lookup\": { \"best_s\": %.9f, \"median_s\": %.9f, \"lookups\": %zu, \"ns_per_lookup\": %.3f },\n",
+        t.best(), t.median(), lookups, t.best() * 1e9 / lookups);
+}
+
+//! Benchmarks every stage on one generated source and prints its JSON object
+void run(Options const& options, size_t size, bool last)
+{
+    auto shape = options.shape;
+    shape.target_bytes = size;
+    SourceStats stats;
+    auto const source = generate_source(shape, &stats);
+
+    // Results of the last iteration are kept for the following stages. The previous result
+    // is freed and the text tokenize() consumes is copied before the clock starts; the copy
+    // has room for the padding, so tokenize() doesn't reallocate it either.
+    std::unique_ptr<TokenList> list;
+    std::string copy;
+    auto const lex = measure(options.iterations, [&]
+    {
+        list.reset();
+        copy.reserve(source.size() + 1 + source_padding);
+        copy.assign(source);
+    }, [&]
+    {
+        list = std::make_unique<TokenList>(tokenize(std::move(copy)));
+    });
+    auto const& tokens = *list;
+
+    std::unique_ptr<ParseContext> tree;
+    auto const parsing = measure(options.iterations, [&]
+    {
+        tree.reset();
+    }, [&]
+    {
+        tree = std::make_unique<ParseContext>(parse_serial(tokens));
+    });
+    auto const& ast = *tree;
+    auto const nodes = ast.node_count();
+
+    // Same tree on an explicit stack, which has to keep up with recursion on shallow sources
+    auto const parsing_iterative = measure(options.iterations, [&]
+    {
+        parse_iterative(tokens);
+    });
+
+    // Resolves names the way a later pass would: interned text, then the binding
+    std::vector<std::string> names;
+    names.reserve(std::min(options.lookups, ast.exprs.size()));
+    for (size_t i = 0; i < names.capacity(); ++i)
+    {
+        auto const id = ast.exprs[(i * 7919) % ast.exprs.size()]->id();
+        names.emplace_back(ast.interner->name(id), ast.interner->size(id));
+    }
+    size_t found = 0;
+    auto const lookups = measure(options.iterations, [&]
+    {
+        for (size_t i = 0; i < options.lookups; ++i)
+        {
+            auto const& name = names[i % names.size()];
+            found += ast.symbols->expr_at(ast.interner->find(name)) != nullptr;
+        }
+    });
+    if (found != options.lookups * options.iterations)
+    {
+        fprintf(stderr, "Symbol lookup failed: %zu of %zu names found\n", found, options.lookups * options.iterations);
+        std::exit(1);
+    }
+
+    size_t ir_bytes = 0;
+    auto const codegen = measure(options.iterations, [&]
+    {
+        CountingSink out;
+        generate_serial(ast, out);
+        ir_bytes = out.bytes();
+    });
+
+    auto const end_to_end = measure(options.iterations, [&]
+    {
+        auto copy = source;
+        auto const t = tokenize(std::move(copy));
+        auto const tree = parse_serial(t);
+        CountingSink out;
+        generate_serial(tree, out);
+    });
+
+    printf("    {\n");
+    printf("      \"source_bytes\": %zu, \"target_bytes\": %zu, \"depth\": %u, \"identifiers\": %u, \"distribution\": \"%s\", \"seed\": %llu,\n",
+        source.size(), size, shape.max_depth, shape.identifiers, to_string(shape.distribution), static_cast<unsigned long long>(shape.seed));
+    printf("      \"definitions\": %zu, \"functions\": %zu, \"references\": %zu, \"tokens\": %zu, \"nodes\": %zu, \"ir_bytes\": %zu,\n",
+        stats.definitions, stats.functions, stats.references, tokens.size(), nodes, ir_bytes);
+    printf("      \"stages\": {\n");
+    print_stage("tokenize", lex, source.size(), tokens.size(), nodes, false);
+    print_stage("parse", parsing, source.size(), tokens.size(), nodes, false);
+    print_stage("parse_iterative", parsing_iterative, source.size(), tokens.size(), nodes, false);
+    print_lookups(lookups, options.lookups);
+    print_stage("codegen", codegen, source.size(), tokens.size(), nodes, false);
+    print_stage("end_to_end", end_to_end, source.size(), tokens.size(), nodes, true);
+    printf("      },\n");
+    printf("      \"peak_rss_bytes\": %zu\n", peak_rss_bytes());
+    printf("    }%s\n", last ? "" : ",");
+    fflush(stdout);
+}
+
+} // namespace
+
+//! Benchmarks the lexer, parser, symbol table and IR generator on synthetic sources and
+//! prints the results as JSON on stdout. Peak RSS is the process high-water mark after
+//! each size, so sizes are best given in increasing order.
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+    printf("{\n  \"benchmark\": \"tybench\",\n  \"iterations\": %u,\n  \"lexer\": \"%s\",\n  \"results\": [\n",
+           options.iterations, to_string(resolve_engine(Global<LexerSettings>().engine)));
+    for (size_t i = 0; i < options.sizes.size(); ++i)
+    {
+        run(options, options.sizes[i], i + 1 == options.sizes.size());
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
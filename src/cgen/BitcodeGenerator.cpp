@@ -0,0 +1,384 @@
+#include "BitcodeGenerator.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+namespace ty
+{
+
+namespace
+{
+
+// Block ids and record codes from llvm/Bitcode/LLVMBitCodes.h
+enum BlockId : unsigned
+{
+    MODULE_BLOCK_ID = 8,
+    CONSTANTS_BLOCK_ID = 11,
+    FUNCTION_BLOCK_ID = 12,
+    VALUE_SYMTAB_BLOCK_ID = 14,
+    TYPE_BLOCK_ID_NEW = 17
+};
+
+enum ModuleCode : unsigned
+{
+    MODULE_CODE_VERSION = 1,
+    MODULE_CODE_GLOBALVAR = 7,
+    MODULE_CODE_FUNCTION = 8
+};
+
+enum TypeCode : unsigned
+{
+    TYPE_CODE_NUMENTRY = 1,
+    TYPE_CODE_INTEGER = 7,
+    TYPE_CODE_FUNCTION = 21
+};
+
+enum ConstantsCode : unsigned
+{
+    CST_CODE_SETTYPE = 1,
+    CST_CODE_INTEGER = 4
+};
+
+enum FunctionCode : unsigned
+{
+    FUNC_CODE_DECLAREBLOCKS = 1,
+    FUNC_CODE_INST_BINOP = 2,
+    FUNC_CODE_INST_RET = 10,
+    FUNC_CODE_INST_LOAD = 20,
+    FUNC_CODE_INST_CALL = 34
+};
+
+enum ValueSymtabCode : unsigned
+{
+    VST_CODE_ENTRY = 1
+};
+
+enum BinaryOpcode : unsigned
+{
+    BINOP_ADD = 0,
+    BINOP_SUB = 1
+};
+
+constexpr uint64_t OBO_NO_SIGNED_WRAP = 1 << 1;
+constexpr uint64_t CALL_EXPLICIT_TYPE = 1 << 15;
+
+//! Version 1: operands in function blocks are relative to the instruction's own number,
+//! names are stored in value symbol tables
+constexpr uint64_t module_version = 1;
+
+// Fixed type table
+constexpr uint64_t type_i32 = 0;
+constexpr uint64_t type_i64 = 1;
+constexpr uint64_t type_i32_fn = 2;    //!< i32 (), the type of every function
+constexpr uint64_t type_count = 3;
+
+uint64_t type_id(SystemType const* t)
+{
+    switch (t->native_type())
+    {
+    case NativeType::I_32:  return type_i32;
+    case NativeType::I_64:  return type_i64;
+    default:
+        std::abort();
+        return 0;
+    }
+}
+
+//! Alignment as bitcode stores it: log2(bytes) + 1, or 0 for none
+uint64_t encode_alignment(int bytes)
+{
+    uint64_t log2 = 0;
+    while ((1 << log2) < bytes)
+    {
+        ++log2;
+    }
+    return bytes ? log2 + 1 : 0;
+}
+
+} // namespace
+
+void BitcodeGenerator::generate(FunctionDefnExpr const& expr)
+{
+    if (expr.m_returns.empty())
+    {
+        throw EvalException(&expr, std::string("Function '") + m_interner->name(expr.id()) + "' doesn't return a value");
+    }
+    m_global_index[expr.id()] = static_cast<uint32_t>(m_globals.size());
+    m_globals.push_back(Global{ expr.id(), true, nullptr, 0 });
+    m_functions.emplace_back();
+    m_function = &m_functions.back();
+    for (auto const& a : expr.m_body->exprs)
+    {
+        a->generate(*this);
+    }
+    m_function = nullptr;
+}
+
+void BitcodeGenerator::generate(Int32LiteralExpr const& expr)
+{
+    errno = 0;
+    auto const value = std::strtoll(expr.text(), nullptr, 10);
+    if (errno == ERANGE || value < INT32_MIN || value > INT32_MAX)
+    {
+        throw EvalException(&expr, std::string("Literal ") + expr.text() + " out of range for i32");
+    }
+    m_value = constant(static_cast<SystemType const*>(expr.inferred_type()), value);
+}
+
+void BitcodeGenerator::generate(ReturnExpr const& expr)
+{
+    local(Instruction::Op::Ret, value_of(*expr.sub_expr()), Operand{});
+}
+
+void BitcodeGenerator::generate(DataDefnExpr const& expr)
+{
+    auto const* c = m_evaluator ? m_evaluator->evaluate(expr) : nullptr;
+    if (!c)
+    {
+        throw EvalException(&expr, std::string("Initializer of '") + m_interner->name(expr.id()) + "' is not a compile-time constant");
+    }
+    auto const init = constant(c->type, c->value).index;
+    m_global_index[expr.id()] = static_cast<uint32_t>(m_globals.size());
+    m_globals.push_back(Global{ expr.id(), false, c->type, init });
+}
+
+void BitcodeGenerator::generate(SymbolExpr const& expr)
+{
+    Operand global;
+    global.kind = Operand::Kind::Global;
+    global.index = expr.name();
+    global.use = &expr;
+    m_value = local(Instruction::Op::Load, global, Operand{});
+}
+
+void BitcodeGenerator::generate(FunctionCallExpr const& expr)
+{
+    Operand callee;
+    callee.kind = Operand::Kind::Global;
+    callee.index = expr.callee();
+    callee.use = &expr;
+    m_value = local(Instruction::Op::Call, callee, Operand{});
+}
+
+void BitcodeGenerator::generate(AddExpr const& expr)
+{
+    generate_binary(Instruction::Op::Add, expr);
+}
+
+void BitcodeGenerator::generate(SubExpr const& expr)
+{
+    generate_binary(Instruction::Op::Sub, expr);
+}
+
+BitcodeGenerator::Operand BitcodeGenerator::value_of(Expr const& expr)
+{
+    if (auto const* c = m_evaluator ? m_evaluator->evaluate(expr) : nullptr)
+    {
+        return constant(c->type, c->value);
+    }
+    expr.generate(*this);
+    return m_value;
+}
+
+BitcodeGenerator::Operand BitcodeGenerator::constant(SystemType const* type, int64_t value)
+{
+    auto const inserted = m_constant_index.emplace(std::make_pair(type->native_type(), value), static_cast<uint32_t>(m_constants.size()));
+    if (inserted.second)
+    {
+        m_constants.emplace_back(type, value);
+    }
+    Operand c;
+    c.index = inserted.first->second;
+    return c;
+}
+
+BitcodeGenerator::Operand BitcodeGenerator::local(Instruction::Op op, Operand a, Operand b)
+{
+    CCT_CHECK(m_function);
+    m_function->body.push_back(Instruction{ op, a, b });
+
+    Operand result;
+    result.kind = Operand::Kind::Local;
+    result.index = op == Instruction::Op::Ret ? 0 : m_function->results++;
+    return result;
+}
+
+void BitcodeGenerator::generate_binary(Instruction::Op op, BinaryOpExpr const& expr)
+{
+    auto const lhs = value_of(*expr.left());
+    auto const rhs = value_of(*expr.right());
+    m_value = local(op, lhs, rhs);
+}
+
+uint64_t BitcodeGenerator::value_number(Operand const& o, uint64_t first_local) const
+{
+    switch (o.kind)
+    {
+    case Operand::Kind::Constant:   return m_globals.size() + o.index;
+    case Operand::Kind::Local:      return first_local + o.index;
+    case Operand::Kind::Global:     break;
+    }
+    auto const found = m_global_index.find(o.index);
+    if (found == m_global_index.end())
+    {
+        throw EvalException(o.use, std::string("Undefined symbol '") + m_interner->name(o.index) + "'");
+    }
+    return found->second;
+}
+
+void BitcodeGenerator::write_types(BitstreamWriter& w) const
+{
+    w.enter_block(TYPE_BLOCK_ID_NEW, 4);
+    w.record(TYPE_CODE_NUMENTRY, { type_count });
+    w.record(TYPE_CODE_INTEGER, { 32 });
+    w.record(TYPE_CODE_INTEGER, { 64 });
+    w.record(TYPE_CODE_FUNCTION, { 0 /* vararg */, type_i32 });
+    w.end_block();
+}
+
+void BitcodeGenerator::write_constants(BitstreamWriter& w) const
+{
+    if (m_constants.empty())
+    {
+        return;
+    }
+    w.enter_block(CONSTANTS_BLOCK_ID, 4);
+    SystemType const* current = nullptr;
+    for (auto const& c : m_constants)
+    {
+        if (c.first != current)
+        {
+            current = c.first;
+            w.record(CST_CODE_SETTYPE, { type_id(current) });
+        }
+        w.record(CST_CODE_INTEGER, { encode_signed(c.second) });
+    }
+    w.end_block();
+}
+
+void BitcodeGenerator::write_function(BitstreamWriter& w, Function const& f) const
+{
+    // Values are numbered globals, then constants, then the function's results
+    auto const first_local = m_globals.size() + m_constants.size();
+    auto next = first_local;
+
+    // Loads must name values and calls functions, or the module won't verify
+    for (auto const& i : f.body)
+    {
+        for (auto const* o : { &i.a, &i.b })
+        {
+            if (o->kind != Operand::Kind::Global)
+            {
+                continue;
+            }
+            auto const& g = m_globals[value_number(*o, first_local)];
+            if (g.is_function != (i.op == Instruction::Op::Call))
+            {
+                throw EvalException(o->use, std::string("'") + m_interner->name(o->index) + (g.is_function ? "' is not a value" : "' is not a function"));
+            }
+        }
+    }
+
+    w.enter_block(FUNCTION_BLOCK_ID, 4);
+    w.record(FUNC_CODE_DECLAREBLOCKS, { 1 });
+    for (auto const& i : f.body)
+    {
+        auto const a = next - value_number(i.a, first_local);
+        switch (i.op)
+        {
+        case Instruction::Op::Load:
+            w.record(FUNC_CODE_INST_LOAD, { a, type_i32, encode_alignment(4), 0 /* volatile */ });
+            ++next;
+            break;
+        case Instruction::Op::Call:
+            w.record(FUNC_CODE_INST_CALL, { 0 /* attributes */, CALL_EXPLICIT_TYPE, type_i32_fn, a });
+            ++next;
+            break;
+        case Instruction::Op::Add:
+        case Instruction::Op::Sub:
+            w.record(FUNC_CODE_INST_BINOP, { a, next - value_number(i.b, first_local),
+                i.op == Instruction::Op::Add ? BINOP_ADD : BINOP_SUB, OBO_NO_SIGNED_WRAP });
+            ++next;
+            break;
+        case Instruction::Op::Ret:
+            w.record(FUNC_CODE_INST_RET, { a });
+            break;
+        }
+    }
+    w.end_block();
+}
+
+void BitcodeGenerator::finish()
+{
+    BitstreamWriter w;
+    w.emit('B', 8);
+    w.emit('C', 8);
+    w.emit(0x0, 4);
+    w.emit(0xC, 4);
+    w.emit(0xE, 4);
+    w.emit(0xD, 4);
+
+    w.enter_block(MODULE_BLOCK_ID, 3);
+    w.record(MODULE_CODE_VERSION, { module_version });
+    write_types(w);
+
+    // Globals take value numbers 0..n-1 in record order
+    for (auto const& g : m_globals)
+    {
+        if (g.is_function)
+        {
+            // [type, callingconv, isproto, linkage, paramattr, alignment, section, visibility, gc, unnamed_addr]
+            w.record(MODULE_CODE_FUNCTION, { type_i32_fn, 0, 0, 0, 0, 0, 0, 0, 0, 0 });
+        }
+        else
+        {
+            // [type, explicit type | not constant, initid + 1, linkage, alignment, section]
+            w.record(MODULE_CODE_GLOBALVAR, { type_id(g.type), 2, m_globals.size() + g.initializer + 1, 0,
+                encode_alignment(g.type->alignment()), 0 });
+        }
+    }
+    write_constants(w);
+
+    w.enter_block(VALUE_SYMTAB_BLOCK_ID, 4);
+    std::vector<uint64_t> entry;
+    for (size_t i = 0; i < m_globals.size(); ++i)
+    {
+        auto const name = m_globals[i].name;
+        auto const* s = m_interner->name(name);
+        entry.assign(1, i);
+        entry.insert(entry.end(), s, s + m_interner->size(name));
+        w.record(VST_CODE_ENTRY, entry);
+    }
+    w.end_block();
+
+    // Bodies follow in the order of their function records
+    for (auto const& f : m_functions)
+    {
+        write_function(w, f);
+    }
+    w.end_block();
+
+    // The format is little-endian regardless of the host
+    for (auto const word : w.words())
+    {
+        char const bytes[4] = { char(word), char(word >> 8), char(word >> 16), char(word >> 24) };
+        m_out.text(bytes, 4);
+    }
+}
+
+void generate_bitcode(ParseContext const& ast, OutputSink& out)
+{
+    ConstantEvaluator evaluator{ *ast.symbols, ast.interner.get() };
+    BitcodeGenerator g{ out };
+    g.set_interner(ast.interner.get());
+    g.set_evaluator(&evaluator);
+    for (auto const* defn : ast.exprs)
+    {
+        defn->generate(g);
+    }
+    g.finish();
+}
+
+} // namespace ty
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Generator.h"
+#include "BitstreamWriter.h"
+#include "parse/Type.h"
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ty
+{
+
+struct ParseContext;
+
+//! Generates an LLVM bitcode (.bc) module directly, without LLVM libraries.
+//! Emits the same module as LLVM_IR_Generator, so 'llvm-dis' of the output reads like
+//! its text. Definitions are collected by generate(); finish() numbers the values and
+//! writes the module, since bitcode needs every global and constant numbered before
+//! the first function body.
+class BitcodeGenerator : public FileGenerator
+{
+public:
+	template <typename... Args>
+	explicit BitcodeGenerator(Args&&... args) : FileGenerator(std::forward<Args>(args)...) {}
+
+    virtual void generate(FunctionDefnExpr const& expr) override;
+
+    virtual void generate(Int32LiteralExpr const& expr) override;
+
+    virtual void generate(ReturnExpr const& expr) override;
+
+    //! Adds a global; its initializer must fold to a constant
+    virtual void generate(DataDefnExpr const& expr) override;
+
+    virtual void generate(SymbolExpr const& expr) override;
+
+    virtual void generate(FunctionCallExpr const& expr) override;
+
+    virtual void generate(AddExpr const& expr) override;
+
+    virtual void generate(SubExpr const& expr) override;
+
+    //! Writes the module to the output sink
+    //! \throws EvalException if a function uses a name that isn't defined as a value or function
+    void finish();
+
+private:
+    //! Value an instruction uses, resolved to a value number by finish()
+    struct Operand
+    {
+        enum class Kind { Constant, Global, Local };
+
+        Kind        kind = Kind::Constant;
+        uint32_t    index = 0;      //!< Into m_constants, a SymbolId, or a result in the function
+        Expr const* use = nullptr;  //!< For globals: the expression naming it, for errors
+    };
+
+    struct Instruction
+    {
+        enum class Op { Load, Call, Add, Sub, Ret };
+
+        Op          op;
+        Operand     a;
+        Operand     b;
+    };
+
+    struct Global
+    {
+        SymbolId            name;
+        bool                is_function;
+        SystemType const*   type;           //!< For values
+        uint32_t            initializer;    //!< For values: index in m_constants
+    };
+
+    struct Function
+    {
+        std::vector<Instruction>    body;
+        uint32_t                    results = 0;    //!< Instructions producing a value
+    };
+
+    Operand value_of(Expr const& expr);
+
+    Operand constant(SystemType const* type, int64_t value);
+
+    Operand local(Instruction::Op op, Operand a, Operand b);
+
+    void generate_binary(Instruction::Op op, BinaryOpExpr const& expr);
+
+    void write_types(BitstreamWriter& w) const;
+    void write_constants(BitstreamWriter& w) const;
+    void write_function(BitstreamWriter& w, Function const& f) const;
+
+    //! Absolute value number of 'o' in a function whose first result is 'first_local'
+    uint64_t value_number(Operand const& o, uint64_t first_local) const;
+
+    std::vector<Global>                                 m_globals;      //!< In source order
+    std::vector<Function>                               m_functions;    //!< Bodies of the function globals, in order
+    std::vector<std::pair<SystemType const*, int64_t>>  m_constants;
+    std::map<std::pair<NativeType, int64_t>, uint32_t>  m_constant_index;
+    std::unordered_map<SymbolId, uint32_t>              m_global_index;
+
+    Function*   m_function = nullptr;   //!< Function being generated
+    Operand     m_value;                //!< Result of the last expression generated
+};
+
+//! Generates 'ast' as one bitcode module in source order
+//! \throws EvalException on the first definition that can't be generated; nothing is written then
+void generate_bitcode(ParseContext const& ast, OutputSink& out);
+
+} // namespace ty
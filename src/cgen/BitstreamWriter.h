@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cppcoretools/print.h>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace ty
+{
+
+//! Writes the LLVM bitstream container format: fixed-width and variable-width
+//! (VBR) fields packed LSB-first into little-endian 32-bit words, nested blocks
+//! with back-patched lengths, and unabbreviated records.
+//! See https://llvm.org/docs/BitCodeFormat.html
+class BitstreamWriter
+{
+public:
+    //! Abbreviation ids every block has
+    enum : unsigned
+    {
+        END_BLOCK = 0,
+        ENTER_SUBBLOCK = 1,
+        DEFINE_ABBREV = 2,
+        UNABBREV_RECORD = 3
+    };
+
+    //! Appends the low 'width' bits of 'value'
+    void emit(uint32_t value, unsigned width)
+    {
+        CCT_CHECK(width <= 32);
+        m_current |= uint64_t(value) << m_bits;
+        m_bits += width;
+        if (m_bits >= 32)
+        {
+            m_words.push_back(static_cast<uint32_t>(m_current));
+            m_current >>= 32;
+            m_bits -= 32;
+        }
+    }
+
+    //! Appends 'value' in chunks of width - 1 bits, the high bit of each chunk
+    //! marking that another one follows
+    void emit_vbr(uint64_t value, unsigned width)
+    {
+        auto const threshold = uint64_t(1) << (width - 1);
+        while (value >= threshold)
+        {
+            emit(static_cast<uint32_t>((value & (threshold - 1)) | threshold), width);
+            value >>= width - 1;
+        }
+        emit(static_cast<uint32_t>(value), width);
+    }
+
+    //! Pads with zero bits to the next 32-bit boundary
+    void align32()
+    {
+        if (m_bits > 0)
+        {
+            m_words.push_back(static_cast<uint32_t>(m_current));
+            m_current = 0;
+            m_bits = 0;
+        }
+    }
+
+    //! Opens block 'id', whose abbreviation ids are 'abbrev_width' bits wide
+    void enter_block(unsigned id, unsigned abbrev_width)
+    {
+        emit(ENTER_SUBBLOCK, m_abbrev_width);
+        emit_vbr(id, 8);
+        emit_vbr(abbrev_width, 4);
+        align32();
+        m_blocks.push_back(Block{ m_words.size(), m_abbrev_width });
+        m_words.push_back(0); // length in words, patched by end_block()
+        m_abbrev_width = abbrev_width;
+    }
+
+    void end_block()
+    {
+        CCT_CHECK(!m_blocks.empty());
+        emit(END_BLOCK, m_abbrev_width);
+        align32();
+        auto const block = m_blocks.back();
+        m_blocks.pop_back();
+        m_words[block.length_word] = static_cast<uint32_t>(m_words.size() - block.length_word - 1);
+        m_abbrev_width = block.outer_abbrev_width;
+    }
+
+    //! Appends an unabbreviated record
+    void record(unsigned code, uint64_t const* operands, size_t count)
+    {
+        emit(UNABBREV_RECORD, m_abbrev_width);
+        emit_vbr(code, 6);
+        emit_vbr(count, 6);
+        for (size_t i = 0; i < count; ++i)
+        {
+            emit_vbr(operands[i], 6);
+        }
+    }
+
+    void record(unsigned code, std::initializer_list<uint64_t> operands)
+    {
+        record(code, operands.begin(), operands.size());
+    }
+
+    void record(unsigned code, std::vector<uint64_t> const& operands)
+    {
+        record(code, operands.data(), operands.size());
+    }
+
+    //! Words written so far
+    //! \pre every block is closed and the stream is 32-bit aligned
+    std::vector<uint32_t> const& words() const
+    {
+        CCT_CHECK(m_blocks.empty() && m_bits == 0);
+        return m_words;
+    }
+
+private:
+    struct Block
+    {
+        size_t      length_word;            //!< Index of the block's length word
+        unsigned    outer_abbrev_width;     //!< Abbreviation width to restore on end_block()
+    };
+
+    std::vector<uint32_t>   m_words;
+    uint64_t                m_current = 0;      //!< Bits not yet forming a whole word
+    unsigned                m_bits = 0;         //!< Number of valid bits in m_current
+    unsigned                m_abbrev_width = 2; //!< Width at the top level
+    std::vector<Block>      m_blocks;
+};
+
+//! Encodes a signed value the way bitcode expects it in a VBR field: the magnitude
+//! shifted left by one, with the sign in the lowest bit
+inline uint64_t encode_signed(int64_t value)
+{
+    auto const v = uint64_t(value);
+    return value >= 0 ? v << 1 : ((uint64_t(0) - v) << 1) | 1;
+}
+
+} // namespace ty
@@ -0,0 +1,361 @@
+#include "CompileCache.h"
+#include "LLVM_IR_Generator.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace ty
+{
+
+namespace
+{
+
+//! Changes whenever the generated code or the key derivation changes, orphaning old entries
+constexpr char const* cache_salt = "tycache 1 llvm_ir";
+
+//! First line of an entry; the payload length detects truncated files
+constexpr char const* entry_magic = "tycache1 ";
+
+uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+struct Entry
+{
+    std::string name;
+    uint64_t    size;
+    int64_t     used;   //!< Modification time, refreshed by load()
+};
+
+std::vector<Entry> list_entries(std::string const& directory, std::string const& suffix)
+{
+    std::vector<Entry> entries;
+    auto const is_entry = [&](std::string const& name)
+    {
+        return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    auto const handle = FindFirstFileA((directory + "\\*" + suffix).c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return entries;
+    }
+    do
+    {
+        if (is_entry(data.cFileName))
+        {
+            entries.push_back(Entry{ data.cFileName, (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow,
+                int64_t((uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime) });
+        }
+    } while (FindNextFileA(handle, &data));
+    FindClose(handle);
+#else
+    auto* dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        return entries;
+    }
+    while (auto const* d = readdir(dir))
+    {
+        std::string const name = d->d_name;
+        struct stat info;
+        if (is_entry(name) && stat((directory + "/" + name).c_str(), &info) == 0)
+        {
+            entries.push_back(Entry{ name, static_cast<uint64_t>(info.st_size), static_cast<int64_t>(info.st_mtime) });
+        }
+    }
+    closedir(dir);
+#endif
+    return entries;
+}
+
+//! Marks the file at 'path' as used now
+void touch(std::string const& path)
+{
+#ifdef _WIN32
+    auto const handle = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle != INVALID_HANDLE_VALUE)
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        SetFileTime(handle, nullptr, nullptr, &now);
+        CloseHandle(handle);
+    }
+#else
+    utime(path.c_str(), nullptr);
+#endif
+}
+
+bool make_directory(std::string const& path)
+{
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0777) == 0 || errno == EEXIST;
+#endif
+}
+
+int process_id()
+{
+#ifdef _WIN32
+    return _getpid();
+#else
+    return static_cast<int>(getpid());
+#endif
+}
+
+//! Computes the key of every top-level definition
+class KeyBuilder
+{
+public:
+    KeyBuilder(ParseContext const& ast, TokenList const& tokens)
+        : m_ast{ ast }, m_tokens{ tokens }, m_keys(ast.exprs.size()), m_state(ast.exprs.size(), State::Pending)
+    {
+        for (size_t i = 0; i < ast.exprs.size(); ++i)
+        {
+            m_index[ast.exprs[i]] = i;
+        }
+    }
+
+    CacheKey const& key(size_t i)
+    {
+        if (m_state[i] != State::Done)
+        {
+            build(i);
+        }
+        return m_keys[i];
+    }
+
+private:
+    enum class State : uint8_t { Pending, InProgress, Done };
+
+    void build(size_t i)
+    {
+        // A cycle is an error the generator reports; it only needs a stable key meanwhile
+        m_state[i] = State::InProgress;
+        auto const first = m_ast.exprs[i]->token();
+        auto const last = i + 1 < m_ast.exprs.size() ? m_ast.exprs[i + 1]->token() : m_tokens.size();
+
+        CacheHasher h;
+        h.field(cache_salt, std::char_traits<char>::length(cache_salt));
+        for (size_t t = first; t < last; ++t)
+        {
+            auto const item = m_tokens[t];
+            if (item.type == LexItem::Type::eof)
+            {
+                break;
+            }
+            auto const type = static_cast<uint8_t>(item.type);
+            h.bytes(&type, 1);
+            h.field(item.begin, static_cast<size_t>(item.end - item.begin));
+            if (item.type != LexItem::Type::ID || t == first)
+            {
+                continue;
+            }
+            auto const* target = m_ast.symbols->expr_at(item.symbol);
+            auto const found = target ? m_index.find(target) : m_index.end();
+            if (found != m_index.end() && m_state[found->second] != State::InProgress)
+            {
+                h.key(key(found->second));
+            }
+        }
+        m_keys[i] = h.digest();
+        m_state[i] = State::Done;
+    }
+
+    ParseContext const&                         m_ast;
+    TokenList const&                            m_tokens;
+    std::vector<CacheKey>                       m_keys;
+    std::vector<State>                          m_state;
+    std::unordered_map<Expr const*, size_t>     m_index;
+};
+
+} // namespace
+
+std::string CacheKey::hex() const
+{
+    char text[33];
+    snprintf(text, sizeof(text), "%016llx%016llx", static_cast<unsigned long long>(hi), static_cast<unsigned long long>(lo));
+    return text;
+}
+
+CacheHasher& CacheHasher::bytes(void const* data, size_t size)
+{
+    // Two FNV-style lanes with different multipliers, mixed again by digest()
+    auto const* p = static_cast<unsigned char const*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        m_a = (m_a ^ p[i]) * 0x100000001B3ull;
+        m_b = (m_b ^ p[i]) * 0x9E3779B97F4A7C15ull;
+    }
+    return *this;
+}
+
+CacheHasher& CacheHasher::field(void const* data, size_t size)
+{
+    uint64_t const n = size;
+    return bytes(&n, sizeof(n)).bytes(data, size);
+}
+
+CacheKey CacheHasher::digest() const
+{
+    CacheKey k;
+    k.hi = mix(m_a ^ mix(m_b));
+    k.lo = mix(m_b + 0x632BE59BD9B4E019ull) ^ m_a;
+    return k;
+}
+
+CompileCache::CompileCache(std::string directory, uint64_t max_bytes, std::string suffix)
+    : m_directory{ std::move(directory) }, m_suffix{ std::move(suffix) }, m_max_bytes{ max_bytes }
+{
+    while (m_directory.size() > 1 && (m_directory.back() == '/' || m_directory.back() == '\\'))
+    {
+        m_directory.pop_back();
+    }
+    // Parents first
+    for (size_t i = 1; i < m_directory.size(); ++i)
+    {
+        if (m_directory[i] == '/' || m_directory[i] == '\\')
+        {
+            make_directory(m_directory.substr(0, i));
+        }
+    }
+    if (!make_directory(m_directory))
+    {
+        throw CacheException("Cannot create cache directory " + m_directory);
+    }
+}
+
+std::string CompileCache::path(CacheKey const& key) const
+{
+    return m_directory + "/" + key.hex() + m_suffix;
+}
+
+bool CompileCache::load(CacheKey const& key, std::string& fragment)
+{
+    auto const file_path = path(key);
+    auto* f = std::fopen(file_path.c_str(), "rb");
+    if (!f)
+    {
+        ++m_stats.misses;
+        return false;
+    }
+    unsigned long long size = 0;
+    auto valid = std::fscanf(f, "tycache1 %llu\n", &size) == 1;
+    if (valid)
+    {
+        fragment.resize(static_cast<size_t>(size));
+        valid = std::fread(&fragment[0], 1, fragment.size(), f) == fragment.size() && std::fgetc(f) == EOF;
+    }
+    std::fclose(f);
+    if (!valid)
+    {
+        ++m_stats.misses;
+        return false;
+    }
+    touch(file_path);
+    ++m_stats.hits;
+    return true;
+}
+
+void CompileCache::store(CacheKey const& key, std::string const& fragment)
+{
+    auto const final_path = path(key);
+    auto const temp_path = final_path + ".tmp" + std::to_string(process_id());
+    auto* f = std::fopen(temp_path.c_str(), "wb");
+    if (!f)
+    {
+        return;
+    }
+    auto ok = std::fprintf(f, "%s%llu\n", entry_magic, static_cast<unsigned long long>(fragment.size())) > 0
+        && std::fwrite(fragment.data(), 1, fragment.size(), f) == fragment.size();
+    ok = std::fclose(f) == 0 && ok;
+    // rename() doesn't replace an existing file on Windows, but that entry has the same contents
+    if (!ok || std::rename(temp_path.c_str(), final_path.c_str()) != 0)
+    {
+        std::remove(temp_path.c_str());
+        return;
+    }
+    ++m_stats.stored;
+}
+
+void CompileCache::trim()
+{
+    auto entries = list_entries(m_directory, m_suffix);
+    uint64_t total = 0;
+    for (auto const& e : entries)
+    {
+        total += e.size;
+    }
+    if (total <= m_max_bytes)
+    {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b)
+    {
+        return a.used != b.used ? a.used < b.used : a.name < b.name;
+    });
+    for (auto const& e : entries)
+    {
+        if (total <= m_max_bytes)
+        {
+            break;
+        }
+        if (std::remove((m_directory + "/" + e.name).c_str()) == 0)
+        {
+            total -= e.size;
+            ++m_stats.evicted;
+        }
+    }
+}
+
+void generate_cached(ParseContext const& ast, TokenList const& tokens, OutputSink& out, CompileCache& cache)
+{
+    ConstantEvaluator evaluator{ *ast.symbols, ast.interner.get() };
+    KeyBuilder keys{ ast, tokens };
+    std::string fragment;
+    auto const stored = cache.stats().stored;
+    for (size_t i = 0; i < ast.exprs.size(); ++i)
+    {
+        auto const& key = keys.key(i);
+        if (!cache.load(key, fragment))
+        {
+            StringSink sink;
+            LLVM_IR_Generator g{ sink };
+            g.set_interner(ast.interner.get());
+            g.set_evaluator(&evaluator);
+            ast.exprs[i]->generate(g);
+            fragment = sink.str();
+            cache.store(key, fragment);
+        }
+        out.text(fragment.data(), fragment.size());
+    }
+    if (cache.stats().stored != stored)
+    {
+        cache.trim();
+    }
+}
+
+} // namespace ty
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "token/TokenList.h"
+#include "cgen/OutputSink.h"
+
+#include <cstdint>
+#include <exception>
+#include <string>
+
+namespace ty
+{
+
+struct ParseContext;
+
+struct CacheException : public std::exception
+{
+    explicit CacheException(std::string msg) : m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    std::string m_message;
+};
+
+//! 128-bit key of a cache entry
+struct CacheKey
+{
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    //! 32 lowercase hex digits, used as the entry's file name
+    std::string hex() const;
+};
+
+//! Incremental hash of the inputs of a definition's code. Not cryptographic: it guards
+//! against accidental collisions, not against someone crafting them.
+class CacheHasher
+{
+public:
+    CacheHasher& bytes(void const* data, size_t size);
+
+    //! Adds 'size' first, so adjacent fields can't run into each other
+    CacheHasher& field(void const* data, size_t size);
+
+    CacheHasher& key(CacheKey const& k) { return bytes(&k.hi, sizeof(k.hi)).bytes(&k.lo, sizeof(k.lo)); }
+
+    CacheKey digest() const;
+
+private:
+    uint64_t m_a = 0xCBF29CE484222325ull;
+    uint64_t m_b = 0x84222325CBF29CE4ull;
+};
+
+//! Directory of generated code fragments keyed by the hash of their inputs.
+//! Entries are written to a temporary file and renamed into place, so concurrent
+//! compiles sharing the directory never see partial entries. Reading an entry marks it
+//! as recently used; trim() evicts the least recently used entries beyond the size limit.
+class CompileCache
+{
+public:
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t stored = 0;
+        size_t evicted = 0;
+    };
+
+    //! Creates 'directory' if it doesn't exist. Entries are named <key><suffix>, with the
+    //! suffix saying what the caller stores, e.g. ".ll" for LLVM IR fragments; trim() only
+    //! considers files with that suffix.
+    //! \throws CacheException if it can't be created
+    CompileCache(std::string directory, uint64_t max_bytes, std::string suffix);
+
+    //! Replaces 'fragment' with the entry for 'key' and returns true if there is one
+    bool load(CacheKey const& key, std::string& fragment);
+
+    //! Adds an entry; failures are ignored, the cache being only an optimization
+    void store(CacheKey const& key, std::string const& fragment);
+
+    //! Deletes the least recently used entries until the rest fit in the size limit
+    void trim();
+
+    Stats const& stats() const noexcept { return m_stats; }
+
+private:
+    std::string path(CacheKey const& key) const;
+
+    std::string m_directory;
+    std::string m_suffix;
+    uint64_t    m_max_bytes;
+    Stats       m_stats;
+};
+
+//! Generates LLVM IR like generate_serial(), reusing the cached fragment of every top-level
+//! definition whose key is unchanged and storing the fragments it had to generate.
+//! A definition's key covers its tokens and the keys of the top-level definitions it
+//! references through the SymbolTable, so editing a definition also regenerates every
+//! definition whose folded constants may depend on it, while whitespace is irrelevant.
+//! \throws EvalException like generate_serial(); fragments before the failing definition
+//!         have been written and stored
+void generate_cached(ParseContext const& ast, TokenList const& tokens, OutputSink& out, CompileCache& cache);
+
+} // namespace ty
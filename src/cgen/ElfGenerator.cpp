@@ -0,0 +1,443 @@
+#include "ElfGenerator.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+#include "parse/SymbolTable.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+
+namespace ty
+{
+
+namespace
+{
+
+// From the System V ABI and its x86-64 supplement
+enum SectionType : uint32_t
+{
+    SHT_NULL = 0,
+    SHT_PROGBITS = 1,
+    SHT_SYMTAB = 2,
+    SHT_STRTAB = 3,
+    SHT_RELA = 4
+};
+
+enum SectionFlags : uint64_t
+{
+    SHF_WRITE = 0x1,
+    SHF_ALLOC = 0x2,
+    SHF_EXECINSTR = 0x4,
+    SHF_INFO_LINK = 0x40
+};
+
+enum SymbolBinding : uint8_t
+{
+    STB_LOCAL = 0,
+    STB_GLOBAL = 1
+};
+
+enum SymbolType : uint8_t
+{
+    STT_OBJECT = 1,
+    STT_FUNC = 2
+};
+
+enum RelocationType : uint32_t
+{
+    R_X86_64_PC32 = 2,
+    R_X86_64_PLT32 = 4
+};
+
+constexpr uint16_t ET_REL = 1;
+constexpr uint16_t EM_X86_64 = 62;
+constexpr size_t ehdr_size = 64;
+constexpr size_t shdr_size = 64;
+constexpr size_t sym_size = 24;
+constexpr size_t rela_size = 24;
+
+// Section header indices, in the order written by finish()
+enum Section : uint16_t
+{
+    section_null,
+    section_text,
+    section_data,
+    section_rela_text,
+    section_symtab,
+    section_strtab,
+    section_shstrtab,
+    section_note_stack,     //!< Empty .note.GNU-stack: the object doesn't need an executable stack
+    section_count
+};
+
+// Instructions used by the generator; displacements and immediates follow them
+constexpr uint8_t push_rbp[] = { 0x55 };
+constexpr uint8_t mov_rbp_rsp[] = { 0x48, 0x89, 0xE5 };
+constexpr uint8_t sub_rsp_imm32[] = { 0x48, 0x81, 0xEC };
+constexpr uint8_t mov_eax_imm32[] = { 0xB8 };
+constexpr uint8_t mov_eax_rip32[] = { 0x8B, 0x05 };
+constexpr uint8_t call_rel32[] = { 0xE8 };
+constexpr uint8_t mov_rbp32_eax[] = { 0x89, 0x85 };
+constexpr uint8_t mov_eax_rbp32[] = { 0x8B, 0x85 };
+constexpr uint8_t mov_ecx_eax[] = { 0x89, 0xC1 };
+constexpr uint8_t leave_ret[] = { 0xC9, 0xC3 };
+constexpr uint8_t add_eax_imm32 = 0x05;
+constexpr uint8_t add_eax_ecx = 0x01;
+constexpr uint8_t sub_eax_imm32 = 0x2D;
+constexpr uint8_t sub_eax_ecx = 0x29;
+constexpr uint8_t modrm_eax_ecx = 0xC8;
+
+//! Offset of the frame size in the prologue: push rbp; mov rbp, rsp; sub rsp, imm32
+constexpr size_t frame_size_offset = sizeof(push_rbp) + sizeof(mov_rbp_rsp) + sizeof(sub_rsp_imm32);
+
+//! Appends little-endian integers to a byte buffer
+class ByteWriter
+{
+public:
+    void u8(uint8_t v) { m_bytes.push_back(v); }
+    void u16(uint16_t v) { put(v, 2); }
+    void u32(uint32_t v) { put(v, 4); }
+    void u64(uint64_t v) { put(v, 8); }
+
+    void append(std::vector<uint8_t> const& v) { m_bytes.insert(m_bytes.end(), v.begin(), v.end()); }
+
+    //! Pads with zeros to a multiple of 'alignment'
+    void align(size_t alignment)
+    {
+        m_bytes.resize((m_bytes.size() + alignment - 1) / alignment * alignment);
+    }
+
+    size_t size() const noexcept { return m_bytes.size(); }
+    std::vector<uint8_t>& bytes() noexcept { return m_bytes; }
+
+private:
+    void put(uint64_t v, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            m_bytes.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    std::vector<uint8_t> m_bytes;
+};
+
+//! String table section: starts with the empty name, offsets are returned by add()
+class StringTable
+{
+public:
+    StringTable() { m_bytes.push_back(0); }
+
+    uint32_t add(char const* s)
+    {
+        auto const offset = static_cast<uint32_t>(m_bytes.size());
+        m_bytes.insert(m_bytes.end(), s, s + std::char_traits<char>::length(s) + 1);
+        return offset;
+    }
+
+    std::vector<uint8_t> const& bytes() const noexcept { return m_bytes; }
+
+private:
+    std::vector<uint8_t> m_bytes;
+};
+
+void section_header(ByteWriter& w, uint32_t name, uint32_t type, uint64_t flags, uint64_t offset, uint64_t size,
+                    uint32_t link, uint32_t info, uint64_t alignment, uint64_t entry_size)
+{
+    w.u32(name);
+    w.u32(type);
+    w.u64(flags);
+    w.u64(0);           // address
+    w.u64(offset);
+    w.u64(size);
+    w.u32(link);
+    w.u32(info);
+    w.u64(alignment);
+    w.u64(entry_size);
+}
+
+} // namespace
+
+void ElfGenerator::generate(FunctionDefnExpr const& expr)
+{
+    // Checked first: the definitions of a block body would be emitted inside this function
+    if (expr.m_returns.empty())
+    {
+        throw EvalException(&expr, std::string("Function '") + m_interner->name(expr.id()) + "' doesn't return a value");
+    }
+    m_index[expr.id()] = static_cast<uint32_t>(m_definitions.size());
+    m_definitions.push_back(Definition{ expr.id(), true, m_text.size(), 0 });
+    m_depth = 0;
+    m_max_depth = 0;
+
+    bytes(push_rbp);
+    bytes(mov_rbp_rsp);
+    bytes(sub_rsp_imm32);
+    imm32(0);
+
+    for (auto const& a : expr.m_body->exprs)
+    {
+        a->generate(*this);
+    }
+
+    // Spill slots are 8 bytes; keep rsp 16-byte aligned at calls
+    auto& defn = m_definitions.back();
+    auto const frame_size = (m_max_depth * 8 + 15) / 16 * 16;
+    for (int i = 0; i < 4; ++i)
+    {
+        m_text[defn.offset + frame_size_offset + i] = static_cast<uint8_t>(frame_size >> (8 * i));
+    }
+    defn.size = m_text.size() - defn.offset;
+}
+
+void ElfGenerator::generate(Int32LiteralExpr const& expr)
+{
+    errno = 0;
+    auto const value = std::strtoll(expr.text(), nullptr, 10);
+    if (errno == ERANGE || value < INT32_MIN || value > INT32_MAX)
+    {
+        throw EvalException(&expr, std::string("Literal ") + expr.text() + " out of range for i32");
+    }
+    bytes(mov_eax_imm32);
+    imm32(static_cast<uint32_t>(value));
+}
+
+void ElfGenerator::generate(ReturnExpr const& expr)
+{
+    value_of(*expr.sub_expr());
+    bytes(leave_ret);
+}
+
+void ElfGenerator::generate(DataDefnExpr const& expr)
+{
+    auto const* c = m_evaluator ? m_evaluator->evaluate(expr) : nullptr;
+    if (!c)
+    {
+        throw EvalException(&expr, std::string("Initializer of '") + m_interner->name(expr.id()) + "' is not a compile-time constant");
+    }
+    auto const size = static_cast<size_t>(c->type->alignment());
+    m_data.resize((m_data.size() + size - 1) / size * size);
+    m_index[expr.id()] = static_cast<uint32_t>(m_definitions.size());
+    m_definitions.push_back(Definition{ expr.id(), false, m_data.size(), size });
+    for (size_t i = 0; i < size; ++i)
+    {
+        m_data.push_back(static_cast<uint8_t>(static_cast<uint64_t>(c->value) >> (8 * i)));
+    }
+}
+
+void ElfGenerator::generate(SymbolExpr const& expr)
+{
+    bytes(mov_eax_rip32);
+    m_relocations.push_back(Relocation{ m_text.size(), expr.name(), false, &expr });
+    imm32(0);
+}
+
+void ElfGenerator::generate(FunctionCallExpr const& expr)
+{
+    bytes(call_rel32);
+    m_relocations.push_back(Relocation{ m_text.size(), expr.callee(), true, &expr });
+    imm32(0);
+}
+
+void ElfGenerator::generate(AddExpr const& expr)
+{
+    generate_binary(expr, add_eax_imm32, add_eax_ecx);
+}
+
+void ElfGenerator::generate(SubExpr const& expr)
+{
+    generate_binary(expr, sub_eax_imm32, sub_eax_ecx);
+}
+
+void ElfGenerator::generate_binary(BinaryOpExpr const& expr, uint8_t op_imm, uint8_t op_reg)
+{
+    int64_t rhs = 0;
+    if (fold(*expr.right(), rhs))
+    {
+        value_of(*expr.left());
+        m_text.push_back(op_imm);
+        imm32(static_cast<uint32_t>(rhs));
+        return;
+    }
+    value_of(*expr.left());
+    auto const slot = push_slot();
+    bytes(mov_rbp32_eax);
+    imm32(static_cast<uint32_t>(slot));
+    value_of(*expr.right());
+    bytes(mov_ecx_eax);
+    bytes(mov_eax_rbp32);
+    imm32(static_cast<uint32_t>(slot));
+    m_text.push_back(op_reg);
+    m_text.push_back(modrm_eax_ecx);
+    pop_slot();
+}
+
+void ElfGenerator::value_of(Expr const& expr)
+{
+    int64_t value = 0;
+    if (fold(expr, value))
+    {
+        bytes(mov_eax_imm32);
+        imm32(static_cast<uint32_t>(value));
+        return;
+    }
+    expr.generate(*this);
+}
+
+bool ElfGenerator::fold(Expr const& expr, int64_t& value)
+{
+    auto const* c = folder() ? folder()->evaluate(expr) : nullptr;
+    if (c)
+    {
+        value = c->value;
+    }
+    return c != nullptr;
+}
+
+void ElfGenerator::imm32(uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        m_text.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+int32_t ElfGenerator::push_slot()
+{
+    ++m_depth;
+    m_max_depth = std::max(m_max_depth, m_depth);
+    return -8 * static_cast<int32_t>(m_depth);
+}
+
+void ElfGenerator::finish()
+{
+    // Check every reference before writing anything
+    for (auto const& r : m_relocations)
+    {
+        auto const found = m_index.find(r.name);
+        if (found == m_index.end())
+        {
+            throw EvalException(r.use, std::string("Undefined symbol '") + m_interner->name(r.name) + "'");
+        }
+        if (m_definitions[found->second].is_function != r.is_call)
+        {
+            throw EvalException(r.use, std::string("'") + m_interner->name(r.name) + (r.is_call ? "' is not a function" : "' is not a value"));
+        }
+    }
+
+    // Local symbols must precede global ones; both keep source order
+    auto const& exports = Global<ExportList>();
+    auto const exported = [&](Definition const& d)
+    {
+        return exports.empty() || std::find(exports.begin(), exports.end(), m_interner->name(d.name)) != exports.end();
+    };
+    std::vector<uint32_t> order(m_definitions.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    auto const first_global = std::stable_partition(order.begin(), order.end(),
+        [&](uint32_t i) { return !exported(m_definitions[i]); }) - order.begin();
+    std::vector<uint32_t> symbol_of(m_definitions.size());    // Symbol table index of each definition
+
+    StringTable strtab;
+    ByteWriter symtab;
+    symtab.bytes().resize(sym_size);    // Null symbol
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        auto const& d = m_definitions[order[i]];
+        symbol_of[order[i]] = static_cast<uint32_t>(i + 1);
+        auto const binding = static_cast<long>(i) < first_global ? STB_LOCAL : STB_GLOBAL;
+        symtab.u32(strtab.add(m_interner->name(d.name)));
+        symtab.u8(static_cast<uint8_t>((binding << 4) | (d.is_function ? STT_FUNC : STT_OBJECT)));
+        symtab.u8(0);   // Default visibility
+        symtab.u16(d.is_function ? section_text : section_data);
+        symtab.u64(d.offset);
+        symtab.u64(d.size);
+    }
+
+    // Fields hold S + A - P; the CPU adds them to the address of the next instruction, 4 bytes on
+    ByteWriter rela;
+    for (auto const& r : m_relocations)
+    {
+        auto const symbol = symbol_of[m_index[r.name]];
+        rela.u64(r.offset);
+        rela.u64((uint64_t(symbol) << 32) | (r.is_call ? R_X86_64_PLT32 : R_X86_64_PC32));
+        rela.u64(static_cast<uint64_t>(int64_t(-4)));
+    }
+
+    StringTable shstrtab;
+    uint32_t const names[section_count] = { 0, shstrtab.add(".text"), shstrtab.add(".data"), shstrtab.add(".rela.text"),
+        shstrtab.add(".symtab"), shstrtab.add(".strtab"), shstrtab.add(".shstrtab"), shstrtab.add(".note.GNU-stack") };
+
+    // Contents follow the ELF header; section headers come last
+    ByteWriter w;
+    w.bytes().resize(ehdr_size);
+    uint64_t offsets[section_count] = {};
+    auto const place = [&](Section s, std::vector<uint8_t> const& contents, size_t alignment)
+    {
+        w.align(alignment);
+        offsets[s] = w.size();
+        w.append(contents);
+    };
+    place(section_text, m_text, 16);
+    place(section_data, m_data, 8);
+    place(section_rela_text, rela.bytes(), 8);
+    place(section_symtab, symtab.bytes(), 8);
+    place(section_strtab, strtab.bytes(), 1);
+    place(section_shstrtab, shstrtab.bytes(), 1);
+    offsets[section_note_stack] = w.size();
+    w.align(8);
+    auto const section_headers = w.size();
+
+    section_header(w, 0, SHT_NULL, 0, 0, 0, 0, 0, 0, 0);
+    section_header(w, names[section_text], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, offsets[section_text], m_text.size(), 0, 0, 16, 0);
+    section_header(w, names[section_data], SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, offsets[section_data], m_data.size(), 0, 0, 8, 0);
+    section_header(w, names[section_rela_text], SHT_RELA, SHF_INFO_LINK, offsets[section_rela_text], rela.size(),
+                   section_symtab, section_text, 8, rela_size);
+    section_header(w, names[section_symtab], SHT_SYMTAB, 0, offsets[section_symtab], symtab.size(),
+                   section_strtab, static_cast<uint32_t>(first_global + 1), 8, sym_size);
+    section_header(w, names[section_strtab], SHT_STRTAB, 0, offsets[section_strtab], strtab.bytes().size(), 0, 0, 1, 0);
+    section_header(w, names[section_shstrtab], SHT_STRTAB, 0, offsets[section_shstrtab], shstrtab.bytes().size(), 0, 0, 1, 0);
+    section_header(w, names[section_note_stack], SHT_PROGBITS, 0, offsets[section_note_stack], 0, 0, 0, 1, 0);
+
+    ByteWriter header;
+    uint8_t const ident[16] = { 0x7F, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little-endian */, 1 /* version */ };
+    for (auto const b : ident)
+    {
+        header.u8(b);
+    }
+    header.u16(ET_REL);
+    header.u16(EM_X86_64);
+    header.u32(1);      // version
+    header.u64(0);      // entry
+    header.u64(0);      // program headers
+    header.u64(section_headers);
+    header.u32(0);      // flags
+    header.u16(ehdr_size);
+    header.u16(0);      // program header entry size
+    header.u16(0);      // program header count
+    header.u16(shdr_size);
+    header.u16(section_count);
+    header.u16(section_shstrtab);
+    std::copy(header.bytes().begin(), header.bytes().end(), w.bytes().begin());
+
+    m_out.text(reinterpret_cast<char const*>(w.bytes().data()), w.size());
+}
+
+void generate_elf(ParseContext const& ast, OutputSink& out, bool fold)
+{
+    ConstantEvaluator evaluator{ *ast.symbols, ast.interner.get() };
+    ElfGenerator g{ out };
+    g.set_interner(ast.interner.get());
+    g.set_evaluator(&evaluator);
+    g.set_folding(fold);
+    for (auto const* defn : ast.exprs)
+    {
+        defn->generate(g);
+    }
+    g.finish();
+}
+
+} // namespace ty
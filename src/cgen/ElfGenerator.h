@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Generator.h"
+#include "parse/Type.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ty
+{
+
+struct ParseContext;
+
+//! Generates x86-64 machine code directly into a relocatable ELF object (.o), for
+//! debug builds that don't need LLVM's optimizer.
+//! Code is emitted in one pass with a stack-slot strategy: every expression leaves its
+//! value in eax, and a binary operation spills its left operand to a frame slot while
+//! the right one is computed, so no register allocation is needed. Functions follow the
+//! System V ABI, so the object links with C code using the system linker. Names in the
+//! ExportList become global symbols and the others local; an empty ExportList exports
+//! every definition, like the LLVM backends.
+class ElfGenerator : public FileGenerator
+{
+public:
+	template <typename... Args>
+	explicit ElfGenerator(Args&&... args) : FileGenerator(std::forward<Args>(args)...) {}
+
+    virtual void generate(FunctionDefnExpr const& expr) override;
+
+    virtual void generate(Int32LiteralExpr const& expr) override;
+
+    virtual void generate(ReturnExpr const& expr) override;
+
+    //! Adds a global to .data; its initializer must fold to a constant
+    virtual void generate(DataDefnExpr const& expr) override;
+
+    virtual void generate(SymbolExpr const& expr) override;
+
+    virtual void generate(FunctionCallExpr const& expr) override;
+
+    virtual void generate(AddExpr const& expr) override;
+
+    virtual void generate(SubExpr const& expr) override;
+
+    //! Writes the object file to the output sink
+    //! \throws EvalException if a function uses a name that isn't defined as a value or function
+    void finish();
+
+private:
+    //! A function in .text or a value in .data
+    struct Definition
+    {
+        SymbolId    name;
+        bool        is_function;
+        uint64_t    offset;     //!< In its section
+        uint64_t    size;
+    };
+
+    //! Reference from .text to a definition, resolved by finish()
+    struct Relocation
+    {
+        uint64_t    offset;     //!< Of the 32-bit field in .text
+        SymbolId    name;
+        bool        is_call;
+        Expr const* use;
+    };
+
+    //! Emits code leaving the value of 'expr' in eax
+    void value_of(Expr const& expr);
+
+    //! Folds 'expr' if folding is on, there is an evaluator and 'expr' is constant
+    bool fold(Expr const& expr, int64_t& value);
+
+    template <size_t N>
+    void bytes(uint8_t const (&code)[N]) { m_text.insert(m_text.end(), code, code + N); }
+
+    void imm32(uint32_t value);
+
+    //! Emits 'add/sub eax, imm32' or, with the right operand in ecx, 'add/sub eax, ecx'
+    void generate_binary(BinaryOpExpr const& expr, uint8_t op_imm, uint8_t op_reg);
+
+    //! Returns the frame offset of a new spill slot below rbp
+    int32_t push_slot();
+    void pop_slot() { --m_depth; }
+
+    std::vector<uint8_t>                        m_text;
+    std::vector<uint8_t>                        m_data;
+    std::vector<Definition>                     m_definitions;  //!< In source order
+    std::vector<Relocation>                     m_relocations;
+    std::unordered_map<SymbolId, uint32_t>      m_index;        //!< Into m_definitions
+
+    uint32_t    m_depth = 0;        //!< Spill slots in use in the current function
+    uint32_t    m_max_depth = 0;
+};
+
+//! Generates 'ast' as one relocatable x86-64 ELF object in source order. Without 'fold',
+//! function bodies aren't folded, so every use of a global or function is a relocation.
+//! \throws EvalException on the first definition that can't be generated; nothing is written then
+void generate_elf(ParseContext const& ast, OutputSink& out, bool fold = true);
+
+} // namespace ty
@@ -0,0 +1,371 @@
+#include "LLVM_IR_Generator.h"
+#include "parse/FlatAst.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
+
+namespace ty
+{
+
+namespace
+{
+
+//! No definition, or no named node being evaluated
+constexpr NodeIndex no_node = UINT32_MAX;
+
+//! Folds FlatAst nodes as ConstantEvaluator folds the Expr nodes they were made from.
+//! Names resolve to the module's top-level definitions, which is all the SymbolTable
+//! holds once parsing is done. Int32Literal is the only literal, so every value is an i32.
+class FlatEvaluator
+{
+public:
+    explicit FlatEvaluator(FlatAst const& ast)
+        : m_ast{ ast }, m_state(ast.size(), State::Unvisited), m_value(ast.size(), 0)
+    {
+        auto const& root = ast[FlatAst::root];
+        for (uint32_t k = 0; k < root.child_count; ++k)
+        {
+            auto const d = ast.child(FlatAst::root, k);
+            auto const name = ast[d].symbol;
+            if (name == invalid_symbol)
+            {
+                continue;
+            }
+            if (name >= m_definitions.size())
+            {
+                m_definitions.resize(name + 1, no_node);
+            }
+            m_definitions[name] = d;
+        }
+    }
+
+    //! Folds node 'i' (for a FunctionDefn: the result of calling it)
+    //! \returns false if it isn't a compile-time constant
+    //! \throws FlatCodegenException on cycles, overflow and undefined names. The evaluator
+    //!         can't be used any more then, which doesn't matter as generation stops.
+    bool evaluate(NodeIndex i, int64_t& value)
+    {
+        switch (m_state[i])
+        {
+        case State::Folded:
+            value = m_value[i];
+            return true;
+        case State::NotConstant:
+            return false;
+        case State::InProgress:
+            // Report the cycle by the definition it was found in, if 'i' itself has no name
+            throw FlatCodegenException("Cyclic definition of '" + name_of(is_named(i) ? i : m_definition) + "'");
+        default:
+            break;
+        }
+
+        m_state[i] = State::InProgress;
+        auto const outer_definition = m_definition;
+        if (is_named(i))
+        {
+            m_definition = i;
+        }
+        auto const folded = fold(i, m_value[i]);
+        m_definition = outer_definition;
+        m_state[i] = folded ? State::Folded : State::NotConstant;
+        value = m_value[i];
+        return folded;
+    }
+
+private:
+    enum class State : uint8_t { Unvisited, InProgress, Folded, NotConstant };
+
+    //! Whether the Expr of node 'i' has an id(); Symbol and FunctionCall keep the name they use instead
+    bool is_named(NodeIndex i) const
+    {
+        auto const kind = m_ast[i].kind;
+        return m_ast[i].symbol != invalid_symbol && kind != FlatNodeKind::Symbol && kind != FlatNodeKind::FunctionCall;
+    }
+
+    std::string name_of(NodeIndex i) const
+    {
+        return i == no_node ? "<anonymous>" : m_ast.name(m_ast[i].symbol);
+    }
+
+    NodeIndex resolve(SymbolId name) const
+    {
+        if (name >= m_definitions.size() || m_definitions[name] == no_node)
+        {
+            throw FlatCodegenException(std::string("Undefined symbol '") + m_ast.name(name) + "'");
+        }
+        return m_definitions[name];
+    }
+
+    bool fold(NodeIndex i, int64_t& value)
+    {
+        auto const& n = m_ast[i];
+        switch (n.kind)
+        {
+        case FlatNodeKind::FunctionDefn:
+            // Only functions without parameters whose body is a single return are folded
+            return n.child_count == 1 && m_ast[m_ast.child(i, 0)].kind == FlatNodeKind::Return
+                && evaluate(m_ast.child(i, 0), value);
+        case FlatNodeKind::Int32Literal:
+        {
+            errno = 0;
+            char* end = nullptr;
+            value = std::strtoll(m_ast.text(i), &end, 10);
+            if (errno == ERANGE || *end != '\0' || value < INT32_MIN || value > INT32_MAX)
+            {
+                throw FlatCodegenException(std::string("Literal ") + m_ast.text(i) + " out of range for " + to_string(NativeType::I_32));
+            }
+            return true;
+        }
+        case FlatNodeKind::Return:
+        case FlatNodeKind::DataDefn:
+            return n.child_count == 1 && evaluate(m_ast.child(i, 0), value);
+        case FlatNodeKind::Symbol:
+        {
+            auto const target = resolve(n.symbol);
+            if (m_ast[target].kind != FlatNodeKind::DataDefn)
+            {
+                throw FlatCodegenException(std::string("'") + m_ast.name(n.symbol) + "' is not a value");
+            }
+            return evaluate(target, value);
+        }
+        case FlatNodeKind::FunctionCall:
+        {
+            auto const target = resolve(n.symbol);
+            if (m_ast[target].kind != FlatNodeKind::FunctionDefn)
+            {
+                throw FlatCodegenException(std::string("'") + m_ast.name(n.symbol) + "' is not a function");
+            }
+            return n.child_count == 0 && evaluate(target, value);
+        }
+        case FlatNodeKind::Add:
+        case FlatNodeKind::Sub:
+        {
+            // Both sides are evaluated, so errors on the right are found as in ConstantEvaluator
+            int64_t l = 0;
+            int64_t r = 0;
+            auto const has_l = evaluate(m_ast.child(i, 0), l);
+            auto const has_r = evaluate(m_ast.child(i, 1), r);
+            if (!has_l || !has_r)
+            {
+                return false;
+            }
+            auto const add = n.kind == FlatNodeKind::Add;
+            value = add ? l + r : l - r;
+            if (value < INT32_MIN || value > INT32_MAX)
+            {
+                throw FlatCodegenException(std::string("Overflow in ") + to_string(NativeType::I_32) + (add ? " addition" : " subtraction"));
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    FlatAst const&              m_ast;
+    std::vector<State>          m_state;
+    std::vector<int64_t>        m_value;
+    std::vector<NodeIndex>      m_definitions;  //!< Top-level definition of each SymbolId, or no_node
+    NodeIndex                   m_definition = no_node; //!< Innermost named node being evaluated
+};
+
+//! Writes the same IR as LLVM_IR_Generator. walk() drives the definitions; an expression
+//! is written from its root, since its operands must come first, and the nodes of its
+//! subtree are then skipped as walk() reaches them.
+class FlatIrEmitter
+{
+public:
+    FlatIrEmitter(FlatAst const& ast, OutputSink& out)
+        : m_ast{ ast }, m_out{ out }, m_evaluator{ ast }
+    {}
+
+    void enter_module(FlatAst const&, NodeIndex) {}
+
+    void enter_function(FlatAst const& ast, NodeIndex i)
+    {
+        // A block body only holds definitions; checked before any IR is written
+        auto returns = false;
+        for (uint32_t k = 0; k < ast[i].child_count; ++k)
+        {
+            returns = returns || ast[ast.child(i, k)].kind == FlatNodeKind::Return;
+        }
+        auto const* name = ast.name(ast[i].symbol);
+        if (!returns)
+        {
+            throw FlatCodegenException(std::string("Function '") + name + "' doesn't return a value");
+        }
+        m_out.keyword("define i32 @").identifier(name).keyword("() {\n");
+        m_temp_no = 1;
+    }
+
+    void leave_function(FlatAst const&, NodeIndex)
+    {
+        m_temp_no = 0;
+        m_out.keyword("}\n");
+    }
+
+    void enter_argument(FlatAst const&, NodeIndex) { /* no code for arguments yet */ }
+
+    void enter_return(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_int32_literal(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_data(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_symbol(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_call(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_add(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_sub(FlatAst const&, NodeIndex i) { statement(i); }
+
+    void enter_unknown(FlatAst const&, NodeIndex) {}
+
+private:
+    //! Value an instruction can use: an immediate, the text of a literal, or a temporary %N
+    struct Operand
+    {
+        enum class Kind { Immediate, Literal, Temporary };
+
+        Kind            kind = Kind::Immediate;
+        int64_t         value = 0;
+        char const*     text = nullptr;
+    };
+
+    //! Writes node 'i' unless it belongs to an expression already written
+    void statement(NodeIndex i)
+    {
+        if (i < m_written_end)
+        {
+            return;
+        }
+        generate(i);
+        m_written_end = m_ast[i].subtree_end;
+    }
+
+    void generate(NodeIndex i)
+    {
+        auto const& n = m_ast[i];
+        switch (n.kind)
+        {
+        case FlatNodeKind::Int32Literal:
+            m_value.kind = Operand::Kind::Literal;
+            m_value.text = m_ast.text(i);
+            break;
+        case FlatNodeKind::Return:
+        {
+            auto const value = value_of(m_ast.child(i, 0));
+            m_out.keyword("  ret i32 ");
+            write(value);
+            m_out.character('\n');
+            break;
+        }
+        case FlatNodeKind::DataDefn:
+        {
+            auto const* name = m_ast.name(n.symbol);
+            int64_t value = 0;
+            if (!m_evaluator.evaluate(i, value))
+            {
+                throw FlatCodegenException(std::string("Initializer of '") + name + "' is not a compile-time constant");
+            }
+            m_out.character('@').identifier(name).keyword(" = global ")
+                .identifier(to_string(NativeType::I_32)).character(' ').integer(value)
+                .keyword(", align ").integer(alignment_of(NativeType::I_32)).character('\n');
+            break;
+        }
+        case FlatNodeKind::Symbol:
+        {
+            auto const temp = begin_temp();
+            m_out.keyword("load i32, i32* @").identifier(m_ast.name(n.symbol)).keyword(", align 4\n");
+            m_value = temp;
+            break;
+        }
+        case FlatNodeKind::FunctionCall:
+        {
+            auto const temp = begin_temp();
+            m_out.keyword("call i32 @").identifier(m_ast.name(n.symbol)).keyword("()\n");
+            m_value = temp;
+            break;
+        }
+        case FlatNodeKind::Add:
+            generate_binary("add", i);
+            break;
+        case FlatNodeKind::Sub:
+            generate_binary("sub", i);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Operand value_of(NodeIndex i)
+    {
+        int64_t value = 0;
+        if (m_evaluator.evaluate(i, value))
+        {
+            Operand folded;
+            folded.value = value;
+            return folded;
+        }
+        generate(i);
+        return m_value;
+    }
+
+    template <size_t N>
+    void generate_binary(char const (&op)[N], NodeIndex i)
+    {
+        auto const lhs = value_of(m_ast.child(i, 0));
+        auto const rhs = value_of(m_ast.child(i, 1));
+        auto const temp = begin_temp();
+        m_out.keyword(op).keyword(" nsw i32 ");
+        write(lhs);
+        m_out.keyword(", ");
+        write(rhs);
+        m_out.character('\n');
+        m_value = temp;
+    }
+
+    void write(Operand const& o)
+    {
+        switch (o.kind)
+        {
+        case Operand::Kind::Immediate:  m_out.integer(o.value); break;
+        case Operand::Kind::Literal:    m_out.identifier(o.text); break;
+        case Operand::Kind::Temporary:  m_out.character('%').integer(o.value); break;
+        }
+    }
+
+    Operand begin_temp()
+    {
+        Operand temp;
+        temp.kind = Operand::Kind::Temporary;
+        temp.value = m_temp_no++;
+        m_out.keyword("  ");
+        write(temp);
+        m_out.keyword(" = ");
+        return temp;
+    }
+
+    FlatAst const&  m_ast;
+    OutputSink&     m_out;
+    FlatEvaluator   m_evaluator;
+    int             m_temp_no = 0;
+    Operand         m_value;            //!< Operand holding the result of the last expression generated
+    NodeIndex       m_written_end = 0;  //!< One past the last node of the last expression written
+};
+
+} // namespace
+
+void generate_serial(FlatAst const& ast, OutputSink& out)
+{
+    if (ast.size() == 0)
+    {
+        return;
+    }
+    FlatIrEmitter emitter{ ast, out };
+    walk(ast, emitter);
+}
+
+} // namespace ty
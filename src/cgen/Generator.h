@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cppcoretools/print.h>
+#include "token/StringInterner.h"
+#include "cgen/OutputSink.h"
 
 namespace ty
 {
@@ -11,6 +13,7 @@ class Expr;
 class LiteralExpr;
 class Int32LiteralExpr;
 class ReturnExpr;
+class FunctionArgDeclExpr;
 class SymbolExpr;
 class NumExpr;
 class BinaryOpExpr;
@@ -18,6 +21,9 @@ class FunctionCallExpr;
 class FunctionDefnExpr;
 class MemberFunctionCallExpr;
 class AddExpr;
+class SubExpr;
+class DataDefnExpr;
+class ConstantEvaluator;
 
 
 //! Abstract interface for generating code
@@ -36,20 +42,51 @@ public:
 
     virtual void generate(ReturnExpr const& expr) = 0;
 
+    virtual void generate(DataDefnExpr const& expr) = 0;
+
+    virtual void generate(SymbolExpr const& expr) = 0;
+
+    virtual void generate(FunctionCallExpr const& expr) = 0;
+
+    virtual void generate(AddExpr const& expr) = 0;
+
+    virtual void generate(SubExpr const& expr) = 0;
+
+    virtual void generate(FunctionArgDeclExpr const&) { /* no code for arguments yet */ }
+
     // DELETE THIS LATER
     virtual void generate(Expr const& expr) { /* not yet impl */}
+
+	//! Sets the interner used to resolve Expr::id() to names
+	void set_interner(StringInterner const* interner) { m_interner = interner; }
+
+	//! Sets the evaluator used to fold compile-time constants; without one nothing is folded
+	void set_evaluator(ConstantEvaluator* evaluator) { m_evaluator = evaluator; }
+
+	//! Sets whether function bodies are folded (the default) or lowered expression by
+	//! expression. Data initializers are evaluated either way, they must be constants.
+	void set_folding(bool fold) { m_fold = fold; }
+
+protected:
+	//! The evaluator to fold expressions in function bodies with, or null
+	ConstantEvaluator* folder() const { return m_fold ? m_evaluator : nullptr; }
+
+	StringInterner const* m_interner = nullptr;
+	ConstantEvaluator* m_evaluator = nullptr;
+	bool m_fold = true;
 };
 
-//! Generalization of a Generator that writes using a unique_file (wrapper around C file)
+//! Generalization of a Generator that writes its output to an OutputSink
 class FileGenerator : public Generator
 {
 public:
-	explicit FileGenerator(cct::unique_file file)
-		: m_file{ std::move(file) }
+	//! 'out' must outlive the generator; call out.flush() once generation is done
+	explicit FileGenerator(OutputSink& out)
+		: m_out{ out }
 	{}
 
 protected:
-	cct::unique_file m_file;
+	OutputSink& m_out;
 };
 
 } // namespace ty
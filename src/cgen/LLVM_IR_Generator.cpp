@@ -1,28 +1,163 @@
 #include "LLVM_IR_Generator.h"
 #include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+#include "BitcodeGenerator.h"
+#include "ElfGenerator.h"
 
 namespace ty
 {
 void LLVM_IR_Generator::generate(FunctionDefnExpr const& expr)
 {
-    CCT_CHECK(is_exportable_name(expr.id()));
+    auto const* name = m_interner->name(expr.id());
+    CCT_CHECK(is_exportable_name(name));
+    if (expr.m_returns.empty())
+    {
+        // A block body only holds definitions; checked before any IR is written
+        throw EvalException(&expr, std::string("Function '") + name + "' doesn't return a value");
+    }
 
-    m_file.printf("define %s @%s() {");
+    m_out.keyword("define i32 @").text(name, m_interner->size(expr.id())).keyword("() {\n");
     begin_function();
     for (auto const& a : expr.m_body->exprs)
     {
         a->generate(*this);
     }
     end_function();
+    m_out.keyword("}\n");
 }
 
 void LLVM_IR_Generator::generate(Int32LiteralExpr const& expr)
 {
-
+    m_value.kind = Operand::Kind::Literal;
+    m_value.text = expr.text();
 }
 
 void LLVM_IR_Generator::generate(ReturnExpr const& expr)
 {
+    auto const value = value_of(*expr.sub_expr());
+    m_out.keyword("  ret i32 ");
+    write(value);
+    m_out.character('\n');
+}
+
+void LLVM_IR_Generator::generate(DataDefnExpr const& expr)
+{
+    auto const* name = m_interner->name(expr.id());
+    CCT_CHECK(is_exportable_name(name));
+
+    auto const* c = m_evaluator ? m_evaluator->evaluate(expr) : nullptr;
+    if (!c)
+    {
+        throw EvalException(&expr, std::string("Initializer of '") + name + "' is not a compile-time constant");
+    }
+    m_out.character('@').text(name, m_interner->size(expr.id())).keyword(" = global ")
+        .identifier(to_string(c->type->native_type())).character(' ').integer(c->value)
+        .keyword(", align ").integer(c->type->alignment()).character('\n');
+}
+
+void LLVM_IR_Generator::generate(SymbolExpr const& expr)
+{
+    auto const temp = begin_temp();
+    m_out.keyword("load i32, i32* @").text(m_interner->name(expr.name()), m_interner->size(expr.name()))
+        .keyword(", align 4\n");
+    m_value = temp;
+}
+
+void LLVM_IR_Generator::generate(FunctionCallExpr const& expr)
+{
+    auto const temp = begin_temp();
+    m_out.keyword("call i32 @").text(m_interner->name(expr.callee()), m_interner->size(expr.callee()))
+        .keyword("()\n");
+    m_value = temp;
+}
+
+void LLVM_IR_Generator::generate(AddExpr const& expr)
+{
+    generate_binary("add", expr);
+}
+
+void LLVM_IR_Generator::generate(SubExpr const& expr)
+{
+    generate_binary("sub", expr);
+}
+
+LLVM_IR_Generator::Operand LLVM_IR_Generator::value_of(Expr const& expr)
+{
+    if (auto const* c = m_evaluator ? m_evaluator->evaluate(expr) : nullptr)
+    {
+        Operand folded;
+        folded.value = c->value;
+        return folded;
+    }
+    expr.generate(*this);
+    return m_value;
+}
+
+template <size_t N>
+void LLVM_IR_Generator::generate_binary(char const (&op)[N], BinaryOpExpr const& expr)
+{
+    auto const lhs = value_of(*expr.left());
+    auto const rhs = value_of(*expr.right());
+    auto const temp = begin_temp();
+    m_out.keyword(op).keyword(" nsw i32 ");
+    write(lhs);
+    m_out.keyword(", ");
+    write(rhs);
+    m_out.character('\n');
+    m_value = temp;
+}
+
+void LLVM_IR_Generator::write(Operand const& o)
+{
+    switch (o.kind)
+    {
+    case Operand::Kind::Immediate:  m_out.integer(o.value); break;
+    case Operand::Kind::Literal:    m_out.identifier(o.text); break;
+    case Operand::Kind::Temporary:  m_out.character('%').integer(o.value); break;
+    }
+}
+
+LLVM_IR_Generator::Operand LLVM_IR_Generator::begin_temp()
+{
+    Operand temp;
+    temp.kind = Operand::Kind::Temporary;
+    temp.value = m_temp_no++;
+    m_out.keyword("  ");
+    write(temp);
+    m_out.keyword(" = ");
+    return temp;
+}
+
+void generate_serial(ParseContext const& ast, OutputSink& out)
+{
+    ConstantEvaluator evaluator{ *ast.symbols, ast.interner.get() };
+    LLVM_IR_Generator g{ out };
+    g.set_interner(ast.interner.get());
+    g.set_evaluator(&evaluator);
+    for (auto const* defn : ast.exprs)
+    {
+        defn->generate(g);
+    }
+}
+
+void generate_module(ParseContext const& ast, OutputSink& out)
+{
+    if (Global<CodegenSettings>().format == OutputFormat::bitcode)
+    {
+        generate_bitcode(ast, out);
+        return;
+    }
+    if (Global<CodegenSettings>().format == OutputFormat::elf_object)
+    {
+        generate_elf(ast, out);
+        return;
+    }
+    if (Global<CodegenSettings>().mode == CodegenMode::parallel)
+    {
+        generate_parallel(ast, out, Global<ThreadPool>());
+        return;
+    }
+    generate_serial(ast, out);
 }
 
 } // namespace ty
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "Generator.h"
+#include "common/TyObject.h"
+#include <cstdint>
+#include <exception>
+#include <string>
 
 namespace ty
 {
 
 class Int32Type;
 class Definition;
+class ThreadPool;
+class FlatAst;
+struct ParseContext;
 
 //! Generates code for the LLVM IR format
 class LLVM_IR_Generator : public FileGenerator
@@ -21,7 +28,41 @@ public:
 
     virtual void generate(ReturnExpr const& expr) override;
 
+    //! Emits a global; its initializer must fold to a constant
+    virtual void generate(DataDefnExpr const& expr) override;
+
+    virtual void generate(SymbolExpr const& expr) override;
+
+    virtual void generate(FunctionCallExpr const& expr) override;
+
+    virtual void generate(AddExpr const& expr) override;
+
+    virtual void generate(SubExpr const& expr) override;
+
 private:
+    //! Value an instruction can use: an immediate, the text of a literal, or a temporary %N
+    struct Operand
+    {
+        enum class Kind { Immediate, Literal, Temporary };
+
+        Kind            kind = Kind::Immediate;
+        int64_t         value = 0;
+        char const*     text = nullptr;
+    };
+
+    //! Emits code computing 'expr' and returns the operand holding the result; folds it
+    //! to an immediate when the evaluator can
+    Operand value_of(Expr const& expr);
+
+    //! Emits 'lhs op rhs' into a new temporary
+    template <size_t N>
+    void generate_binary(char const (&op)[N], BinaryOpExpr const& expr);
+
+    void write(Operand const& o);
+
+    //! Starts an instruction whose result is a new temporary, i.e. writes '  %N = '
+    Operand begin_temp();
+
     void begin_function() { m_temp_no = 1; }
 
     void end_function() { m_temp_no = 0; }
@@ -30,6 +71,64 @@ private:
 
     int m_temp_no = 0;
 
+    //! Operand holding the result of the last expression generated
+    Operand m_value;
+
 };
 
+enum class CodegenMode
+{
+    serial,     //!< generate_serial()
+    parallel    //!< generate_parallel() on Global<ThreadPool>()
+};
+
+enum class OutputFormat
+{
+    llvm_ir,    //!< Textual IR (.ll), by LLVM_IR_Generator
+    bitcode,    //!< LLVM bitcode (.bc), by BitcodeGenerator
+    elf_object  //!< Relocatable x86-64 ELF object (.o), by ElfGenerator
+};
+
+//! Process-wide code generation configuration
+struct CodegenSettings : public TyObject<Attribute::HasGlobal>
+{
+    CodegenMode mode = CodegenMode::serial;
+
+    //! Bitcode and ELF objects are always generated serially, since they number values
+    //! or lay out sections across the module
+    OutputFormat format = OutputFormat::llvm_ir;
+};
+
+//! Generates LLVM IR for every top-level definition of 'ast' in source order, folding constants
+//! \throws EvalException on the first definition that can't be generated; the output of the
+//!         definitions before it has been appended to 'out'
+void generate_serial(ParseContext const& ast, OutputSink& out);
+
+//! Error found by generate_serial(FlatAst), with the message EvalException would carry;
+//! the flat form keeps no source positions
+struct FlatCodegenException : public std::exception
+{
+    explicit FlatCodegenException(std::string msg) : m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    std::string m_message;
+};
+
+//! Generates LLVM IR from the flat form of a module with walk(), folding constants over
+//! node indices. Produces the same bytes as generate_serial() of the tree it was made from.
+//! \throws FlatCodegenException where generate_serial() throws an EvalException
+void generate_serial(FlatAst const& ast, OutputSink& out);
+
+//! Generates definitions concurrently on 'pool', each worker with its own generator, evaluator
+//! and buffer, then appends the buffers in source order.
+//! Produces the same bytes, and throws the same EvalException, as generate_serial().
+void generate_parallel(ParseContext const& ast, OutputSink& out, ThreadPool& pool);
+
+//! Generates 'ast' as selected by Global<CodegenSettings>()
+void generate_module(ParseContext const& ast, OutputSink& out);
+
 } // namespace ty
@@ -0,0 +1,80 @@
+#include "OutputSink.h"
+
+#include <cerrno>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ty
+{
+
+FileSink::FileSink(int fd)
+    : m_fd{ fd }
+{
+#ifdef _WIN32
+    ::_setmode(m_fd, _O_BINARY);
+#endif
+}
+
+FileSink::FileSink(char const* path)
+{
+#ifdef _WIN32
+    m_fd = ::_open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (m_fd < 0)
+    {
+        throw OutputException{ std::string{ "Cannot open " } + path };
+    }
+    m_owns_fd = true;
+}
+
+FileSink::~FileSink()
+{
+    try
+    {
+        flush();
+    }
+    catch (OutputException const&)
+    {
+    }
+    if (m_owns_fd)
+    {
+#ifdef _WIN32
+        ::_close(m_fd);
+#else
+        ::close(m_fd);
+#endif
+    }
+}
+
+void FileSink::flush_buffer(char const* data, size_t size)
+{
+    while (size)
+    {
+#ifdef _WIN32
+        auto const written = ::_write(m_fd, data, static_cast<unsigned>(size));
+#else
+        auto const written = ::write(m_fd, data, size);
+#endif
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw OutputException{ "Write to output failed" };
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+} // namespace ty
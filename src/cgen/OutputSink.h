@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+
+namespace ty
+{
+
+struct OutputException : public std::exception
+{
+    explicit OutputException(std::string msg) : m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    std::string m_message;
+};
+
+//! Destination of generated code.
+//! Appends go to a fixed in-memory buffer with no formatting or locking; the buffer
+//! is handed to flush_buffer() only when full and on flush(), so emitting a module
+//! costs a handful of large writes instead of one stdio call per fragment.
+class OutputSink
+{
+public:
+    static constexpr size_t buffer_size = 1 << 16;
+
+    OutputSink() : m_buffer{ new char[buffer_size] } {}
+
+    OutputSink(OutputSink const&) = delete;
+    OutputSink& operator=(OutputSink const&) = delete;
+
+    //! Derived sinks flush in their own destructor; anything still buffered here is lost
+    virtual ~OutputSink() = default;
+
+    OutputSink& character(char c)
+    {
+        if (m_used == buffer_size)
+        {
+            flush();
+        }
+        m_buffer[m_used++] = c;
+        return *this;
+    }
+
+    OutputSink& text(char const* data, size_t size)
+    {
+        if (size > buffer_size - m_used)
+        {
+            flush();
+            if (size >= buffer_size)
+            {
+                flush_buffer(data, size);
+                return *this;
+            }
+        }
+        std::memcpy(m_buffer.get() + m_used, data, size);
+        m_used += size;
+        return *this;
+    }
+
+    //! Appends a fixed piece of syntax; its length is known at compile time
+    template <size_t N>
+    OutputSink& keyword(char const (&s)[N])
+    {
+        return text(s, N - 1);
+    }
+
+    //! Appends a null-terminated name
+    OutputSink& identifier(char const* name)
+    {
+        return text(name, std::strlen(name));
+    }
+
+    //! Appends 'value' in decimal
+    OutputSink& integer(int64_t value)
+    {
+        char digits[20];
+        auto* p = digits + sizeof(digits);
+        // Negate as unsigned so INT64_MIN needs no special case
+        auto magnitude = value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value);
+        do
+        {
+            *--p = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0)
+        {
+            character('-');
+        }
+        return text(p, static_cast<size_t>(digits + sizeof(digits) - p));
+    }
+
+    //! Passes everything appended so far on to the destination
+    //! \throws OutputException if the destination fails
+    void flush()
+    {
+        if (m_used)
+        {
+            auto const size = m_used;
+            m_used = 0;
+            flush_buffer(m_buffer.get(), size);
+        }
+    }
+
+protected:
+    //! Writes 'size' bytes to the destination
+    virtual void flush_buffer(char const* data, size_t size) = 0;
+
+private:
+    std::unique_ptr<char[]>     m_buffer;
+    size_t                      m_used = 0;
+};
+
+//! Writes to a file descriptor (e.g. 1 for stdout) with write(2)
+class FileSink : public OutputSink
+{
+public:
+    //! Writes to 'fd', which stays open afterwards. Output is binary: no newline translation.
+    explicit FileSink(int fd);
+
+    //! Creates or truncates the file at 'path'
+    //! \throws OutputException if it can't be opened
+    explicit FileSink(char const* path);
+
+    //! Flushes what is left, ignoring errors; call flush() first to see them
+    ~FileSink() override;
+
+protected:
+    void flush_buffer(char const* data, size_t size) override;
+
+private:
+    int     m_fd;
+    bool    m_owns_fd = false;
+};
+
+//! Keeps the output in memory, e.g. to inspect it in tests or hand it to an embedding tool
+class StringSink : public OutputSink
+{
+public:
+    //! Everything appended so far
+    std::string const& str()
+    {
+        flush();
+        return m_text;
+    }
+
+protected:
+    void flush_buffer(char const* data, size_t size) override
+    {
+        m_text.append(data, size);
+    }
+
+private:
+    std::string m_text;
+};
+
+} // namespace ty
@@ -0,0 +1,87 @@
+#include "LLVM_IR_Generator.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace ty
+{
+
+namespace
+{
+
+//! Consecutive definitions generated by one task
+struct Chunk
+{
+    size_t              begin = 0;
+    size_t              end = 0;
+    StringSink          out;
+    std::exception_ptr  error;      //!< Set if generation stopped at a definition in the chunk
+};
+
+} // namespace
+
+void generate_parallel(ParseContext const& ast, OutputSink& out, ThreadPool& pool)
+{
+    auto const count = ast.exprs.size();
+    if (count < min_parallel_definitions)
+    {
+        generate_serial(ast, out);
+        return;
+    }
+
+    // A few chunks per thread balance uneven functions without a buffer per definition
+    auto const chunk_count = std::min<size_t>(count, size_t(pool.concurrency()) * 8);
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    chunks.reserve(chunk_count);
+    for (size_t c = 0; c < chunk_count; ++c)
+    {
+        chunks.push_back(std::make_unique<Chunk>());
+        chunks.back()->begin = count * c / chunk_count;
+        chunks.back()->end = count * (c + 1) / chunk_count;
+    }
+
+    // The evaluator only memoizes complete results, so a worker's evaluator folds every
+    // definition, and reports every error, exactly as the serial one would
+    std::vector<std::unique_ptr<ConstantEvaluator>> evaluators(pool.concurrency());
+    pool.parallel_for(chunk_count, [&](size_t c, unsigned worker)
+    {
+        auto& evaluator = evaluators[worker];
+        if (!evaluator)
+        {
+            evaluator = std::make_unique<ConstantEvaluator>(*ast.symbols, ast.interner.get());
+        }
+
+        auto& chunk = *chunks[c];
+        LLVM_IR_Generator g{ chunk.out };
+        g.set_interner(ast.interner.get());
+        g.set_evaluator(evaluator.get());
+        try
+        {
+            for (auto i = chunk.begin; i < chunk.end; ++i)
+            {
+                ast.exprs[i]->generate(g);
+            }
+        }
+        catch (...)
+        {
+            chunk.error = std::current_exception();
+        }
+    }, 1);
+
+    // Source order; like the serial generator, stop after the first failing definition
+    for (auto const& chunk : chunks)
+    {
+        auto const& text = chunk->out.str();
+        out.text(text.data(), text.size());
+        if (chunk->error)
+        {
+            std::rethrow_exception(chunk->error);
+        }
+    }
+}
+
+} // namespace ty
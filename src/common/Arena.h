@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ty
+{
+
+//! Bump allocator for objects that all die together (e.g. every node of one compile).
+//! Destructors of objects created in an Arena are never run: everything is released
+//! at once, in O(number of chunks), when the Arena is destroyed. Objects must therefore
+//! not own resources outside the arena (use ArenaAllocator for their containers).
+class Arena
+{
+public:
+    static constexpr size_t default_chunk_size = 64 * 1024;
+
+    explicit Arena(size_t chunk_size = default_chunk_size)
+        : m_chunk_size{ chunk_size }
+    {}
+
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+
+    //! Returns 'size' bytes aligned to 'align'
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        auto pos = (m_pos + (align - 1)) & ~(uintptr_t(align) - 1);
+        if (pos + size > m_end)
+        {
+            new_chunk(size + align);
+            pos = (m_pos + (align - 1)) & ~(uintptr_t(align) - 1);
+        }
+        m_pos = pos + size;
+        m_bytes_allocated += size;
+        return reinterpret_cast<void*>(pos);
+    }
+
+    //! Constructs a T in the arena. Its destructor will not be called.
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        ++m_object_count;
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    //! Copies [data, data + size) into the arena as a null-terminated string
+    char const* copy_string(char const* data, size_t size)
+    {
+        auto* out = static_cast<char*>(allocate(size + 1, 1));
+        std::memcpy(out, data, size);
+        out[size] = '\0';
+        return out;
+    }
+
+    //! Bytes handed out by allocate(), including container storage
+    size_t bytes_allocated() const noexcept { return m_bytes_allocated; }
+
+    //! Bytes reserved from the system for chunks
+    size_t bytes_reserved() const noexcept { return m_bytes_reserved; }
+
+    //! Number of objects constructed with create()
+    size_t object_count() const noexcept { return m_object_count; }
+
+private:
+    void new_chunk(size_t min_size)
+    {
+        auto const size = min_size > m_chunk_size ? min_size : m_chunk_size;
+        m_chunks.emplace_back(new char[size]);
+        m_pos = reinterpret_cast<uintptr_t>(m_chunks.back().get());
+        m_end = m_pos + size;
+        m_bytes_reserved += size;
+    }
+
+    std::vector<std::unique_ptr<char[]>>    m_chunks;
+    uintptr_t                               m_pos = 0;
+    uintptr_t                               m_end = 0;
+    size_t                                  m_chunk_size;
+    size_t                                  m_bytes_allocated = 0;
+    size_t                                  m_bytes_reserved = 0;
+    size_t                                  m_object_count = 0;
+};
+
+//! Standard allocator that draws from an Arena, so containers inside arena objects need no destructor.
+//! With a null arena it falls back to the global heap (for objects that live outside any compile).
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator(Arena* arena = nullptr) noexcept : m_arena{ arena } {}
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const& other) noexcept : m_arena{ other.arena() } {}
+
+    T* allocate(size_t n)
+    {
+        if (m_arena)
+        {
+            return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) noexcept
+    {
+        if (!m_arena)
+        {
+            ::operator delete(p);
+        }
+    }
+
+    Arena* arena() const noexcept { return m_arena; }
+
+    template <typename U>
+    bool operator==(ArenaAllocator<U> const& o) const noexcept { return m_arena == o.arena(); }
+
+    template <typename U>
+    bool operator!=(ArenaAllocator<U> const& o) const noexcept { return m_arena != o.arena(); }
+
+private:
+    Arena* m_arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+} // namespace ty
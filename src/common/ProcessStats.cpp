@@ -0,0 +1,131 @@
+#include "ProcessStats.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ty
+{
+
+double process_cpu_seconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+    auto const ticks = [](FILETIME const& t) { return (uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) * 100e-9;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+    auto const seconds = [](timeval const& t) { return t.tv_sec + t.tv_usec * 1e-6; };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#endif
+}
+
+size_t peak_rss_bytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+HardwareCounters::HardwareCounters()
+{
+#ifdef __linux__
+    uint64_t const events[3] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+    for (int i = 0; i < 3; ++i)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = events[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;   // Also count the thread pool's workers
+        m_fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0 /* this process */, -1 /* any cpu */, -1, 0));
+        if (m_fds[i] < 0)
+        {
+            // All or nothing, so callers only check available()
+            for (int j = 0; j <= i; ++j)
+            {
+                if (m_fds[j] >= 0)
+                {
+                    close(m_fds[j]);
+                }
+                m_fds[j] = -1;
+            }
+            return;
+        }
+    }
+#endif
+}
+
+HardwareCounters::~HardwareCounters()
+{
+#ifdef __linux__
+    for (auto const fd : m_fds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+#endif
+}
+
+HardwareCounters::Values HardwareCounters::read() const
+{
+    uint64_t totals[3] = {};
+#ifdef __linux__
+    for (int i = 0; i < 3; ++i)
+    {
+        if (m_fds[i] < 0 || ::read(m_fds[i], &totals[i], sizeof(totals[i])) != sizeof(totals[i]))
+        {
+            totals[i] = 0;
+        }
+    }
+#endif
+    Values v;
+    v.cycles = totals[0];
+    v.instructions = totals[1];
+    v.cache_misses = totals[2];
+    return v;
+}
+
+} // namespace ty
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ty
+{
+
+//! Processor time used so far by every thread of the process, user plus system, in seconds
+double process_cpu_seconds();
+
+//! Largest resident set of the process so far, in bytes; 0 where unavailable
+size_t peak_rss_bytes();
+
+//! Hardware event counters for the calling process and the threads it starts afterwards.
+//! Uses perf_event_open on Linux; elsewhere, or when the kernel refuses (e.g. because of
+//! perf_event_paranoid or a container), available() is false and read() returns zeros.
+class HardwareCounters
+{
+public:
+    struct Values
+    {
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t cache_misses = 0;
+    };
+
+    //! Starts counting
+    HardwareCounters();
+    ~HardwareCounters();
+
+    HardwareCounters(HardwareCounters const&) = delete;
+    HardwareCounters& operator=(HardwareCounters const&) = delete;
+
+    bool available() const noexcept { return m_fds[0] >= 0; }
+
+    //! Totals since construction
+    Values read() const;
+
+private:
+    int m_fds[3] = { -1, -1, -1 };
+};
+
+} // namespace ty
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "common/TyObject.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ty
+{
+
+//! Below this many top-level definitions, waking the pool costs more than parsing or
+//! generating them in parallel saves; shared by parse_parallel() and generate_parallel()
+constexpr size_t min_parallel_definitions = 64;
+
+//! Fixed set of worker threads that run one parallel_for at a time.
+//! The calling thread takes part in every job, so a pool of N threads uses N + 1 cores.
+class ThreadPool : public TyObject<Attribute::HasGlobal>
+{
+public:
+    //! Body of a job: called with an item index and the index of the thread running it
+    using Task = std::function<void(size_t item, unsigned worker)>;
+
+    explicit ThreadPool(unsigned threads = default_threads())
+    {
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            m_threads.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& t : m_threads)
+        {
+            t.join();
+        }
+    }
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    //! Number of distinct 'worker' values passed to tasks (pool threads plus the caller)
+    unsigned concurrency() const noexcept { return static_cast<unsigned>(m_threads.size()) + 1; }
+
+    //! Calls task(i, worker) for every i in [0, count) and returns once all calls finished.
+    //! Items are handed out in batches of 'grain'. Calls from inside a task run serially.
+    //! \throws the first exception thrown by a task, after all items have stopped
+    void parallel_for(size_t count, Task const& task, size_t grain = 0)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        if (t_inside_task() || m_threads.empty() || count == 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                task(i, concurrency() - 1);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> submit{ m_submit };
+        if (grain == 0)
+        {
+            grain = std::max<size_t>(1, count / (size_t(concurrency()) * 8));
+        }
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_task = &task;
+            m_count = count;
+            m_grain = grain;
+            m_next = 0;
+            m_error = nullptr;
+            m_active = static_cast<unsigned>(m_threads.size());
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        run_items(concurrency() - 1);
+
+        std::unique_lock<std::mutex> lock{ m_mutex };
+        m_done.wait(lock, [this] { return m_active == 0; });
+        m_task = nullptr;
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+    static unsigned default_threads()
+    {
+        auto const n = std::thread::hardware_concurrency();
+        return n > 1 ? n - 1 : 0;
+    }
+
+private:
+    static bool& t_inside_task()
+    {
+        static thread_local bool inside = false;
+        return inside;
+    }
+
+    void worker_loop(unsigned index)
+    {
+        unsigned long long seen = 0;
+        while (1)
+        {
+            {
+                std::unique_lock<std::mutex> lock{ m_mutex };
+                m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+                if (m_stop)
+                {
+                    return;
+                }
+                seen = m_generation;
+            }
+
+            run_items(index);
+
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            if (--m_active == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    void run_items(unsigned worker)
+    {
+        t_inside_task() = true;
+        while (1)
+        {
+            auto const begin = m_next.fetch_add(m_grain);
+            if (begin >= m_count)
+            {
+                break;
+            }
+            auto const end = std::min(begin + m_grain, m_count);
+            try
+            {
+                for (auto i = begin; i < end; ++i)
+                {
+                    (*m_task)(i, worker);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+                if (!m_error)
+                {
+                    m_error = std::current_exception();
+                }
+                m_next = m_count;
+            }
+        }
+        t_inside_task() = false;
+    }
+
+    std::vector<std::thread>    m_threads;
+
+    std::mutex                  m_submit;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wake;
+    std::condition_variable     m_done;
+
+    Task const*                 m_task = nullptr;
+    size_t                      m_count = 0;
+    size_t                      m_grain = 1;
+    std::atomic<size_t>         m_next{ 0 };
+    std::exception_ptr          m_error;
+    unsigned                    m_active = 0;
+    unsigned long long          m_generation = 0;
+    bool                        m_stop = false;
+};
+
+} // namespace ty
@@ -27,9 +27,10 @@ public:
 	constexpr static auto has_global() { return attributes & Attribute::HasGlobal; }
 };
 
-//! Returns a reference to the top-level global instance of a TyObject
+//! Returns a reference to the top-level global instance of a TyObject.
+//! Not 'static': that would give every translation unit its own instance.
 template <typename T>
-static T& Global()
+T& Global()
 {
 	static_assert(std::is_base_of<TyObjectBase, T>::value, "T must derive TyObject");
 	static_assert(T::has_global(), "T is not defined to have a global instance");
@@ -0,0 +1,75 @@
+// Replaces the global operator new and delete so 'tyx --stats' can count heap allocations.
+// Counting is off until enable_allocation_counting(); until then the hook costs one
+// relaxed load per allocation. Over-aligned allocations (C++17) aren't counted.
+
+#include "CompileStats.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+std::atomic<bool>       g_enabled{ false };
+std::atomic<uint64_t>   g_count{ 0 };
+std::atomic<uint64_t>   g_bytes{ 0 };
+
+void* allocate(size_t size) noexcept
+{
+    if (g_enabled.load(std::memory_order_relaxed))
+    {
+        g_count.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return std::malloc(size ? size : 1);
+}
+
+void* allocate_or_throw(size_t size)
+{
+    for (;;)
+    {
+        if (auto* p = allocate(size))
+        {
+            return p;
+        }
+        auto const handler = std::get_new_handler();
+        if (!handler)
+        {
+            throw std::bad_alloc{};
+        }
+        handler();
+    }
+}
+
+} // namespace
+
+namespace ty
+{
+
+void enable_allocation_counting()
+{
+    g_enabled.store(true, std::memory_order_relaxed);
+}
+
+AllocationTotals allocation_totals()
+{
+    AllocationTotals t;
+    t.count = g_count.load(std::memory_order_relaxed);
+    t.bytes = g_bytes.load(std::memory_order_relaxed);
+    return t;
+}
+
+} // namespace ty
+
+void* operator new(size_t size) { return allocate_or_throw(size); }
+void* operator new[](size_t size) { return allocate_or_throw(size); }
+void* operator new(size_t size, std::nothrow_t const&) noexcept { return allocate(size); }
+void* operator new[](size_t size, std::nothrow_t const&) noexcept { return allocate(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { std::free(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { std::free(p); }
@@ -0,0 +1,238 @@
+#include "BatchCompile.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+#include "cgen/LLVM_IR_Generator.h"
+#include "token/SourceBuffer.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <numeric>
+
+namespace ty
+{
+
+namespace
+{
+
+struct BatchItem
+{
+    std::string input;
+    std::string output;
+    long long   size = 0;
+    bool        failed = false;
+    std::string diagnostics;
+};
+
+long long file_size(char const* path)
+{
+    auto* f = std::fopen(path, "rb");
+    if (!f)
+    {
+        return 0;
+    }
+    std::fseek(f, 0, SEEK_END);
+    auto const size = std::ftell(f);
+    std::fclose(f);
+    return size;
+}
+
+char const* output_extension()
+{
+    switch (Global<CodegenSettings>().format)
+    {
+    case OutputFormat::bitcode:     return ".bc";
+    case OutputFormat::elf_object:  return ".o";
+    default:                        return ".ll";
+    }
+}
+
+//! 'input' with its extension replaced, placed in 'out_dir' if given
+std::string output_path(std::string const& input, char const* out_dir)
+{
+    auto const slash = input.find_last_of("/\\");
+    auto const name_begin = slash == std::string::npos ? 0 : slash + 1;
+    auto stem = input;
+    auto const dot = input.find_last_of('.');
+    if (dot != std::string::npos && dot > name_begin)
+    {
+        stem.resize(dot);
+    }
+    if (out_dir)
+    {
+        stem = std::string{ out_dir } + "/" + stem.substr(name_begin);
+    }
+    return stem + output_extension();
+}
+
+//! 'path' made absolute with '.', '..' and symlinks resolved, so two spellings of
+//! one file compare equal; 'path' itself if it can't be resolved (e.g. doesn't exist)
+std::string full_path(std::string const& path)
+{
+#ifdef _WIN32
+    char full[_MAX_PATH];
+    return _fullpath(full, path.c_str(), sizeof(full)) ? full : path;
+#else
+    char full[PATH_MAX];
+    return realpath(path.c_str(), full) ? full : path;
+#endif
+}
+
+//! Reports every pair of inputs that would write the same output file
+//! (the same input twice, or equal file names under one 'out_dir')
+//! \returns false if there is any
+bool check_distinct_outputs(std::vector<BatchItem> const& items, char const* out_dir)
+{
+    auto const dir = out_dir ? full_path(out_dir) : std::string{};
+    std::map<std::string, size_t> writers;
+    auto distinct = true;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        auto const key = output_path(full_path(items[i].input), out_dir ? dir.c_str() : nullptr);
+        auto const claimed = writers.emplace(key, i);
+        if (!claimed.second)
+        {
+            fprintf(stderr, "%s and %s would both write %s\n",
+                items[claimed.first->second].input.c_str(), items[i].input.c_str(), items[i].output.c_str());
+            distinct = false;
+        }
+    }
+    return distinct;
+}
+
+void compile_one(BatchItem& item)
+{
+    std::string error;
+    try
+    {
+        auto const source = load_source(item.input.c_str());
+        Diagnostics diagnostics{ source->data(), source->size() };
+        try
+        {
+            auto const list = tokenize(*source);
+            auto const ast = parse_recovering(list, diagnostics);
+            if (diagnostics.empty())
+            {
+                try
+                {
+                    FileSink out{ item.output.c_str() };
+                    generate_module(ast, out);
+                    out.flush();
+                }
+                catch (EvalException const& e)
+                {
+                    report(diagnostics, list, e);
+                }
+            }
+        }
+        catch (TokenException const& e)
+        {
+            report(diagnostics, e);
+        }
+        if (!diagnostics.empty())
+        {
+            diagnostics.render(item.diagnostics, item.input.c_str());
+        }
+    }
+    catch (SourceException const& e)
+    {
+        error = e.what();
+    }
+    catch (OutputException const& e)
+    {
+        error = e.what();
+    }
+    if (!error.empty())
+    {
+        item.diagnostics = item.input + ": " + error + "\n";
+    }
+    item.failed = !item.diagnostics.empty();
+    if (item.failed)
+    {
+        // Don't leave a partial output behind for the build to pick up
+        std::remove(item.output.c_str());
+    }
+}
+
+} // namespace
+
+bool read_file_list(char const* path, std::vector<std::string>& inputs)
+{
+    auto* f = std::fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    std::string line;
+    for (int c = std::fgetc(f); ; c = std::fgetc(f))
+    {
+        if (c == EOF || c == '\n')
+        {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+            {
+                line.pop_back();
+            }
+            auto const first = line.find_first_not_of(" \t");
+            if (first != std::string::npos && line[first] != '#')
+            {
+                inputs.push_back(line.substr(first));
+            }
+            line.clear();
+            if (c == EOF)
+            {
+                break;
+            }
+            continue;
+        }
+        line.push_back(static_cast<char>(c));
+    }
+    std::fclose(f);
+    return true;
+}
+
+int compile_batch(std::vector<std::string> const& inputs, unsigned jobs, char const* out_dir)
+{
+    std::vector<BatchItem> items(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        items[i].input = inputs[i];
+        items[i].output = output_path(inputs[i], out_dir);
+        items[i].size = file_size(inputs[i].c_str());
+    }
+    // Two threads writing one file would race; refuse before compiling anything
+    if (!check_distinct_outputs(items, out_dir))
+    {
+        return 1;
+    }
+    std::vector<size_t> order(items.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return items[a].size > items[b].size; });
+
+    // The pool hands out one file at a time from a shared index, so idle threads take
+    // the next file as soon as they finish; the caller is one of the 'jobs' threads
+    if (jobs == 0)
+    {
+        jobs = ThreadPool::default_threads() + 1;
+    }
+    ThreadPool pool{ jobs - 1 };
+    pool.parallel_for(order.size(), [&](size_t k, unsigned)
+    {
+        compile_one(items[order[k]]);
+    }, 1);
+
+    size_t failed = 0;
+    for (auto const& item : items)
+    {
+        if (item.failed)
+        {
+            fputs(item.diagnostics.c_str(), stderr);
+            ++failed;
+        }
+    }
+    fprintf(stderr, "; %zu files compiled, %zu failed, %u threads\n", items.size() - failed, failed, jobs);
+    return failed ? 1 : 0;
+}
+
+} // namespace ty
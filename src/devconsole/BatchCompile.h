@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace ty
+{
+
+//! Reads an '@filelist': one path per line; blank lines and lines starting with '#' are skipped
+//! \returns false if the file can't be read
+bool read_file_list(char const* path, std::vector<std::string>& inputs);
+
+//! Compiles every input on 'jobs' threads (0: one per hardware thread), as 'tyx <input>'
+//! would with the current Global<CodegenSettings>(), writing each output next to its input
+//! (or into 'out_dir' if it isn't null) with the extension of the output format.
+//! Files are handed out largest first, so one big file doesn't start last and finish alone.
+//! Diagnostics are collected per file and printed in input order once all are done.
+//! Nothing is compiled if two inputs would write the same output file.
+//! \returns 0 if every file compiled
+int compile_batch(std::vector<std::string> const& inputs, unsigned jobs, char const* out_dir);
+
+} // namespace ty
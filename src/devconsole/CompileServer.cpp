@@ -0,0 +1,582 @@
+#include "CompileServer.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+#include "cgen/BitcodeGenerator.h"
+#include "cgen/ElfGenerator.h"
+#include "token/FastLexer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace ty
+{
+
+struct CompileServer::Module
+{
+    std::mutex                                  mutex;      //!< Held for a whole request
+    std::unique_ptr<TokenList>                  tokens;
+    std::unique_ptr<ParseContext>               ast;        //!< Null after a failed parse
+    size_t                                      edits = 0;  //!< Incremental edits since the last full parse
+};
+
+namespace
+{
+
+char const* format_name(OutputFormat format)
+{
+    switch (format)
+    {
+    case OutputFormat::bitcode:     return "bc";
+    case OutputFormat::elf_object:  return "obj";
+    default:                        return "ll";
+    }
+}
+
+bool format_from_name(char const* name, OutputFormat& format)
+{
+    for (auto const f : { OutputFormat::llvm_ir, OutputFormat::bitcode, OutputFormat::elf_object })
+    {
+        if (std::strcmp(name, format_name(f)) == 0)
+        {
+            format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool read_file(char const* path, std::string& text)
+{
+    auto* f = std::fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    text.clear();
+    char chunk[64 * 1024];
+    size_t n = 0;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+    {
+        text.append(chunk, n);
+    }
+    auto const ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+//! Byte stream over a pair of file descriptors (a socket, or stdin and stdout)
+class Channel
+{
+public:
+    Channel(int in, int out) : m_in{ in }, m_out{ out } {}
+
+    bool read(void* data, size_t size)
+    {
+        auto* p = static_cast<char*>(data);
+        while (size > 0)
+        {
+#ifdef _WIN32
+            auto const n = _read(m_in, p, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+#else
+            auto const n = ::read(m_in, p, size);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+#endif
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool write(void const* data, size_t size)
+    {
+        auto const* p = static_cast<char const*>(data);
+        while (size > 0)
+        {
+#ifdef _WIN32
+            auto const n = _write(m_out, p, static_cast<unsigned>(std::min<size_t>(size, 1 << 30)));
+#else
+            auto const n = ::write(m_out, p, size);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+#endif
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool write(std::string const& s) { return write(s.data(), s.size()); }
+
+    //! Reads a header line without its '\n'; false at end of stream or if it's too long
+    bool read_line(std::string& line)
+    {
+        line.clear();
+        char c = 0;
+        while (read(&c, 1))
+        {
+            if (c == '\n')
+            {
+                return true;
+            }
+            if (line.size() == 256)
+            {
+                return false;
+            }
+            line.push_back(c);
+        }
+        return false;
+    }
+
+private:
+    int m_in;
+    int m_out;
+};
+
+enum class ReadStatus
+{
+    ok,
+    closed,     //!< End of the stream or a malformed header
+    too_large   //!< The payload is longer than CompileServer::max_request_bytes
+};
+
+//! Reads one request
+ReadStatus read_request(Channel& channel, CompileRequest& request)
+{
+    std::string header;
+    if (!channel.read_line(header))
+    {
+        return ReadStatus::closed;
+    }
+    char format[8] = {};
+    char kind[8] = {};
+    unsigned long long length = 0;
+    if (std::sscanf(header.c_str(), "tyx1 %7s %7s %llu", format, kind, &length) != 3
+        || !format_from_name(format, request.format)
+        || (std::strcmp(kind, "path") != 0 && std::strcmp(kind, "text") != 0))
+    {
+        return ReadStatus::closed;
+    }
+    if (length > CompileServer::max_request_bytes)
+    {
+        return ReadStatus::too_large;
+    }
+    request.inline_text = std::strcmp(kind, "text") == 0;
+    request.payload.resize(static_cast<size_t>(length));
+    return channel.read(&request.payload[0], request.payload.size()) ? ReadStatus::ok : ReadStatus::closed;
+}
+
+bool write_request(Channel& channel, CompileRequest const& request)
+{
+    auto const header = std::string{ "tyx1 " } + format_name(request.format) + (request.inline_text ? " text " : " path ")
+        + std::to_string(request.payload.size()) + "\n";
+    return channel.write(header) && channel.write(request.payload);
+}
+
+bool write_response(Channel& channel, CompileResponse const& response)
+{
+    auto const header = "tyx1 " + std::to_string(response.status) + " " + std::to_string(response.output.size())
+        + " " + std::to_string(response.diagnostics.size()) + "\n";
+    return channel.write(header) && channel.write(response.output) && channel.write(response.diagnostics);
+}
+
+bool read_response(Channel& channel, CompileResponse& response)
+{
+    std::string header;
+    unsigned long long output = 0;
+    unsigned long long diagnostics = 0;
+    if (!channel.read_line(header) || std::sscanf(header.c_str(), "tyx1 %d %llu %llu", &response.status, &output, &diagnostics) != 3)
+    {
+        return false;
+    }
+    response.output.resize(static_cast<size_t>(output));
+    response.diagnostics.resize(static_cast<size_t>(diagnostics));
+    return channel.read(&response.output[0], response.output.size())
+        && channel.read(&response.diagnostics[0], response.diagnostics.size());
+}
+
+CompileResponse error_response(std::string message)
+{
+    CompileResponse response;
+    response.status = 1;
+    response.diagnostics = std::move(message) + "\n";
+    return response;
+}
+
+//! Compiles 'request', turning anything it throws into an error response, so one request
+//! can't take down a server that other clients share
+CompileResponse compile_guarded(CompileServer& server, CompileRequest const& request)
+{
+    try
+    {
+        return server.compile(request);
+    }
+    catch (std::exception const& e)
+    {
+        return error_response(std::string{ "Internal compiler error: " } + e.what());
+    }
+    catch (...)
+    {
+        return error_response("Internal compiler error");
+    }
+}
+
+//! Answers requests on 'channel' until the client closes it or sends one too large to read
+void serve(CompileServer& server, Channel& channel)
+{
+    CompileRequest request;
+    while (1)
+    {
+        auto const status = read_request(channel, request);
+        if (status == ReadStatus::too_large)
+        {
+            write_response(channel, error_response("Request larger than " + std::to_string(CompileServer::max_request_bytes) + " bytes refused"));
+            break;
+        }
+        if (status != ReadStatus::ok || !write_response(channel, compile_guarded(server, request)))
+        {
+            break;
+        }
+    }
+}
+
+//! serve() for one client; a failure outside compile() drops only that client
+void serve_client(CompileServer& server, Channel& channel)
+{
+    try
+    {
+        serve(server, channel);
+    }
+    catch (std::exception const& e)
+    {
+        fprintf(stderr, "; client dropped: %s\n", e.what());
+    }
+    catch (...)
+    {
+        fprintf(stderr, "; client dropped\n");
+    }
+}
+
+} // namespace
+
+std::shared_ptr<CompileServer::Module> CompileServer::module(std::string const& key)
+{
+    std::lock_guard<std::mutex> lock{ m_mutex };
+    auto& entry = m_modules[key];
+    if (!entry)
+    {
+        entry = std::make_shared<Module>();
+    }
+    m_lru.remove(key);
+    m_lru.push_front(key);
+    while (m_lru.size() > max_modules)
+    {
+        // Requests still using the module keep it alive through their shared_ptr
+        m_modules.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+    return entry;
+}
+
+CompileResponse CompileServer::compile(CompileRequest const& request)
+{
+    auto const start = std::chrono::steady_clock::now();
+    CompileResponse response;
+    std::string text;
+    if (request.inline_text)
+    {
+        text = request.payload;
+    }
+    else if (!read_file(request.payload.c_str(), text))
+    {
+        response.status = 1;
+        response.diagnostics = "Cannot open " + request.payload + "\n";
+        return response;
+    }
+    // The buffer tokenize() would make, so unchanged text compares equal to it
+    if (text.empty() || !(char_class_table()[uint8_t(text.back())] & CC_SPACE))
+    {
+        text.push_back(' ');
+    }
+
+    auto const key = request.inline_text ? "text:" + std::to_string(std::hash<std::string>{}(text)) : "path:" + request.payload;
+    auto const m = module(key);
+    std::lock_guard<std::mutex> lock{ m->mutex };
+
+    auto const* name = request.inline_text ? "<text>" : request.payload.c_str();
+    char const* reuse = "reused";
+    try
+    {
+        auto const& old = m->tokens ? &m->tokens->buffer() : nullptr;
+        auto const unchanged = m->ast && old->size() == text.size() && std::memcmp(old->data(), text.data(), text.size()) == 0;
+        auto parsed = unchanged;
+        if (!unchanged && m->ast && m->edits < max_incremental_edits)
+        {
+            auto const edit = text_edit(old->data(), old->size(), text.data(), text.size());
+            TokenEdit changed;
+            relex(*m->tokens, edit, changed);
+            try
+            {
+                reparse(*m->ast, *m->tokens, changed);
+                ++m->edits;
+                reuse = "reparsed";
+                parsed = true;
+            }
+            catch (ParseException const&)
+            {
+                // Parsed from scratch below, which reports every error rather than the first
+            }
+        }
+        if (!parsed)
+        {
+            m->ast.reset();
+            m->edits = 0;
+            // From a copy, so a lexing error can still point into 'text'
+            m->tokens = std::make_unique<TokenList>(tokenize(text));
+            Diagnostics diagnostics{ m->tokens->buffer().data(), m->tokens->buffer().size() };
+            auto ast = parse_recovering(*m->tokens, diagnostics);
+            if (diagnostics.empty())
+            {
+                m->ast = std::make_unique<ParseContext>(std::move(ast));
+            }
+            else
+            {
+                response.status = 1;
+                diagnostics.render(response.diagnostics, name);
+            }
+            reuse = "parsed";
+        }
+    }
+    catch (TokenException const& e)
+    {
+        response.status = 1;
+        Diagnostics diagnostics{ text.data(), text.size() };
+        report(diagnostics, e);
+        diagnostics.render(response.diagnostics, name);
+    }
+    if (response.status != 0)
+    {
+        // An incremental edit left the module as it was; start over next time
+        m->ast.reset();
+        m->edits = 0;
+        m->tokens.reset();
+        return response;
+    }
+
+    StringSink out;
+    try
+    {
+        switch (request.format)
+        {
+        case OutputFormat::bitcode:     generate_bitcode(*m->ast, out); break;
+        case OutputFormat::elf_object:  generate_elf(*m->ast, out); break;
+        default:                        generate_serial(*m->ast, out); break;
+        }
+    }
+    catch (EvalException const& e)
+    {
+        response.status = 1;
+        Diagnostics diagnostics{ m->tokens->buffer().data(), m->tokens->buffer().size() };
+        report(diagnostics, *m->tokens, e);
+        diagnostics.render(response.diagnostics, name);
+    }
+    response.output = out.str();
+
+    auto const micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "; %s %s: %s, %lld us\n", format_name(request.format), name, reuse, static_cast<long long>(micros));
+    return response;
+}
+
+int serve_stdio(CompileServer& server)
+{
+#ifdef _WIN32
+    _setmode(0, _O_BINARY);
+    _setmode(1, _O_BINARY);
+#endif
+    Channel channel{ 0, 1 };
+    serve_client(server, channel);
+    return 0;
+}
+
+#ifdef _WIN32
+
+int serve_socket(CompileServer&, char const*)
+{
+    fprintf(stderr, "Unix domain sockets aren't supported on this platform; use 'tyx --server' on stdin/stdout\n");
+    return 1;
+}
+
+int run_client(char const*, CompileRequest const&)
+{
+    fprintf(stderr, "Unix domain sockets aren't supported on this platform\n");
+    return 1;
+}
+
+#else
+
+namespace
+{
+
+//! Fills 'address' for 'path'; false if the path doesn't fit
+bool socket_address(char const* path, sockaddr_un& address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    std::strcpy(address.sun_path, path);
+    return true;
+}
+
+//! Clears 'path' for bind: nothing there, or a socket nobody listens on any more.
+//! Anything else - a regular file, a live server - is left alone and refused.
+bool claim_socket_path(char const* path, sockaddr_un const& address)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        if (errno == ENOENT)
+        {
+            return true;
+        }
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, std::strerror(errno));
+        return false;
+    }
+    if (!S_ISSOCK(info.st_mode))
+    {
+        fprintf(stderr, "Cannot listen on %s: it exists and isn't a socket\n", path);
+        return false;
+    }
+    auto const probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, std::strerror(errno));
+        return false;
+    }
+    auto const live = connect(probe, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) == 0;
+    close(probe);
+    if (live)
+    {
+        fprintf(stderr, "Cannot listen on %s: another server is already listening there\n", path);
+        return false;
+    }
+    if (unlink(path) != 0 && errno != ENOENT)
+    {
+        fprintf(stderr, "Cannot remove stale socket %s: %s\n", path, std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int serve_socket(CompileServer& server, char const* path)
+{
+    // A client going away must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    if (!socket_address(path, address))
+    {
+        return 1;
+    }
+    if (!claim_socket_path(path, address))
+    {
+        return 1;
+    }
+    auto const listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, std::strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "; listening on %s\n", path);
+    for (;;)
+    {
+        auto const client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            fprintf(stderr, "accept failed: %s\n", std::strerror(errno));
+            return 1;
+        }
+        std::thread([&server, client]
+        {
+            Channel channel{ client, client };
+            serve_client(server, channel);
+            close(client);
+        }).detach();
+    }
+}
+
+int run_client(char const* path, CompileRequest const& request)
+{
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    if (!socket_address(path, address))
+    {
+        return 1;
+    }
+    auto const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        fprintf(stderr, "Cannot connect to %s: %s\n", path, std::strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    Channel channel{ fd, fd };
+    CompileResponse response;
+    auto const ok = write_request(channel, request) && read_response(channel, response);
+    close(fd);
+    if (!ok)
+    {
+        fprintf(stderr, "Connection to %s failed\n", path);
+        return 1;
+    }
+    Channel{ -1, 1 }.write(response.output);
+    fputs(response.diagnostics.c_str(), stderr);
+    return response.status;
+}
+
+#endif
+
+} // namespace ty
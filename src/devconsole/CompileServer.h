@@ -0,0 +1,77 @@
+#pragma once
+
+#include "cgen/LLVM_IR_Generator.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ty
+{
+
+//! One compile, as sent by 'tyx --client' or any other client of the protocol:
+//!     request:    "tyx1 <ll|bc|obj> <path|text> <length>\n" + length bytes of path or source
+//!     response:   "tyx1 <status> <output length> <diagnostics length>\n" + output + diagnostics
+//! Status 0 means success; the output is what 'tyx --emit=<format>' would write to stdout
+//! and the diagnostics what it would write to stderr.
+struct CompileRequest
+{
+    OutputFormat    format = OutputFormat::llvm_ir;
+    bool            inline_text = false;    //!< 'payload' is source text rather than a path
+    std::string     payload;
+};
+
+struct CompileResponse
+{
+    int             status = 0;
+    std::string     output;
+    std::string     diagnostics;
+};
+
+//! Compiles requests against warm state shared by every client: each module's tokens,
+//! interned strings and tree stay cached after a request. A later request for the same
+//! file reuses the tree if the text is unchanged and otherwise relexes and reparses only
+//! the edited definitions (see reparse()). Requests for different modules run
+//! concurrently; requests for the same module wait for each other.
+class CompileServer
+{
+public:
+    //! Modules beyond this many are dropped, least recently used first
+    static constexpr size_t max_modules = 256;
+
+    //! Edits applied incrementally before a module is parsed from scratch, which frees the
+    //! nodes the edits replaced
+    static constexpr size_t max_incremental_edits = 16;
+
+    //! Largest payload a request may announce. A larger one is refused with an error response
+    //! and the connection closed, since the client's length can't be trusted to skip it.
+    static constexpr size_t max_request_bytes = size_t(256) << 20;
+
+    CompileResponse compile(CompileRequest const& request);
+
+private:
+    struct Module;
+
+    //! Returns the module cached under 'key', creating it if needed
+    std::shared_ptr<Module> module(std::string const& key);
+
+    std::mutex                                                  m_mutex;    //!< Guards the two members below
+    std::list<std::string>                                      m_lru;      //!< Most recently used first
+    std::unordered_map<std::string, std::shared_ptr<Module>>    m_modules;
+};
+
+//! Serves framed requests from stdin until it is closed, writing responses to stdout
+int serve_stdio(CompileServer& server);
+
+//! Accepts clients on the Unix domain socket at 'path', each on its own thread, forever
+//! \returns non-zero if the socket can't be set up (or on platforms without Unix sockets)
+int serve_socket(CompileServer& server, char const* path);
+
+//! Sends 'request' to the server at 'path' and copies the response to stdout and stderr
+//! \returns the response's status, or 1 if the server can't be reached
+int run_client(char const* path, CompileRequest const& request);
+
+} // namespace ty
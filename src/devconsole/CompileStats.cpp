@@ -0,0 +1,139 @@
+#include "CompileStats.h"
+
+#include <chrono>
+
+namespace ty
+{
+
+namespace
+{
+
+double wall_seconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! Writes '"key": value'; keys are identifiers chosen by tyx, so nothing needs escaping
+void json_pair(FILE* out, char const* key, uint64_t value, bool last = false)
+{
+    fprintf(out, "\"%s\": %llu%s", key, static_cast<unsigned long long>(value), last ? "" : ", ");
+}
+
+} // namespace
+
+CompileStats::Phase::Phase(CompileStats* stats, char const* name)
+    : m_stats{ stats }
+{
+    if (!m_stats)
+    {
+        return;
+    }
+    m_index = m_stats->m_phases.size();
+    m_stats->m_phases.emplace_back();
+    m_stats->m_phases.back().name = name;
+    m_stats->m_starts.push_back(m_stats->now());
+}
+
+CompileStats::Phase::~Phase()
+{
+    if (!m_stats)
+    {
+        return;
+    }
+    auto const end = m_stats->now();
+    auto const& start = m_stats->m_starts[m_index];
+    auto& r = m_stats->m_phases[m_index];
+    r.wall_seconds = end.wall_seconds - start.wall_seconds;
+    r.cpu_seconds = end.cpu_seconds - start.cpu_seconds;
+    r.allocations.count = end.allocations.count - start.allocations.count;
+    r.allocations.bytes = end.allocations.bytes - start.allocations.bytes;
+    r.counters.cycles = end.counters.cycles - start.counters.cycles;
+    r.counters.instructions = end.counters.instructions - start.counters.instructions;
+    r.counters.cache_misses = end.counters.cache_misses - start.counters.cache_misses;
+}
+
+CompileStats::CompileStats()
+{
+    enable_allocation_counting();
+}
+
+CompileStats::Snapshot CompileStats::now() const
+{
+    return Snapshot{ wall_seconds(), process_cpu_seconds(), allocation_totals(), m_counters.read() };
+}
+
+void CompileStats::print_table(FILE* out) const
+{
+    auto const hardware = m_counters.available();
+    fprintf(out, "%-10s %12s %12s %12s %14s", "phase", "wall ms", "cpu ms", "allocs", "alloc bytes");
+    if (hardware)
+    {
+        fprintf(out, " %14s %14s %12s", "cycles", "instructions", "cache miss");
+    }
+    fputc('\n', out);
+
+    Record total;
+    total.name = "total";
+    auto const row = [&](Record const& r)
+    {
+        fprintf(out, "%-10s %12.3f %12.3f %12llu %14llu", r.name.c_str(), r.wall_seconds * 1e3, r.cpu_seconds * 1e3,
+            static_cast<unsigned long long>(r.allocations.count), static_cast<unsigned long long>(r.allocations.bytes));
+        if (hardware)
+        {
+            fprintf(out, " %14llu %14llu %12llu", static_cast<unsigned long long>(r.counters.cycles),
+                static_cast<unsigned long long>(r.counters.instructions), static_cast<unsigned long long>(r.counters.cache_misses));
+        }
+        fputc('\n', out);
+    };
+    for (auto const& r : m_phases)
+    {
+        row(r);
+        total.wall_seconds += r.wall_seconds;
+        total.cpu_seconds += r.cpu_seconds;
+        total.allocations.count += r.allocations.count;
+        total.allocations.bytes += r.allocations.bytes;
+        total.counters.cycles += r.counters.cycles;
+        total.counters.instructions += r.counters.instructions;
+        total.counters.cache_misses += r.counters.cache_misses;
+    }
+    row(total);
+    if (!hardware)
+    {
+        fprintf(out, "(hardware counters unavailable)\n");
+    }
+
+    fputc('\n', out);
+    for (auto const& c : m_counts)
+    {
+        fprintf(out, "%-16s %14llu\n", c.first.c_str(), static_cast<unsigned long long>(c.second));
+    }
+    fprintf(out, "%-16s %14llu\n", "peak_rss_bytes", static_cast<unsigned long long>(peak_rss_bytes()));
+}
+
+void CompileStats::print_json(FILE* out) const
+{
+    fprintf(out, "{\n  \"phases\": [\n");
+    for (size_t i = 0; i < m_phases.size(); ++i)
+    {
+        auto const& r = m_phases[i];
+        fprintf(out, "    { \"name\": \"%s\", \"wall_s\": %.9f, \"cpu_s\": %.9f, ", r.name.c_str(), r.wall_seconds, r.cpu_seconds);
+        json_pair(out, "allocations", r.allocations.count);
+        json_pair(out, "allocated_bytes", r.allocations.bytes, !m_counters.available());
+        if (m_counters.available())
+        {
+            json_pair(out, "cycles", r.counters.cycles);
+            json_pair(out, "instructions", r.counters.instructions);
+            json_pair(out, "cache_misses", r.counters.cache_misses, true);
+        }
+        fprintf(out, " }%s\n", i + 1 == m_phases.size() ? "" : ",");
+    }
+    fprintf(out, "  ],\n  \"hardware_counters\": %s,\n  \"counts\": { ", m_counters.available() ? "true" : "false");
+    for (auto const& c : m_counts)
+    {
+        json_pair(out, c.first.c_str(), c.second);
+    }
+    json_pair(out, "peak_rss_bytes", peak_rss_bytes(), true);
+    fprintf(out, " }\n}\n");
+}
+
+} // namespace ty
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "cgen/OutputSink.h"
+#include "common/ProcessStats.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ty
+{
+
+struct AllocationTotals
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+//! Starts counting calls to the global operator new (see AllocationHook.cpp); off by default
+void enable_allocation_counting();
+
+//! Allocations made since enable_allocation_counting()
+AllocationTotals allocation_totals();
+
+//! Wall time, processor time, allocations and hardware counters of the phases of one
+//! compile, plus counts describing its input and output, for 'tyx --stats'
+class CompileStats
+{
+public:
+    //! Measures from construction to destruction; phases must not overlap.
+    //! Does nothing when 'stats' is null, so code can be instrumented unconditionally.
+    class Phase
+    {
+    public:
+        Phase(CompileStats* stats, char const* name);
+        ~Phase();
+
+        Phase(Phase const&) = delete;
+        Phase& operator=(Phase const&) = delete;
+
+    private:
+        CompileStats*   m_stats;
+        size_t          m_index = 0;
+    };
+
+    //! Also starts counting allocations, for the rest of the process
+    CompileStats();
+
+    //! Records a named quantity, e.g. the number of tokens
+    void count(char const* name, uint64_t value) { m_counts.emplace_back(name, value); }
+
+    void print_table(FILE* out) const;
+
+    void print_json(FILE* out) const;
+
+private:
+    struct Record
+    {
+        std::string                 name;
+        double                      wall_seconds = 0;
+        double                      cpu_seconds = 0;
+        AllocationTotals            allocations;
+        HardwareCounters::Values    counters;
+    };
+
+    struct Snapshot
+    {
+        double                      wall_seconds;
+        double                      cpu_seconds;
+        AllocationTotals            allocations;
+        HardwareCounters::Values    counters;
+    };
+
+    Snapshot now() const;
+
+    HardwareCounters                                m_counters;
+    std::vector<Record>                             m_phases;
+    std::vector<Snapshot>                           m_starts;       //!< Parallel to m_phases
+    std::vector<std::pair<std::string, uint64_t>>   m_counts;
+};
+
+//! Forwards to another sink, counting bytes and lines on the way
+class CountingSink : public OutputSink
+{
+public:
+    explicit CountingSink(OutputSink& next) : m_next{ next } {}
+
+    uint64_t bytes() const noexcept { return m_bytes; }
+    uint64_t lines() const noexcept { return m_lines; }
+
+protected:
+    void flush_buffer(char const* data, size_t size) override
+    {
+        m_bytes += size;
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_lines += data[i] == '\n';
+        }
+        m_next.text(data, size);
+    }
+
+private:
+    OutputSink& m_next;
+    uint64_t    m_bytes = 0;
+    uint64_t    m_lines = 0;
+};
+
+} // namespace ty
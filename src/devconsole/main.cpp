@@ -1,14 +1,23 @@
 #include <cppcoretools\print.h>
 #include "parse/SymbolTable.h"
 #include "parse/Parse.h"
+#include "parse/FlatAst.h"
+#include "parse/ConstantEvaluator.h"
 #include "cgen/LLVM_IR_Generator.h"
+#include "cgen/CompileCache.h"
+#include "vm/BytecodeCompiler.h"
+#include "vm/Interpreter.h"
 #include "token/TokenList.h"
-
-class UndefinedSymbolException : public std::exception
-{
-public:
-    char const* what() const override { return "Undefined symbol during compilation"; }
-};
+#include "token/FastLexer.h"
+#include "devconsole/CompileStats.h"
+#include "devconsole/CompileServer.h"
+#include "devconsole/BatchCompile.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
 
 void run_tests()
 {
@@ -21,6 +30,40 @@ void run_tests()
     }
 }
 
+enum class StatsFormat
+{
+    none,
+    table,
+    json
+};
+
+//! Number of scopes in 'ctx': its own plus one per function body, recursively
+size_t count_scopes(ty::ParseContext const& ctx)
+{
+    size_t n = 1;
+    for (auto const* expr : ctx.exprs)
+    {
+        auto const* fn = dynamic_cast<ty::FunctionDefnExpr const*>(expr);
+        if (fn && fn->m_body)
+        {
+            n += count_scopes(*fn->m_body);
+        }
+    }
+    return n;
+}
+
+//! Prints the error reported by ty::report(diagnostics, args...) with the line of 'text' it is on,
+//! as parse() prints parse errors
+//! \returns the exit code of a failed compile
+template <typename... Args>
+int print_error(char const* text, size_t size, char const* source_name, Args const&... args)
+{
+    ty::Diagnostics diagnostics{ text, size };
+    ty::report(diagnostics, args...);
+    diagnostics.render(stderr, source_name);
+    return 1;
+}
+
 int main(int argc, char** argv)
 {
     cct::scoped_failure_handler{ [](char const* op)
@@ -28,6 +71,246 @@ int main(int argc, char** argv)
         fprintf(stderr, "Operation '%s' failed\n", op);
     } };
 
+    auto stats_format = StatsFormat::none;
+    char const* cache_directory = nullptr;
+    char const* server_socket = nullptr;
+    char const* client_socket = nullptr;
+    char const* out_directory = nullptr;
+    bool server = false;
+    bool batch = false;
+    unsigned jobs = 0;
+    std::vector<std::string> batch_inputs;
+    uint64_t cache_bytes = uint64_t(256) << 20;
+
+    // Strip global options so the positional forms below stay unchanged
+    int nargs = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--lexer=", 8) == 0)
+        {
+            auto& engine = ty::Global<ty::LexerSettings>().engine;
+            if (!ty::engine_from_string(argv[i] + 8, engine) || !ty::is_engine_supported(engine))
+            {
+                fprintf(stderr, "Unsupported lexer '%s' (reference, table, sse2, avx2, dfa, auto, checked)\n", argv[i] + 8);
+                return 1;
+            }
+            continue;
+        }
+        if (std::strncmp(argv[i], "--parse=", 8) == 0)
+        {
+            auto& mode = ty::Global<ty::ParseSettings>().mode;
+            if (std::string("serial") == argv[i] + 8)
+            {
+                mode = ty::ParseMode::serial;
+            }
+            else if (std::string("parallel") == argv[i] + 8)
+            {
+                mode = ty::ParseMode::parallel;
+            }
+            else if (std::string("iterative") == argv[i] + 8)
+            {
+                mode = ty::ParseMode::iterative;
+            }
+            else
+            {
+                fprintf(stderr, "Unsupported parse mode '%s' (serial, parallel, iterative)\n", argv[i] + 8);
+                return 1;
+            }
+            continue;
+        }
+        if (std::strncmp(argv[i], "--codegen=", 10) == 0)
+        {
+            auto& mode = ty::Global<ty::CodegenSettings>().mode;
+            if (std::string("serial") == argv[i] + 10)
+            {
+                mode = ty::CodegenMode::serial;
+            }
+            else if (std::string("parallel") == argv[i] + 10)
+            {
+                mode = ty::CodegenMode::parallel;
+            }
+            else
+            {
+                fprintf(stderr, "Unsupported codegen mode '%s' (serial, parallel)\n", argv[i] + 10);
+                return 1;
+            }
+            continue;
+        }
+        if (std::strncmp(argv[i], "--emit=", 7) == 0)
+        {
+            auto& format = ty::Global<ty::CodegenSettings>().format;
+            if (std::string("ll") == argv[i] + 7)
+            {
+                format = ty::OutputFormat::llvm_ir;
+            }
+            else if (std::string("bc") == argv[i] + 7)
+            {
+                format = ty::OutputFormat::bitcode;
+            }
+            else if (std::string("obj") == argv[i] + 7)
+            {
+                format = ty::OutputFormat::elf_object;
+            }
+            else
+            {
+                fprintf(stderr, "Unsupported output format '%s' (ll, bc, obj)\n", argv[i] + 7);
+                return 1;
+            }
+            continue;
+        }
+        if (std::strncmp(argv[i], "--stats", 7) == 0)
+        {
+            // Per-phase timing and resources of a compile, on stderr
+            if (std::string("--stats") == argv[i] || std::string("--stats=table") == argv[i])
+            {
+                stats_format = StatsFormat::table;
+            }
+            else if (std::string("--stats=json") == argv[i])
+            {
+                stats_format = StatsFormat::json;
+            }
+            else
+            {
+                fprintf(stderr, "Unsupported stats format '%s' (table, json)\n", argv[i] + 7);
+                return 1;
+            }
+            continue;
+        }
+        if (std::string("--server") == argv[i] || std::strncmp(argv[i], "--server=", 9) == 0)
+        {
+            // Keeps parsed modules warm between requests, see CompileServer
+            server = true;
+            server_socket = argv[i][8] == '=' ? argv[i] + 9 : nullptr;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--client=", 9) == 0)
+        {
+            client_socket = argv[i] + 9;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--cache=", 8) == 0)
+        {
+            // Reuses the IR of unchanged definitions from earlier compiles
+            cache_directory = argv[i] + 8;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--cache-size=", 13) == 0)
+        {
+            char* end = nullptr;
+            cache_bytes = std::strtoull(argv[i] + 13, &end, 10);
+            auto const shift = *end == 'K' ? 10 : *end == 'M' ? 20 : *end == 'G' ? 30 : 0;
+            if (end == argv[i] + 13 || (shift ? end[1] : end[0]) != '\0')
+            {
+                fprintf(stderr, "Invalid cache size '%s' (e.g. 64M)\n", argv[i] + 13);
+                return 1;
+            }
+            cache_bytes <<= shift;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--export=", 9) == 0)
+        {
+            // Comma-separated names; --emit=obj makes the other definitions local symbols
+            auto& exports = ty::Global<ty::ExportList>();
+            for (char const* name = argv[i] + 9; *name; )
+            {
+                auto const* end = std::strchr(name, ',');
+                auto const length = end ? size_t(end - name) : std::strlen(name);
+                if (length > 0)
+                {
+                    exports.emplace_back(name, length);
+                }
+                name += end ? length + 1 : length;
+            }
+            continue;
+        }
+        if (std::strncmp(argv[i], "-j", 2) == 0 || std::strncmp(argv[i], "--jobs=", 7) == 0)
+        {
+            // Compiles every input to its own output file, see compile_batch()
+            auto const* count = argv[i][1] == 'j' ? argv[i] + 2 : argv[i] + 7;
+            if (argv[i][1] == 'j' && *count == '\0' && i + 1 < argc)
+            {
+                count = argv[++i];
+            }
+            char* end = nullptr;
+            jobs = static_cast<unsigned>(std::strtoul(count, &end, 10));
+            if (end == count || *end != '\0')
+            {
+                fprintf(stderr, "Invalid job count '%s'\n", count);
+                return 1;
+            }
+            batch = true;
+            continue;
+        }
+        if (argv[i][0] == '@' && argv[i][1] != '\0')
+        {
+            if (!ty::read_file_list(argv[i] + 1, batch_inputs))
+            {
+                fprintf(stderr, "Cannot read file list '%s'\n", argv[i] + 1);
+                return 1;
+            }
+            batch = true;
+            continue;
+        }
+        if (std::strncmp(argv[i], "--out-dir=", 10) == 0)
+        {
+            out_directory = argv[i] + 10;
+            continue;
+        }
+        argv[nargs++] = argv[i];
+    }
+    argc = nargs;
+
+    if (batch)
+    {
+        // tyx -j N [--emit=...] [--out-dir=<dir>] <file | @filelist>...
+        batch_inputs.insert(batch_inputs.end(), argv + 1, argv + argc);
+        if (batch_inputs.empty() || server || client_socket || cache_directory || stats_format != StatsFormat::none)
+        {
+            fprintf(stderr, "usage: tyx -j <jobs> [--emit=ll|bc|obj] [--out-dir=<dir>] <file | @filelist>...\n");
+            return 1;
+        }
+        return ty::compile_batch(batch_inputs, jobs, out_directory);
+    }
+
+    if (server)
+    {
+        ty::CompileServer compile_server;
+        return server_socket ? ty::serve_socket(compile_server, server_socket) : ty::serve_stdio(compile_server);
+    }
+    if (client_socket)
+    {
+        // tyx --client=<socket> [--emit=...] <file | ->, where '-' sends stdin as text
+        if (argc != 2)
+        {
+            fprintf(stderr, "usage: tyx --client=<socket> [--emit=ll|bc|obj] <file | ->\n");
+            return 1;
+        }
+        ty::CompileRequest request;
+        request.format = ty::Global<ty::CodegenSettings>().format;
+        if (std::string("-") == argv[1])
+        {
+            request.inline_text = true;
+            char chunk[4096];
+            size_t n = 0;
+            while ((n = fread(chunk, 1, sizeof(chunk), stdin)) > 0)
+            {
+                request.payload.append(chunk, n);
+            }
+        }
+        else
+        {
+            // The server may run in another directory
+#ifdef _WIN32
+            char full[_MAX_PATH];
+            request.payload = _fullpath(full, argv[1], sizeof(full)) ? full : argv[1];
+#else
+            char full[PATH_MAX];
+            request.payload = realpath(argv[1], full) ? full : argv[1];
+#endif
+        }
+        return ty::run_client(client_socket, request);
+    }
+
     if (argc == 1)
     {
         run_tests();
@@ -38,64 +321,246 @@ int main(int argc, char** argv)
 
     if (argc == 3)
     {
-        if (std::string("tokenize") == argv[1])
+        try
+        {
+            if (std::string("tokenize") == argv[1])
+            {
+                auto list = ty::tokenize(argv[2]);
+                cct::println("Tokenizing '%s'", argv[2]);
+                for (auto const& token : list)
+                {
+                    cct::println("%s", token.as_string().c_str());
+                }
+                return 0;
+            }
+            if (std::string("parse") == argv[1])
+            {
+                auto const ast = ty::parse(ty::tokenize(argv[2]));
+                for (auto const& expr : ast.exprs)
+                {
+                    expr->print(cct::unique_file{ stdout });
+                }
+                fprintf(stderr, "; %zu nodes, %zu bytes allocated\n", ast.node_count(), ast.allocated_bytes());
+                return 0;
+            }
+            if (std::string("flat") == argv[1])
+            {
+                // Round-trips through the serialized form before printing
+                auto const ast = ty::parse(ty::tokenize(argv[2]));
+                std::vector<char> bytes;
+                ty::flatten(ast).serialize(bytes);
+                auto const flat = ty::FlatAst::deserialize(bytes.data(), bytes.size());
+                ty::print(flat, cct::unique_file{ stdout });
+                fprintf(stderr, "; %zu flat nodes, %zu bytes serialized\n", flat.size(), bytes.size());
+                return 0;
+            }
+        }
+        catch (ty::TokenException const& e)
+        {
+            return print_error(argv[2], std::strlen(argv[2]), "<source>", e);
+        }
+    }
+
+    if (argc >= 3 && std::string("run") == argv[1])
+    {
+        // Executes the file's functions (or just argv[3]) on the bytecode VM, without LLVM.
+        // The source and tokens outlive the try block so errors can point into them.
+        std::unique_ptr<ty::SourceBuffer const> source;
+        std::unique_ptr<ty::TokenList const> list;
+        try
         {
-            auto list = ty::tokenize(argv[2]);
-            cct::println("Tokenizing '%s'", argv[2]);
-            for (auto const& token : list)
+            source = ty::load_source(argv[2]);
+            list = std::make_unique<ty::TokenList const>(ty::tokenize(*source));
+            auto const ast = ty::parse(*list, argv[2]);
+            if (!ast.arena)
+            {
+                return 1;
+            }
+            // Not folded: the point of running is to execute the code, not the evaluator
+            auto const module = ty::compile_bytecode(ast, false);
+            ty::Interpreter vm{ module };
+            auto found = false;
+            for (size_t i = 0; i < module.functions.size(); ++i)
+            {
+                auto const* name = ast.interner->name(module.functions[i].name);
+                if (argc == 3 || std::string(argv[3]) == name)
+                {
+                    printf("%s() = %lld\n", name, static_cast<long long>(vm.call(i)));
+                    found = true;
+                }
+            }
+            if (argc > 3 && !found)
             {
-                cct::println("%s", token.as_string().c_str());
+                fprintf(stderr, "No function '%s' in %s\n", argv[3], argv[2]);
+                return 1;
             }
-            return 0;
         }
-        if (std::string("parse") == argv[1])
+        catch (ty::SourceException const& e)
+        {
+            fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+        catch (ty::TokenException const& e)
+        {
+            return print_error(source->data(), source->size(), argv[2], e);
+        }
+        catch (ty::EvalException const& e)
+        {
+            return print_error(source->data(), source->size(), argv[2], *list, e);
+        }
+        catch (ty::VmException const& e)
+        {
+            fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc == 6 && std::string("reparse") == argv[1])
+    {
+        // Applies one edit (offset, removed length, inserted text) incrementally
+        try
         {
-            auto const ast = ty::parse(ty::tokenize(argv[2]));
+            auto tokens = ty::tokenize(argv[2]);
+            auto ast = ty::parse(tokens);
+            ty::TokenEdit changed;
+            ty::relex(tokens, ty::TextEdit{ std::stoul(argv[3]), std::stoul(argv[4]), argv[5] }, changed);
+            auto const stats = ty::reparse(ast, tokens, changed);
             for (auto const& expr : ast.exprs)
             {
                 expr->print(cct::unique_file{ stdout });
             }
-            return 0;
+            fprintf(stderr, "; relexed tokens [%zu, %zu) as [%zu, %zu), reparsed %zu, reused %zu definitions\n",
+                changed.first, changed.old_end, changed.first, changed.new_end, stats.reparsed, stats.reused);
+        }
+        catch (ty::TokenException const& e)
+        {
+            fprintf(stderr, "%s at offset %zu\n", e.what(), e.offset);
+            return 1;
         }
+        catch (ty::ParseException const& e)
+        {
+            fprintf(stderr, "%s at token %zu\n", e.m_message.c_str(), e.m_position.index());
+            return 1;
+        }
+        return 0;
     }
 
     using namespace ty;
 
-    cct::unique_file in{ argv[1], "r" };
-
-    std::string text;
-    for (char c = in.getc(); c != EOF; c = in.getc())
+    std::unique_ptr<CompileCache> cache;
+    if (cache_directory)
     {
-        text += c;
+        if (Global<CodegenSettings>().format != OutputFormat::llvm_ir)
+        {
+            fprintf(stderr, "--cache only applies to LLVM IR output (--emit=ll)\n");
+            return 1;
+        }
+        try
+        {
+            cache = std::make_unique<CompileCache>(cache_directory, cache_bytes, ".ll");
+        }
+        catch (CacheException const& e)
+        {
+            fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
     }
-    auto list = tokenize(text);
-    for (auto const& token : list)
+
+    std::unique_ptr<CompileStats> stats;
+    if (stats_format != StatsFormat::none)
     {
-        cct::println("; %s", token.as_string().c_str());
+        stats = std::make_unique<CompileStats>();
     }
+    using Phase = CompileStats::Phase;
 
-    return -1; // fail for now
-
-    //	cct::println("@x = global i32 5, align 4");
-
-    auto ast = parse(list);
+    // The source and tokens outlive the try block so errors can point into them
+    std::unique_ptr<SourceBuffer const> source;
+    std::unique_ptr<TokenList const> list;
+    try
+    {
+        source = [&] { Phase p{ stats.get(), "read" }; return load_source(argv[1]); }();
+        auto const source_bytes = source->size();
 
-    //Global<SymbolTable>().add<Int32LiteralExpr>("x", "5");
-    //Global<ExportList>().emplace_back("x");
+        // Tokens point directly into the mapped file
+        list = [&] { Phase p{ stats.get(), "lex" }; return std::make_unique<TokenList const>(tokenize(*source)); }();
+        auto const ast = [&] { Phase p{ stats.get(), "parse" }; return parse(*list, argv[1]); }();
+        if (!ast.arena)
+        {
+            return 1; // already reported by parse()
+        }
 
-    LLVM_IR_Generator g{ cct::unique_file{stdout} };
-    for (auto const& export_id : Global<ExportList>())
-    {
-        if (auto const* defn = Global<SymbolTable>().expr_at(export_id))
+        FileSink file{ 1 }; // stdout
+        // Output is only counted for --stats, so a plain build writes straight to the file
+        std::unique_ptr<CountingSink> counter;
+        if (stats)
         {
-            defn->generate(g);
+            counter = std::make_unique<CountingSink>(file);
         }
-        else
+        OutputSink& out = counter ? static_cast<OutputSink&>(*counter) : file;
+        {
+            // Symbols are resolved, and constants folded, as definitions are generated
+            Phase p{ stats.get(), "emit" };
+            if (cache)
+            {
+                generate_cached(ast, *list, out, *cache);
+            }
+            else
+            {
+                generate_module(ast, out);
+            }
+            out.flush();
+            file.flush();
+        }
+        if (cache)
+        {
+            auto const& c = cache->stats();
+            fprintf(stderr, "; cache: %zu hits, %zu misses, %zu stored, %zu evicted\n", c.hits, c.misses, c.stored, c.evicted);
+        }
+        if (stats)
         {
-            throw UndefinedSymbolException{};
+            stats->count("source_bytes", source_bytes);
+            stats->count("tokens", list->size());
+            stats->count("ast_nodes", ast.node_count());
+            stats->count("symbols", ast.symbols->count());
+            stats->count("identifiers", ast.interner->count());
+            stats->count("scopes", count_scopes(ast));
+            stats->count("emitted_bytes", counter->bytes());
+            stats->count("emitted_lines", counter->lines());
+            if (cache)
+            {
+                stats->count("cache_hits", cache->stats().hits);
+                stats->count("cache_misses", cache->stats().misses);
+                stats->count("cache_evicted", cache->stats().evicted);
+            }
+            if (stats_format == StatsFormat::json)
+            {
+                stats->print_json(stderr);
+            }
+            else
+            {
+                stats->print_table(stderr);
+            }
         }
     }
-    cct::println(R"(define i32 @five() { ret i32 5 })");
+    catch (SourceException const& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    catch (TokenException const& e)
+    {
+        return print_error(source->data(), source->size(), argv[1], e);
+    }
+    catch (EvalException const& e)
+    {
+        return print_error(source->data(), source->size(), argv[1], *list, e);
+    }
+    catch (OutputException const& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
 
     return 0;
 }
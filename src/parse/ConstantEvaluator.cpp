@@ -0,0 +1,240 @@
+#include "ConstantEvaluator.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+
+namespace ty
+{
+
+namespace
+{
+
+bool in_range(NativeType n, int64_t value)
+{
+    switch (n)
+    {
+    case NativeType::I_32:  return value >= INT32_MIN && value <= INT32_MAX;
+    case NativeType::I_64:  return true;
+    default:
+        std::abort();
+        return false;
+    }
+}
+
+//! a + b, or false if it doesn't fit in 64 bits
+bool checked_add(int64_t a, int64_t b, int64_t& result)
+{
+    if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b)
+        || (b < 0 && a < std::numeric_limits<int64_t>::min() - b))
+    {
+        return false;
+    }
+    result = a + b;
+    return true;
+}
+
+bool checked_sub(int64_t a, int64_t b, int64_t& result)
+{
+    if ((b < 0 && a > std::numeric_limits<int64_t>::max() + b)
+        || (b > 0 && a < std::numeric_limits<int64_t>::min() + b))
+    {
+        return false;
+    }
+    result = a - b;
+    return true;
+}
+
+} // namespace
+
+Constant const* ConstantEvaluator::evaluate(Expr const& e)
+{
+    auto const found = m_memo.find(&e);
+    if (found != m_memo.end())
+    {
+        switch (found->second.state)
+        {
+        case State::Folded:         return &found->second.value;
+        case State::NotConstant:    return nullptr;
+        case State::InProgress:
+        {
+            // Report the cycle by the definition it was found in, if 'e' itself has no name
+            auto const* named = e.id() != invalid_symbol ? &e : m_definition;
+            throw EvalException(&e, "Cyclic definition of '" + name_of(named ? named->id() : invalid_symbol) + "'");
+        }
+        }
+    }
+
+    // References into an unordered_map stay valid while it grows
+    auto& entry = m_memo[&e];
+    auto* const outer = m_current;
+    auto const* const outer_definition = m_definition;
+    m_current = &entry;
+    if (e.id() != invalid_symbol)
+    {
+        m_definition = &e;
+    }
+    try
+    {
+        e.generate(*this);
+    }
+    catch (...)
+    {
+        m_current = outer;
+        m_definition = outer_definition;
+        m_memo.erase(&e);
+        throw;
+    }
+    m_current = outer;
+    m_definition = outer_definition;
+
+    if (entry.state == State::InProgress)
+    {
+        entry.state = State::NotConstant;
+    }
+    return entry.state == State::Folded ? &entry.value : nullptr;
+}
+
+std::string ConstantEvaluator::name_of(SymbolId id) const
+{
+    if (id == invalid_symbol)
+    {
+        return "<anonymous>";
+    }
+    return m_interner ? std::string(m_interner->name(id)) : "#" + std::to_string(id);
+}
+
+Expr const& ConstantEvaluator::resolve(Expr const& use, SymbolId name) const
+{
+    auto const* target = m_symbols.expr_at(name);
+    if (!target)
+    {
+        throw EvalException(&use, "Undefined symbol '" + name_of(name) + "'");
+    }
+    return *target;
+}
+
+void ConstantEvaluator::generate(FunctionDefnExpr const& expr)
+{
+    // Folding a function folds a call to it: only functions without parameters whose
+    // body is a single return are evaluated
+    if (expr.function_type()->parameter_count() != 0 || !expr.m_body || expr.m_body->exprs.size() != 1
+        || !dynamic_cast<ReturnExpr const*>(expr.m_body->exprs.front()))
+    {
+        return;
+    }
+    if (auto const* c = evaluate(*expr.m_body->exprs.front()))
+    {
+        fold(c->type, c->value);
+    }
+}
+
+void ConstantEvaluator::generate(Int32LiteralExpr const& expr)
+{
+    auto const* type = static_cast<SystemType const*>(expr.inferred_type());
+    errno = 0;
+    char* end = nullptr;
+    auto const value = std::strtoll(expr.text(), &end, 10);
+    if (errno == ERANGE || *end != '\0' || !in_range(type->native_type(), value))
+    {
+        throw EvalException(&expr, std::string("Literal ") + expr.text() + " out of range for " + to_string(type->native_type()));
+    }
+    fold(type, value);
+}
+
+void ConstantEvaluator::generate(ReturnExpr const& expr)
+{
+    if (auto const* c = evaluate(*expr.sub_expr()))
+    {
+        fold(c->type, c->value);
+    }
+}
+
+void ConstantEvaluator::generate(DataDefnExpr const& expr)
+{
+    if (auto const* c = evaluate(*expr.value()))
+    {
+        fold(c->type, c->value);
+    }
+}
+
+void ConstantEvaluator::generate(SymbolExpr const& expr)
+{
+    auto const& target = resolve(expr, expr.name());
+    if (!dynamic_cast<DataDefnExpr const*>(&target))
+    {
+        throw EvalException(&expr, "'" + name_of(expr.name()) + "' is not a value");
+    }
+    if (auto const* c = evaluate(target))
+    {
+        fold(c->type, c->value);
+    }
+}
+
+void ConstantEvaluator::generate(FunctionCallExpr const& expr)
+{
+    auto const& target = resolve(expr, expr.callee());
+    if (!dynamic_cast<FunctionDefnExpr const*>(&target))
+    {
+        throw EvalException(&expr, "'" + name_of(expr.callee()) + "' is not a function");
+    }
+    if (!expr.arguments().empty())
+    {
+        return;
+    }
+    if (auto const* c = evaluate(target))
+    {
+        fold(c->type, c->value);
+    }
+}
+
+void ConstantEvaluator::generate(AddExpr const& expr)
+{
+    auto const* l = evaluate(*expr.left());
+    auto const* r = evaluate(*expr.right());
+    if (!l || !r)
+    {
+        return;
+    }
+    if (l->type != r->type)
+    {
+        throw EvalException(&expr, "Type mismatch in addition");
+    }
+    int64_t sum = 0;
+    if (!checked_add(l->value, r->value, sum) || !in_range(l->type->native_type(), sum))
+    {
+        throw EvalException(&expr, std::string("Overflow in ") + to_string(l->type->native_type()) + " addition");
+    }
+    fold(l->type, sum);
+}
+
+void ConstantEvaluator::generate(SubExpr const& expr)
+{
+    auto const* l = evaluate(*expr.left());
+    auto const* r = evaluate(*expr.right());
+    if (!l || !r)
+    {
+        return;
+    }
+    if (l->type != r->type)
+    {
+        throw EvalException(&expr, "Type mismatch in subtraction");
+    }
+    int64_t difference = 0;
+    if (!checked_sub(l->value, r->value, difference) || !in_range(l->type->native_type(), difference))
+    {
+        throw EvalException(&expr, std::string("Overflow in ") + to_string(l->type->native_type()) + " subtraction");
+    }
+    fold(l->type, difference);
+}
+
+void ConstantEvaluator::generate(FunctionArgDeclExpr const&)
+{
+    // Arguments have no value until the function is called
+}
+
+void ConstantEvaluator::generate(Expr const&)
+{
+}
+
+} // namespace ty
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "parse/Parse.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace ty
+{
+
+//! Value of an expression known at compile time
+struct Constant
+{
+    SystemType const*   type;
+    int64_t             value;
+};
+
+//! Error found while folding, e.g. a cycle or an overflow
+struct EvalException : public std::exception
+{
+    //! Keeps the token of 'where' rather than 'where' itself, which is freed with its tree
+    //! when the exception unwinds out of the scope owning the tree
+    EvalException(Expr const* where, std::string msg)
+        : m_token{ where->token() }, m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    uint32_t        m_token;    //!< Index in the TokenList of the expression the error was found at
+    std::string     m_message;
+};
+
+//! Reports 'e' to 'diagnostics', underlining the token of the expression it was found at
+inline void report(Diagnostics& diagnostics, TokenList const& tlist, EvalException const& e)
+{
+    diagnostics.error(tlist.offset(e.m_token), tlist.length(e.m_token), e.m_message);
+}
+
+//! Folds expressions to constants: literals, + and - on them, names bound to
+//! value definitions and calls to zero-argument functions, which are pure since
+//! the language has no side effects. Names are resolved through the module's
+//! SymbolTable. Every result is memoized per Expr, so a definition used many
+//! times is folded once, and a definition reached again while it is still being
+//! folded is reported as a cycle. Arithmetic is checked against the range of the
+//! operands' NativeType.
+class ConstantEvaluator : private Generator
+{
+public:
+    //! 'symbols' is the table of a parsed module; 'names' is used for messages
+    explicit ConstantEvaluator(SymbolTable const& symbols, StringInterner const* names = nullptr)
+        : m_symbols{ symbols }
+    {
+        set_interner(names);
+    }
+
+    //! Folds 'e' (for a FunctionDefnExpr: the result of calling it)
+    //! \returns the value, or nullptr if 'e' isn't a compile-time constant
+    //! \throws EvalException on cycles, overflow, undefined names and type mismatches
+    Constant const* evaluate(Expr const& e);
+
+    //! Number of expressions evaluated so far
+    size_t memo_size() const noexcept { return m_memo.size(); }
+
+private:
+    enum class State { InProgress, Folded, NotConstant };
+
+    struct Entry
+    {
+        State       state = State::InProgress;
+        Constant    value{ nullptr, 0 };
+    };
+
+    void generate(FunctionDefnExpr const& expr) override;
+    void generate(Int32LiteralExpr const& expr) override;
+    void generate(ReturnExpr const& expr) override;
+    void generate(DataDefnExpr const& expr) override;
+    void generate(SymbolExpr const& expr) override;
+    void generate(FunctionCallExpr const& expr) override;
+    void generate(AddExpr const& expr) override;
+    void generate(SubExpr const& expr) override;
+    void generate(FunctionArgDeclExpr const& expr) override;
+    void generate(Expr const& expr) override;
+
+    //! Records the value of the expression whose generate() is running
+    void fold(SystemType const* type, int64_t value)
+    {
+        m_current->state = State::Folded;
+        m_current->value = Constant{ type, value };
+    }
+
+    std::string name_of(SymbolId id) const;
+
+    //! Resolves the target of a SymbolExpr or FunctionCallExpr
+    Expr const& resolve(Expr const& use, SymbolId name) const;
+
+    SymbolTable const&                          m_symbols;
+    std::unordered_map<Expr const*, Entry>      m_memo;
+    Entry*                                      m_current = nullptr;   //!< Entry of the innermost evaluate()
+    Expr const*                                 m_definition = nullptr; //!< Innermost named expression being evaluated
+};
+
+} // namespace ty
@@ -0,0 +1,94 @@
+#include "Diagnostics.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ty
+{
+
+LineIndex::LineIndex(char const* text, size_t size)
+    : m_text{ text }, m_size{ size }
+{
+    m_starts.push_back(0);
+    auto const* end = text + size;
+    for (auto const* p = text; (p = static_cast<char const*>(std::memchr(p, '\n', static_cast<size_t>(end - p)))) != nullptr; )
+    {
+        ++p;
+        m_starts.push_back(static_cast<uint32_t>(p - text));
+    }
+}
+
+LineIndex::Location LineIndex::locate(size_t offset) const
+{
+    offset = std::min(offset, m_size);
+    auto const next = std::upper_bound(m_starts.begin(), m_starts.end(), static_cast<uint32_t>(offset));
+    auto const line = static_cast<size_t>(next - m_starts.begin());
+    return Location{ static_cast<uint32_t>(line), static_cast<uint32_t>(offset - m_starts[line - 1] + 1) };
+}
+
+std::pair<char const*, char const*> LineIndex::line(uint32_t line) const
+{
+    auto const* begin = m_text + m_starts[line - 1];
+    auto const* end = line < m_starts.size() ? m_text + m_starts[line] - 1 : m_text + m_size;
+    if (end > begin && end[-1] == '\r')
+    {
+        --end;
+    }
+    return { begin, end };
+}
+
+void Diagnostics::error(size_t offset, size_t length, std::string message)
+{
+    if (m_reported++ < m_max_errors)
+    {
+        m_errors.push_back(Diagnostic{ offset, length, std::move(message) });
+    }
+}
+
+LineIndex const& Diagnostics::lines() const
+{
+    if (!m_lines)
+    {
+        m_lines = std::make_unique<LineIndex>(m_text, m_size);
+    }
+    return *m_lines;
+}
+
+void Diagnostics::render(std::string& out, char const* source_name) const
+{
+    for (auto const& d : m_errors)
+    {
+        auto const at = lines().locate(d.offset);
+        auto const text = lines().line(at.line);
+        out += std::string{ source_name } + ":" + std::to_string(at.line) + ":" + std::to_string(at.column) + ": error: " + d.message + "\n";
+        out += "    ";
+        out.append(text.first, text.second);
+        out += "\n    ";
+        // Keep tabs so the caret lines up however the terminal expands them
+        auto const* caret = text.first + at.column - 1;
+        for (auto const* p = text.first; p < caret && p < text.second; ++p)
+        {
+            out += *p == '\t' ? '\t' : ' ';
+        }
+        out += '^';
+        auto const underline = std::min(d.length, static_cast<size_t>(std::max<ptrdiff_t>(text.second - caret, 1)));
+        if (underline > 1)
+        {
+            out.append(underline - 1, '~');
+        }
+        out += '\n';
+    }
+    if (full())
+    {
+        out += std::string{ source_name } + ": too many errors, stopped after " + std::to_string(m_errors.size()) + "\n";
+    }
+}
+
+void Diagnostics::render(FILE* out, char const* source_name) const
+{
+    std::string text;
+    render(text, source_name);
+    std::fwrite(text.data(), 1, text.size(), out);
+}
+
+} // namespace ty
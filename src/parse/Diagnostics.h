@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ty
+{
+
+//! Start offset of every line of a source text, for mapping offsets to lines and columns
+//! in O(log lines) instead of rescanning the text from its start
+class LineIndex
+{
+public:
+    struct Location
+    {
+        uint32_t line;      //!< 1-based
+        uint32_t column;    //!< 1-based, in bytes
+    };
+
+    //! Scans 'text' once; it must outlive the index
+    LineIndex(char const* text, size_t size);
+
+    Location locate(size_t offset) const;
+
+    size_t line_count() const noexcept { return m_starts.size(); }
+
+    //! Text of 'line' (1-based), without its line break
+    std::pair<char const*, char const*> line(uint32_t line) const;
+
+private:
+    char const*             m_text;
+    size_t                  m_size;
+    std::vector<uint32_t>   m_starts;
+};
+
+struct Diagnostic
+{
+    size_t      offset;     //!< Into the source text
+    size_t      length;     //!< Bytes underlined; 0 points at 'offset' (e.g. the end of the file)
+    std::string message;
+};
+
+//! Errors of one compile, collected rather than thrown so a compile can report many of
+//! them, and rendered with the source line and a caret under the offending text.
+//! The line index is only built when the first error is located, so compiles without
+//! errors never scan the source for line breaks.
+class Diagnostics
+{
+public:
+    //! Errors beyond this many are counted but not kept; a parse stops once it has this many
+    static constexpr size_t default_max_errors = 32;
+
+    //! 'text' is the source the offsets refer to; it must outlive this object
+    Diagnostics(char const* text, size_t size, size_t max_errors = default_max_errors)
+        : m_text{ text }, m_size{ size }, m_max_errors{ max_errors }
+    {}
+
+    void error(size_t offset, size_t length, std::string message);
+
+    //! True once max_errors errors were reported; callers should stop looking for more
+    bool full() const noexcept { return m_reported >= m_max_errors; }
+
+    bool empty() const noexcept { return m_reported == 0; }
+
+    //! Number of errors reported, including the ones beyond max_errors
+    size_t count() const noexcept { return m_reported; }
+
+    std::vector<Diagnostic> const& errors() const noexcept { return m_errors; }
+
+    LineIndex const& lines() const;
+
+    //! Appends every kept error as
+    //!     <source_name>:<line>:<column>: error: <message>
+    //!         <source line>
+    //!              ^~~~
+    //! Each error costs O(log lines + its line's length), whatever the size of the source.
+    void render(std::string& out, char const* source_name) const;
+    void render(FILE* out, char const* source_name) const;
+
+private:
+    char const*                         m_text;
+    size_t                              m_size;
+    size_t                              m_max_errors;
+    size_t                              m_reported = 0;
+    std::vector<Diagnostic>             m_errors;
+    mutable std::unique_ptr<LineIndex>  m_lines;
+};
+
+} // namespace ty
@@ -1,18 +1,24 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <memory>
 #include <parse/Type.h>
+#include <token/StringInterner.h>
+#include <common/Arena.h>
 #include <cgen/Generator.h>
 #include <cppcoretools/print.h>
 
 namespace ty
 {
 
+//! Base of all AST nodes. Nodes are created in the Arena of the top-level
+//! ParseContext and are never destroyed individually, so they hold plain
+//! pointers to their children and ArenaVector for lists.
 class Expr
 {
 public:
-    explicit Expr(std::string id = "") : m_id{ std::move(id) } {}
+    explicit Expr(SymbolId id = invalid_symbol) : m_id{ id } {}
 
     virtual bool can_evaluate_at_compiletime() const noexcept { return false; }
 
@@ -23,50 +29,65 @@ public:
 
     //! Infers a type from the expression, if possible
     //! Returns null otherwise
-    virtual Type const* inferred_type() const noexcept { return m_inferred_type.get(); }
+    virtual Type const* inferred_type() const noexcept { return m_inferred_type; }
 
-    virtual Type const* specified_type() const noexcept { return m_specified_type.get(); }
+    virtual Type const* specified_type() const noexcept { return m_specified_type; }
 
-    auto const& id() const noexcept { return m_id; }
+    //! Interned name this expression is bound to, or invalid_symbol if it is anonymous
+    SymbolId id() const noexcept { return m_id; }
 
+    void set_id(SymbolId id) noexcept { m_id = id; }
+
+    //! Index in the TokenList of the token that introduced this expression (e.g. its name)
+    uint32_t token() const noexcept { return m_token; }
+
+    void set_token(uint32_t index) noexcept { m_token = index; }
 
 protected:
     
-    std::string m_id;
+    SymbolId m_id;
 
-    std::unique_ptr<Type>   m_specified_type;
+    uint32_t m_token = 0;
 
-    std::unique_ptr<Type>   m_inferred_type;
+    Type const*   m_specified_type = nullptr;
+
+    Type const*   m_inferred_type = nullptr;
 };
 
-using ExprList = std::vector<std::unique_ptr<Expr>>;
+using ExprList = ArenaVector<Expr*>;
 
 class Int32LiteralExpr : public Expr
 {
 public:
-    explicit Int32LiteralExpr(std::string expr_str)
+    //! 'expr_str' must outlive the node (i.e. live in the same Arena); 'type' comes from a TypeContext
+    Int32LiteralExpr(char const* expr_str, Type const* type)
         : Expr{}
-        , m_expr {std::move(expr_str)} 
+        , m_expr {expr_str} 
     {
-        m_inferred_type = std::make_unique<Int32Type>();
+        m_inferred_type = type;
     }
 
+    bool can_evaluate_at_compiletime() const noexcept override { return true; }
+
     void generate(Generator& g) const override { return g.generate(*this); }
 
     void print(cct::unique_file& log_file, int level) const override
     {
-        log_file.printf("%*c Int32LiteralExpr(%s) \n", level, '-', m_expr.c_str());
+        log_file.printf("%*c Int32LiteralExpr(%s) \n", level, '-', m_expr);
     }
 
+    //! Decimal text of the literal, with a leading '-' if it is negative
+    char const* text() const noexcept { return m_expr; }
+
 private:
-    std::string		m_expr;
+    char const*		m_expr;
 };
 
 class ReturnExpr : public Expr
 {
 public:
-    explicit ReturnExpr(std::unique_ptr<Expr> expr)
-        : m_sub_expr{ std::move(expr) } {}
+    explicit ReturnExpr(Expr* expr)
+        : m_sub_expr{ expr } {}
 
     void generate(Generator& g) const override { return g.generate(*this); }
 
@@ -75,21 +96,40 @@ public:
         log_file.printf("%*c ReturnExpr \n", level, '-');
         m_sub_expr->print(log_file, level + 1);
     }
+
+    Expr const* sub_expr() const noexcept { return m_sub_expr; }
 private:
-    std::unique_ptr<Expr>   m_sub_expr;
+    Expr*   m_sub_expr;
 };
 
+//! Use of a name, resolved through the SymbolTable
 class SymbolExpr : public Expr
 {
+public:
+    explicit SymbolExpr(SymbolId name)
+        : m_name{ name } {}
+
+    void generate(Generator& g) const override { return g.generate(*this); }
+
     void print(cct::unique_file& log_file, int level) const override
     {
-        log_file.printf("%*c ReturnExpr \n", level, '-');
+        log_file.printf("%*c SymbolExpr \n", level, '-');
     }
+
+    //! Name this expression refers to
+    SymbolId name() const noexcept { return m_name; }
+
+private:
+    SymbolId    m_name;
 };
 
 class BinaryOpExpr : public Expr
 {
-    bool can_evaluate_at_compiletime() const noexcept 
+public:
+    BinaryOpExpr(Expr* left, Expr* right)
+        : m_left{ left }, m_right{ right } {}
+
+    bool can_evaluate_at_compiletime() const noexcept override
     { 
         return m_left->can_evaluate_at_compiletime()
             && m_right->can_evaluate_at_compiletime(); 
@@ -97,24 +137,28 @@ class BinaryOpExpr : public Expr
 
     Type const* inferred_type() const noexcept override 
     {
+        // Types are canonical, so equal types are the same object
         auto l_type = m_left->inferred_type();
-        if (*l_type != *(m_right->inferred_type()))
-        {
-            return nullptr; // not valid
-        }
-        return l_type;
+        return l_type == m_right->inferred_type() ? l_type : nullptr;
     }
 
     void print(cct::unique_file& log_file, int level) const override
     {
-        log_file.printf("%*c BinaryOpExpr \n", level, '-');
+        log_file.printf("%*c %s \n", level, '-', op_name());
         m_left->print(log_file, level + 1);
         m_right->print(log_file, level + 1);
     }
 
+    Expr const* left() const noexcept { return m_left; }
+
+    Expr const* right() const noexcept { return m_right; }
+
+protected:
+    virtual char const* op_name() const noexcept { return "BinaryOpExpr"; }
+
 private:
-    std::unique_ptr<Expr> m_left;
-    std::unique_ptr<Expr> m_right;
+    Expr* m_left;
+    Expr* m_right;
 };
 
 class FunctionArgDeclExpr : public Expr
@@ -130,15 +174,31 @@ public:
     }
 };
 
+//! Call of the function bound to a name
 class FunctionCallExpr : public Expr
 {
+public:
+    FunctionCallExpr(SymbolId callee, ArenaVector<Expr*> arguments)
+        : m_callee{ callee }, m_arguments{ std::move(arguments) } {}
+
+    void generate(Generator& g) const override { return g.generate(*this); }
 
     void print(cct::unique_file& log_file, int level) const override
     {
-        log_file.printf("%*c functioncallexpr() \n", level, '-');
+        log_file.printf("%*c FunctionCallExpr() \n", level, '-');
+        for (auto const* a : m_arguments)
+        {
+            a->print(log_file, level + 1);
+        }
     }
+
+    SymbolId callee() const noexcept { return m_callee; }
+
+    ArenaVector<Expr*> const& arguments() const noexcept { return m_arguments; }
+
 private:
-    std::vector<std::unique_ptr<Expr>>	m_arguments;
+    SymbolId            m_callee;
+    ArenaVector<Expr*>	m_arguments;
 };
 
 struct ParseContext;
@@ -147,31 +207,90 @@ class FunctionDefnExpr : public Expr
 {
 public:
 
-    std::vector<std::unique_ptr<FunctionArgDeclExpr>>	m_arguments;
-    std::unique_ptr<ParseContext> m_body;
+    ArenaVector<FunctionArgDeclExpr*>	m_arguments;
+    ParseContext*                       m_body;
 
-    // ! Non-owning pointers to return expressions inside of m_body
-    std::vector<ReturnExpr*>                  m_returns;
+    // ! Return expressions inside of m_body
+    ArenaVector<ReturnExpr*>            m_returns;
 
     FunctionDefnExpr(decltype(m_arguments) args, decltype(m_body) body, decltype(m_returns) returns)
         : m_arguments{std::move(args)}, m_body{std::move(body)}, m_returns{std::move(returns)}
     {}
 
+    //! The canonical function type; every argument and the result are i32.
+    //! Looked up on first use, so parsing doesn't take the TypeContext lock per function,
+    //! and kept in the node afterwards.
+    Type const* inferred_type() const noexcept override { return function_type(); }
+
+    FunctionType const* function_type() const noexcept
+    {
+        auto const* type = m_type.load(std::memory_order_acquire);
+        if (!type)
+        {
+            // Threads racing here get the same hash-consed type, so either store is right
+            auto& types = Global<TypeContext>();
+            type = types.function(types.i32(), std::vector<Type const*>(m_arguments.size(), types.i32()));
+            m_type.store(type, std::memory_order_release);
+        }
+        return type;
+    }
+
     void print(cct::unique_file& log_file, int level) const override;
 
     void generate(Generator& g) const override { return g.generate(*this); }
+
+private:
+    mutable std::atomic<FunctionType const*>    m_type{ nullptr };
 };
 
 
+//! Definition of a value, e.g. 'x = {5}'
+class DataDefnExpr : public Expr
+{
+public:
+    explicit DataDefnExpr(Expr* value)
+        : m_value{ value } {}
+
+    void generate(Generator& g) const override { return g.generate(*this); }
+
+    void print(cct::unique_file& log_file, int level) const override
+    {
+        log_file.printf("%*c DataDefnExpr() \n", level, '-');
+        m_value->print(log_file, level + 1);
+    }
+
+    Expr const* value() const noexcept { return m_value; }
+
+private:
+    Expr*   m_value;
+};
+
 class MemberFunctionCallExpr : public Expr
 {
 private:
-    std::vector<std::unique_ptr<Expr>>	m_arguments;
+    ArenaVector<Expr*>	m_arguments;
 };
 
 class AddExpr : public BinaryOpExpr
 {
+public:
+    using BinaryOpExpr::BinaryOpExpr;
 
+    void generate(Generator& g) const override { return g.generate(*this); }
+
+protected:
+    char const* op_name() const noexcept override { return "AddExpr"; }
+};
+
+class SubExpr : public BinaryOpExpr
+{
+public:
+    using BinaryOpExpr::BinaryOpExpr;
+
+    void generate(Generator& g) const override { return g.generate(*this); }
+
+protected:
+    char const* op_name() const noexcept override { return "SubExpr"; }
 };
 
 } // namespace ty
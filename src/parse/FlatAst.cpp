@@ -0,0 +1,324 @@
+#include "FlatAst.h"
+
+#include <cstring>
+
+namespace ty
+{
+
+namespace
+{
+
+char const flat_ast_magic[8] = { 'T', 'Y', 'F', 'L', 'A', 'T', '0', '3' };
+
+//! Emits tree nodes in pre-order, using the Generator double dispatch of Expr
+class FlatAstBuilder : public Generator
+{
+public:
+    FlatAstBuilder(FlatAst& ast, StringInterner const* names)
+        : m_ast{ ast }, m_names{ names }
+    {}
+
+    void build(ParseContext const& ctx)
+    {
+        auto const root = add(FlatNodeKind::Module, invalid_symbol, 0);
+        with_children(root, [&]
+        {
+            for (auto const* e : ctx.exprs)
+            {
+                e->generate(*this);
+            }
+        });
+    }
+
+    void generate(FunctionDefnExpr const& expr) override
+    {
+        auto const i = add(FlatNodeKind::FunctionDefn, expr.id(), 0);
+        with_children(i, [&]
+        {
+            for (auto const* a : expr.m_arguments)
+            {
+                a->generate(*this);
+            }
+            for (auto const* e : expr.m_body->exprs)
+            {
+                e->generate(*this);
+            }
+        });
+    }
+
+    void generate(FunctionArgDeclExpr const& expr) override
+    {
+        with_children(add(FlatNodeKind::FunctionArgDecl, expr.id(), 0), [] {});
+    }
+
+    void generate(ReturnExpr const& expr) override
+    {
+        auto const i = add(FlatNodeKind::Return, expr.id(), 0);
+        with_children(i, [&] { expr.sub_expr()->generate(*this); });
+    }
+
+    void generate(Int32LiteralExpr const& expr) override
+    {
+        auto const text = add_string(expr.text(), std::strlen(expr.text()));
+        with_children(add(FlatNodeKind::Int32Literal, expr.id(), text), [] {});
+    }
+
+    void generate(DataDefnExpr const& expr) override
+    {
+        auto const i = add(FlatNodeKind::DataDefn, expr.id(), 0);
+        with_children(i, [&] { expr.value()->generate(*this); });
+    }
+
+    void generate(SymbolExpr const& expr) override
+    {
+        with_children(add(FlatNodeKind::Symbol, expr.name(), 0), [] {});
+    }
+
+    void generate(FunctionCallExpr const& expr) override
+    {
+        auto const i = add(FlatNodeKind::FunctionCall, expr.callee(), 0);
+        with_children(i, [&]
+        {
+            for (auto const* a : expr.arguments())
+            {
+                a->generate(*this);
+            }
+        });
+    }
+
+    void generate(AddExpr const& expr) override
+    {
+        add_binary(FlatNodeKind::Add, expr);
+    }
+
+    void generate(SubExpr const& expr) override
+    {
+        add_binary(FlatNodeKind::Sub, expr);
+    }
+
+    void generate(Expr const& expr) override
+    {
+        with_children(add(FlatNodeKind::Unknown, expr.id(), 0), [] {});
+    }
+
+private:
+    NodeIndex add(FlatNodeKind kind, SymbolId symbol, uint32_t data)
+    {
+        auto const index = static_cast<NodeIndex>(m_ast.nodes.size());
+        m_ast.nodes.push_back(FlatNode{ kind, {}, m_depth, symbol, 0, 0, index + 1, data });
+        if (m_siblings)
+        {
+            m_siblings->push_back(index);
+        }
+        if (symbol != invalid_symbol && m_names)
+        {
+            add_symbol_name(symbol);
+        }
+        return index;
+    }
+
+    void add_binary(FlatNodeKind kind, BinaryOpExpr const& expr)
+    {
+        auto const i = add(kind, expr.id(), 0);
+        with_children(i, [&]
+        {
+            expr.left()->generate(*this);
+            expr.right()->generate(*this);
+        });
+    }
+
+    //! Runs 'f', which emits the children of 'parent', then records their indices
+    template <typename F>
+    void with_children(NodeIndex parent, F f)
+    {
+        std::vector<NodeIndex> kids;
+        auto* const outer = m_siblings;
+        m_siblings = &kids;
+        ++m_depth;
+        f();
+        --m_depth;
+        m_siblings = outer;
+
+        auto& node = m_ast.nodes[parent];
+        node.first_child = static_cast<uint32_t>(m_ast.children.size());
+        node.child_count = static_cast<uint32_t>(kids.size());
+        node.subtree_end = static_cast<NodeIndex>(m_ast.nodes.size());
+        m_ast.children.insert(m_ast.children.end(), kids.begin(), kids.end());
+    }
+
+    uint32_t add_string(char const* s, size_t size)
+    {
+        auto const offset = static_cast<uint32_t>(m_ast.strings.size());
+        m_ast.strings.insert(m_ast.strings.end(), s, s + size);
+        m_ast.strings.push_back('\0');
+        return offset;
+    }
+
+    void add_symbol_name(SymbolId id)
+    {
+        if (m_ast.symbol_names.size() <= id)
+        {
+            m_ast.symbol_names.resize(id + 1, UINT32_MAX);
+        }
+        if (m_ast.symbol_names[id] == UINT32_MAX)
+        {
+            m_ast.symbol_names[id] = add_string(m_names->name(id), m_names->size(id));
+        }
+    }
+
+    FlatAst&                m_ast;
+    StringInterner const*   m_names;
+    std::vector<NodeIndex>* m_siblings = nullptr;
+    uint32_t                m_depth = 0;
+};
+
+struct FlatPrinter
+{
+    cct::unique_file& out;
+
+    void enter_module(FlatAst const&, NodeIndex) {}
+
+    void enter_function(FlatAst const& ast, NodeIndex i) { out.printf("%*c FunctionDefnExpr() \n", ast[i].depth, '-'); }
+
+    void leave_function(FlatAst const&, NodeIndex) {}
+
+    void enter_argument(FlatAst const& ast, NodeIndex i) { out.printf("%*c FunctionArgDeclExpr() \n", ast[i].depth, '-'); }
+
+    void enter_return(FlatAst const& ast, NodeIndex i) { out.printf("%*c ReturnExpr \n", ast[i].depth, '-'); }
+
+    void enter_int32_literal(FlatAst const& ast, NodeIndex i) { out.printf("%*c Int32LiteralExpr(%s) \n", ast[i].depth, '-', ast.text(i)); }
+
+    void enter_data(FlatAst const& ast, NodeIndex i) { out.printf("%*c DataDefnExpr() \n", ast[i].depth, '-'); }
+
+    void enter_symbol(FlatAst const& ast, NodeIndex i) { out.printf("%*c SymbolExpr \n", ast[i].depth, '-'); }
+
+    void enter_call(FlatAst const& ast, NodeIndex i) { out.printf("%*c FunctionCallExpr() \n", ast[i].depth, '-'); }
+
+    void enter_add(FlatAst const& ast, NodeIndex i) { out.printf("%*c AddExpr \n", ast[i].depth, '-'); }
+
+    void enter_sub(FlatAst const& ast, NodeIndex i) { out.printf("%*c SubExpr \n", ast[i].depth, '-'); }
+
+    void enter_unknown(FlatAst const& ast, NodeIndex i) { out.printf("%*c UnknownExpr \n", ast[i].depth, '-'); }
+};
+
+template <typename T>
+void append_array(std::vector<char>& out, std::vector<T> const& v)
+{
+    uint64_t const count = v.size();
+    auto const* c = reinterpret_cast<char const*>(&count);
+    out.insert(out.end(), c, c + sizeof(count));
+    auto const* d = reinterpret_cast<char const*>(v.data());
+    out.insert(out.end(), d, d + v.size() * sizeof(T));
+}
+
+template <typename T>
+void read_array(char const*& p, char const* end, std::vector<T>& v)
+{
+    uint64_t count;
+    if (size_t(end - p) < sizeof(count))
+    {
+        throw FlatAstException{};
+    }
+    std::memcpy(&count, p, sizeof(count));
+    p += sizeof(count);
+    if (count > size_t(end - p) / sizeof(T))
+    {
+        throw FlatAstException{};
+    }
+    v.resize(static_cast<size_t>(count));
+    std::memcpy(v.data(), p, v.size() * sizeof(T));
+    p += v.size() * sizeof(T);
+}
+
+} // namespace
+
+char const* to_string(FlatNodeKind kind)
+{
+    switch (kind)
+    {
+    case FlatNodeKind::Module: return "module";
+    case FlatNodeKind::FunctionDefn: return "function_defn";
+    case FlatNodeKind::FunctionArgDecl: return "function_arg_decl";
+    case FlatNodeKind::Return: return "return";
+    case FlatNodeKind::Int32Literal: return "int32_literal";
+    case FlatNodeKind::DataDefn: return "data_defn";
+    case FlatNodeKind::Symbol: return "symbol";
+    case FlatNodeKind::FunctionCall: return "function_call";
+    case FlatNodeKind::Add: return "add";
+    case FlatNodeKind::Sub: return "sub";
+    default: return "unknown";
+    }
+}
+
+FlatAst flatten(ParseContext const& ctx)
+{
+    FlatAst ast;
+    ast.nodes.reserve(ctx.node_count() + 1);
+    FlatAstBuilder{ ast, ctx.interner.get() }.build(ctx);
+    return ast;
+}
+
+void print(FlatAst const& ast, cct::unique_file& log_file)
+{
+    FlatPrinter printer{ log_file };
+    walk(ast, printer);
+}
+
+void FlatAst::serialize(std::vector<char>& out) const
+{
+    out.insert(out.end(), flat_ast_magic, flat_ast_magic + sizeof(flat_ast_magic));
+    append_array(out, nodes);
+    append_array(out, children);
+    append_array(out, strings);
+    append_array(out, symbol_names);
+}
+
+FlatAst FlatAst::deserialize(char const* data, size_t size)
+{
+    if (size < sizeof(flat_ast_magic) || std::memcmp(data, flat_ast_magic, sizeof(flat_ast_magic)) != 0)
+    {
+        throw FlatAstException{};
+    }
+
+    FlatAst ast;
+    auto const* p = data + sizeof(flat_ast_magic);
+    auto const* end = data + size;
+    read_array(p, end, ast.nodes);
+    read_array(p, end, ast.children);
+    read_array(p, end, ast.strings);
+    read_array(p, end, ast.symbol_names);
+
+    // Reject indices that would let a walk read out of bounds
+    auto const node_count = ast.nodes.size();
+    for (NodeIndex i = 0; i < node_count; ++i)
+    {
+        auto const& n = ast.nodes[i];
+        if (n.subtree_end <= i || n.subtree_end > node_count
+            || uint64_t(n.first_child) + n.child_count > ast.children.size()
+            || (n.kind == FlatNodeKind::Int32Literal && n.data >= ast.strings.size()))
+        {
+            throw FlatAstException{};
+        }
+    }
+    for (auto const c : ast.children)
+    {
+        if (c >= node_count)
+        {
+            throw FlatAstException{};
+        }
+    }
+    for (auto const offset : ast.symbol_names)
+    {
+        if (offset != UINT32_MAX && offset >= ast.strings.size())
+        {
+            throw FlatAstException{};
+        }
+    }
+    if (!ast.strings.empty() && ast.strings.back() != '\0')
+    {
+        throw FlatAstException{};
+    }
+    return ast;
+}
+
+} // namespace ty
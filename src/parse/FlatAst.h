@@ -0,0 +1,143 @@
+#pragma once
+
+#include "parse/Parse.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ty
+{
+
+//! Index of a node in FlatAst::nodes
+using NodeIndex = uint32_t;
+
+enum class FlatNodeKind : uint8_t
+{
+    Module,             //!< Root; children are the top-level definitions
+    FunctionDefn,       //!< Children are the argument declarations followed by the body
+    FunctionArgDecl,
+    Return,             //!< One child: the returned expression
+    Int32Literal,       //!< 'data' is the offset of the literal text in FlatAst::strings
+    DataDefn,           //!< One child: the value
+    Symbol,             //!< 'symbol' is the name referred to
+    FunctionCall,       //!< 'symbol' is the callee; children are the arguments
+    Add,                //!< Two children: left and right operand
+    Sub,                //!< Two children: left and right operand
+    Unknown             //!< Tree node kind the converter doesn't know about
+};
+
+char const* to_string(FlatNodeKind kind);
+
+struct FlatNode
+{
+    FlatNodeKind    kind;
+    uint8_t         reserved[3];
+    uint32_t        depth;          //!< 0 for the Module node; 32 bits as parse_iterative() accepts any nesting
+    SymbolId        symbol;         //!< Name bound to the node, or invalid_symbol
+    uint32_t        first_child;    //!< Offset of the first child in FlatAst::children
+    uint32_t        child_count;
+    NodeIndex       subtree_end;    //!< One past the last descendant
+    uint32_t        data;           //!< Kind-specific payload
+};
+
+static_assert(sizeof(FlatNode) == 28, "FlatNode is part of the serialized format");
+
+//! Data-oriented form of a parsed module.
+//! Nodes live in one array in pre-order, so walking it front to back visits parents
+//! before children without chasing pointers; children are also reachable directly
+//! through 32-bit indices. Every member is a flat array of PODs, so the whole AST
+//! serializes by copying the arrays.
+//! The backends consume the Expr tree through Generator; generate_serial(FlatAst) writes
+//! the same LLVM IR from the flat form with walk().
+class FlatAst
+{
+public:
+    static constexpr NodeIndex root = 0;
+
+    std::vector<FlatNode>   nodes;
+
+    //! Child node indices; node n's children are children[first_child, first_child + child_count)
+    std::vector<NodeIndex>  children;
+
+    //! Null-terminated literal texts and symbol names
+    std::vector<char>       strings;
+
+    //! Offset in 'strings' of each SymbolId's name, or UINT32_MAX if the symbol isn't used
+    std::vector<uint32_t>   symbol_names;
+
+    FlatNode const& operator[](NodeIndex i) const { return nodes[i]; }
+
+    NodeIndex child(NodeIndex n, uint32_t i) const { return children[nodes[n].first_child + i]; }
+
+    char const* text(NodeIndex n) const { return &strings[nodes[n].data]; }
+
+    //! Name of 'id', or "" if it has none
+    char const* name(SymbolId id) const
+    {
+        return id < symbol_names.size() && symbol_names[id] != UINT32_MAX ? &strings[symbol_names[id]] : "";
+    }
+
+    size_t size() const noexcept { return nodes.size(); }
+
+    //! Appends the binary form of the AST to 'out'
+    void serialize(std::vector<char>& out) const;
+
+    //! \throws FlatAstException if 'data' is not a serialized FlatAst
+    static FlatAst deserialize(char const* data, size_t size);
+};
+
+struct FlatAstException : public std::exception
+{
+    char const* what() const override
+    {
+        return "Malformed serialized FlatAst";
+    }
+};
+
+//! Converts a parsed module to its flat form. 'ctx' must be a top-level context.
+FlatAst flatten(ParseContext const& ctx);
+
+//! Visits every node in memory (pre-)order, switching on its kind.
+//! 'v' provides enter_<kind>(ast, index) for each kind and leave_function(ast, index),
+//! which is called once the last descendant of a FunctionDefn has been visited.
+template <typename Visitor>
+void walk(FlatAst const& ast, Visitor& v)
+{
+    // Open FunctionDefn nodes, innermost last
+    std::vector<NodeIndex> open;
+
+    auto const n = static_cast<NodeIndex>(ast.nodes.size());
+    for (NodeIndex i = 0; i < n; ++i)
+    {
+        while (!open.empty() && ast.nodes[open.back()].subtree_end <= i)
+        {
+            v.leave_function(ast, open.back());
+            open.pop_back();
+        }
+
+        switch (ast.nodes[i].kind)
+        {
+        case FlatNodeKind::Module: v.enter_module(ast, i); break;
+        case FlatNodeKind::FunctionDefn: v.enter_function(ast, i); open.push_back(i); break;
+        case FlatNodeKind::FunctionArgDecl: v.enter_argument(ast, i); break;
+        case FlatNodeKind::Return: v.enter_return(ast, i); break;
+        case FlatNodeKind::Int32Literal: v.enter_int32_literal(ast, i); break;
+        case FlatNodeKind::DataDefn: v.enter_data(ast, i); break;
+        case FlatNodeKind::Symbol: v.enter_symbol(ast, i); break;
+        case FlatNodeKind::FunctionCall: v.enter_call(ast, i); break;
+        case FlatNodeKind::Add: v.enter_add(ast, i); break;
+        case FlatNodeKind::Sub: v.enter_sub(ast, i); break;
+        default: v.enter_unknown(ast, i); break;
+        }
+    }
+    while (!open.empty())
+    {
+        v.leave_function(ast, open.back());
+        open.pop_back();
+    }
+}
+
+//! Prints the same tree as Expr::print, walking the flat form
+void print(FlatAst const& ast, cct::unique_file& log_file);
+
+} // namespace ty
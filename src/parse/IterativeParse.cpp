@@ -0,0 +1,302 @@
+#include "Parse.h"
+
+#include <vector>
+
+namespace ty
+{
+
+namespace
+{
+
+//! Parses definitions with the same grammar, node order and errors as the recursive
+//! functions of ParseContext, keeping what they would keep in stack frames on two stacks:
+//! one entry per function body being parsed, and one per '(' in the current expression.
+class IterativeParser
+{
+public:
+    //! Parses the definition whose '=' is at 'it' into 'ctx', like ParseContext::parse_statement()
+    ParseIndex statement(ParseContext& ctx, ParseIndex it)
+    {
+        m_current = &ctx;
+        try
+        {
+            while (1)
+            {
+                if (definition(it))
+                {
+                    it = finish();
+                    if (m_bodies.empty())
+                    {
+                        return it;
+                    }
+                }
+                else
+                {
+                    it = m_next;
+                }
+
+                // Inside a body: on to its next definition, closing the bodies that end first
+                while (1)
+                {
+                    while (it->type != LexItem::Type::DEFN && it->type != LexItem::Type::BRACE_CLOSE && it->type != LexItem::Type::eof)
+                    {
+                        ++it;
+                    }
+                    if (it->type == LexItem::Type::DEFN)
+                    {
+                        break;
+                    }
+                    if (it->type == LexItem::Type::eof)
+                    {
+                        throw ParseException(it, "Expected }");
+                    }
+                    close_body(it);
+                    it = finish();
+                    if (m_bodies.empty())
+                    {
+                        return it;
+                    }
+                }
+            }
+        }
+        catch (...)
+        {
+            // What the recursive parser's SymbolTable::Scope objects do while unwinding
+            for (size_t i = 0; i < m_bodies.size(); ++i)
+            {
+                m_current->symbols->pop_scope();
+            }
+            m_bodies.clear();
+            throw;
+        }
+    }
+
+private:
+    //! A block-bodied function whose body is being parsed
+    struct Body
+    {
+        ParseContext*                       outer;      //!< Context the function is defined in
+        ParseIndex                          name;       //!< ID token before the function's '='
+        ArenaVector<FunctionArgDeclExpr*>   arguments;
+        ParseContext*                       body;
+    };
+
+    //! An expression being parsed: the left operand so far and the operator after it
+    struct Operand
+    {
+        Expr*       lhs;
+        ParseIndex  op;
+    };
+
+    //! Parses the definition at '=' token 'it', as ParseContext::parse_definition() does.
+    //! \returns true with the definition in m_expr and the index following it in m_next,
+    //!          or false after opening a block body that starts at m_next
+    bool definition(ParseIndex it)
+    {
+        auto& arena = *m_current->arena;
+        if (it.index() == 0)
+        {
+            throw ParseException(it, "Expected ID before '=' token");
+        }
+        m_name = it - 1;
+        if (m_name->type != LexItem::Type::ID)
+        {
+            throw ParseException(m_name, "Expected ID before '=' token");
+        }
+        it = it + 1;
+        if (it->type == LexItem::Type::BRACE_OPEN)
+        {
+            auto value = braced_expression(it + 1);
+            m_expr = arena.create<DataDefnExpr>(value.first);
+            m_expr->set_id(m_name->symbol);
+            m_next = value.second;
+            return true;
+        }
+        if (it->type != LexItem::Type::param)
+        {
+            throw ParseException(it, "Expected function or value definition");
+        }
+
+        // Same header loop as ParseContext::parse_function()
+        ArenaVector<FunctionArgDeclExpr*> arguments{ &arena };
+        auto single_item = false;
+        while (it->type != LexItem::Type::eof)
+        {
+            if (it->type == LexItem::Type::param)
+            {
+                ++it;
+            }
+            else if (it->type == LexItem::Type::PAREN_OPEN)
+            {
+                auto decls = parse_argument_decls(arena, it + 1);
+                arguments = std::move(decls.first);
+                it = decls.second;
+            }
+            else if (it->type == LexItem::Type::ARROW)
+            {
+                single_item = true;
+                ++it;
+            }
+            else if (it->type == LexItem::Type::BRACE_OPEN)
+            {
+                if (!single_item)
+                {
+                    auto* body = arena.create<ParseContext>(&arena, m_current->symbols);
+                    body->begin = it + 1;
+                    m_bodies.push_back(Body{ m_current, m_name, std::move(arguments), body });
+                    m_current->symbols->push_scope();
+                    m_current = body;
+                    m_next = it + 1;
+                    return false;
+                }
+                auto* body = arena.create<ParseContext>(&arena, m_current->symbols);
+                auto value = braced_expression(it + 1);
+                auto* ret = arena.create<ReturnExpr>(value.first);
+                ArenaVector<ReturnExpr*> returns{ &arena };
+                returns.emplace_back(ret);
+                body->exprs.emplace_back(ret);
+                m_expr = arena.create<FunctionDefnExpr>(std::move(arguments), body, std::move(returns));
+                m_expr->set_id(m_name->symbol);
+                m_next = value.second;
+                return true;
+            }
+            else
+            {
+                throw ParseException(it, "Expected (, -> or { in function definition");
+            }
+        }
+        throw ParseException(it, "Expected function body");
+    }
+
+    //! Ends the innermost body at its '}' and makes its function the pending definition
+    void close_body(ParseIndex it)
+    {
+        auto& b = m_bodies.back();
+        b.body->end = it;
+        m_current->symbols->pop_scope();
+        auto& arena = *b.outer->arena;
+        m_expr = arena.create<FunctionDefnExpr>(std::move(b.arguments), b.body, ArenaVector<ReturnExpr*>{ &arena });
+        m_name = b.name;
+        m_expr->set_id(m_name->symbol);
+        m_next = it + 1;
+        m_current = b.outer;
+        m_bodies.pop_back();
+    }
+
+    //! Binds the pending definition in the current context, as ParseContext::parse_statement() does
+    ParseIndex finish()
+    {
+        m_expr->set_token(static_cast<uint32_t>(m_name.index()));
+        if (m_current->symbols->expr_at(m_expr->id()))
+        {
+            throw ParseException(m_name, "Duplicate definition");
+        }
+        m_current->symbols->add_expr(m_expr->id(), m_expr);
+        m_current->exprs.emplace_back(m_expr);
+        return m_next;
+    }
+
+    //! parse_braced_expression() with parenthesized expressions on m_operands
+    Parsed<Expr> braced_expression(ParseIndex it)
+    {
+        auto e = expression(it);
+        if (e.second->type != LexItem::Type::BRACE_CLOSE)
+        {
+            throw ParseException(e.second, "Expected }");
+        }
+        return Parsed<Expr>{ e.first, e.second + 1 };
+    }
+
+    Parsed<Expr> expression(ParseIndex it)
+    {
+        auto& arena = *m_current->arena;
+        m_operands.clear();
+        m_operands.push_back(Operand{ nullptr, it });
+        while (1)
+        {
+            while (it->type == LexItem::Type::PAREN_OPEN)
+            {
+                m_operands.push_back(Operand{ nullptr, it });
+                ++it;
+            }
+            // Not a '(', so parse_primary() doesn't recurse
+            auto primary = parse_primary(arena, it);
+            auto* e = primary.first;
+            it = primary.second;
+            while (1)
+            {
+                auto& top = m_operands.back();
+                if (top.lhs)
+                {
+                    e = top.op->type == LexItem::Type::PLUS
+                        ? static_cast<Expr*>(arena.create<AddExpr>(top.lhs, e))
+                        : static_cast<Expr*>(arena.create<SubExpr>(top.lhs, e));
+                    e->set_token(static_cast<uint32_t>(top.op.index()));
+                }
+                if (it->type == LexItem::Type::PLUS || it->type == LexItem::Type::MINUS)
+                {
+                    top.lhs = e;
+                    top.op = it;
+                    ++it;
+                    break;
+                }
+                if (m_operands.size() == 1)
+                {
+                    return Parsed<Expr>{ e, it };
+                }
+                if (it->type != LexItem::Type::PAREN_CLOSE)
+                {
+                    throw ParseException(it, "Expected )");
+                }
+                // 'e' is the parenthesized primary of the enclosing expression
+                ++it;
+                m_operands.pop_back();
+            }
+        }
+    }
+
+    ParseContext*       m_current = nullptr;    //!< Context definitions are added to
+    std::vector<Body>   m_bodies;
+    std::vector<Operand> m_operands;
+
+    // Pending definition, bound by finish()
+    Expr*               m_expr = nullptr;
+    ParseIndex          m_name;
+    ParseIndex          m_next;
+};
+
+} // namespace
+
+ParseIndex parse_statement_iterative(ParseContext& ctx, ParseIndex it)
+{
+    IterativeParser parser;
+    return parser.statement(ctx, it);
+}
+
+ParseContext parse_iterative(TokenList const& tlist)
+{
+    auto arena = std::make_shared<Arena>();
+    ParseContext ctx{ arena.get(), arena->create<SymbolTable>(arena.get()) };
+    ctx.begin = tlist.begin();
+
+    IterativeParser parser;
+    auto it = tlist.begin();
+    while (it != tlist.end() && it->type != LexItem::Type::eof)
+    {
+        if (it->type == LexItem::Type::DEFN)
+        {
+            it = parser.statement(ctx, it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    ctx.end = it;
+
+    ctx.owned_arena = std::move(arena);
+    ctx.interner = tlist.interner();
+    return ctx;
+}
+
+} // namespace ty
@@ -0,0 +1,168 @@
+#include "Parse.h"
+
+namespace ty
+{
+
+namespace
+{
+
+//! Collects the indices of '=' tokens at brace depth 0.
+//! \returns false if the braces don't balance, in which case the boundaries can't be trusted
+bool find_top_level_definitions(TokenList const& tlist, std::vector<uint32_t>& defns)
+{
+    int depth = 0;
+    auto const n = tlist.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        switch (tlist.kind(i))
+        {
+        case LexItem::Type::BRACE_OPEN: ++depth; break;
+        case LexItem::Type::BRACE_CLOSE: if (--depth < 0) { return false; } break;
+        case LexItem::Type::DEFN: if (depth == 0) { defns.push_back(static_cast<uint32_t>(i)); } break;
+        default: break;
+        }
+    }
+    return depth == 0;
+}
+
+//! Returns true if the serial parser would start a definition in [begin, end)
+bool has_definition(TokenList const& tlist, size_t begin, size_t end)
+{
+    for (auto i = begin; i < end; ++i)
+    {
+        if (tlist.kind(i) == LexItem::Type::DEFN)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! Returns true if a definition nested in 'defn' reuses a name visible in 'table'.
+//! Workers can't see the module's names, so such a clash is found while merging instead.
+bool binds_visible_name(Expr const* defn, SymbolTable const& table)
+{
+    auto const* fn = dynamic_cast<FunctionDefnExpr const*>(defn);
+    if (!fn || !fn->m_body)
+    {
+        return false;
+    }
+    for (auto const* e : fn->m_body->exprs)
+    {
+        if ((e->id() != invalid_symbol && table.expr_at(e->id())) || binds_visible_name(e, table))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ParsedDefinition
+{
+    Expr*               expr = nullptr;
+    uint32_t            next = 0;       //!< Token index following the definition
+    std::exception_ptr  error;
+};
+
+} // namespace
+
+ParseContext parse_parallel(TokenList const& tlist, ThreadPool& pool)
+{
+    std::vector<uint32_t> defns;
+    if (!find_top_level_definitions(tlist, defns) || defns.size() < min_parallel_definitions)
+    {
+        return parse_serial(tlist);
+    }
+
+    // Each worker thread allocates from its own arena and binds nested names in its own table
+    std::vector<std::shared_ptr<Arena>> arenas;
+    std::vector<ParseContext*> scratch;
+    for (unsigned i = 0; i < pool.concurrency(); ++i)
+    {
+        arenas.push_back(std::make_shared<Arena>());
+        auto* a = arenas.back().get();
+        scratch.push_back(a->create<ParseContext>(a, a->create<SymbolTable>(a)));
+    }
+
+    std::vector<ParsedDefinition> results(defns.size());
+    pool.parallel_for(defns.size(), [&](size_t k, unsigned worker)
+    {
+        auto const defn = tlist.begin() + defns[k];
+        if (defns[k] == 0 || (defn - 1)->type != LexItem::Type::ID)
+        {
+            return; // reported while merging, in source order
+        }
+
+        auto& r = results[k];
+        try
+        {
+            auto parsed = scratch[worker]->parse_definition((defn - 1)->symbol, defn + 1);
+            r.expr = parsed.first;
+            r.next = static_cast<uint32_t>(parsed.second.index());
+        }
+        catch (...)
+        {
+            r.error = std::current_exception();
+        }
+    });
+
+    auto arena = std::make_shared<Arena>();
+    ParseContext ctx{ arena.get(), arena->create<SymbolTable>(arena.get()) };
+    ctx.begin = tlist.begin();
+    ctx.exprs.reserve(defns.size());
+
+    // Merge in source order, replaying exactly the checks parse_statements makes
+    size_t pos = 0;
+    for (size_t k = 0; k < defns.size(); ++k)
+    {
+        if (pos > defns[k] || has_definition(tlist, pos, defns[k]))
+        {
+            // The previous definition overran this one, or the serial loop would
+            // have started a definition the brace scan didn't see
+            return parse_serial(tlist);
+        }
+
+        auto const prev = tlist.begin() + (defns[k] == 0 ? 0 : defns[k] - 1);
+        if (defns[k] == 0 || prev->type != LexItem::Type::ID)
+        {
+            throw ParseException(prev, "Expected ID before '=' token");
+        }
+
+        // Replay the definition on the module's table if the worker failed or missed a
+        // clash with a module name, so the error reported is the one the serial parser finds
+        auto r = results[k];
+        if (r.error || binds_visible_name(r.expr, *ctx.symbols))
+        {
+            auto parsed = ctx.parse_definition(prev->symbol, tlist.begin() + defns[k] + 1);
+            r.expr = parsed.first;
+            r.next = static_cast<uint32_t>(parsed.second.index());
+        }
+
+        r.expr->set_token(static_cast<uint32_t>(prev.index()));
+        if (ctx.symbols->expr_at(r.expr->id()))
+        {
+            throw ParseException(prev, "Duplicate definition");
+        }
+        ctx.symbols->add_expr(r.expr->id(), r.expr);
+        ctx.exprs.emplace_back(r.expr);
+        pos = r.next;
+    }
+
+    auto end = tlist.begin() + pos;
+    while (end != tlist.end() && end->type != LexItem::Type::eof)
+    {
+        if (end->type == LexItem::Type::DEFN)
+        {
+            return parse_serial(tlist);
+        }
+        ++end;
+    }
+    ctx.end = end;
+
+    ctx.owned_arena = std::move(arena);
+    ctx.worker_arenas = std::move(arenas);
+    ctx.interner = tlist.interner();
+    return ctx;
+}
+
+} // namespace ty
@@ -2,7 +2,10 @@
 
 #include "token/TokenList.h"
 #include "parse/Expr.h"
+#include "parse/Diagnostics.h"
 #include "SymbolTable.h"
+#include "common/ThreadPool.h"
+#include <cstring>
 #include <string>
 #include <utility>
 
@@ -12,21 +15,22 @@ namespace ty
 using ParseIndex = TokenList::const_iterator;
 
 template <typename T>
-using Parsed = std::pair<std::unique_ptr<T>, ParseIndex>;
+using Parsed = std::pair<T*, ParseIndex>;
 
 template <typename T>
-using ParsedList = std::pair<std::vector<std::unique_ptr<T>>, ParseIndex>;
+using ParsedList = std::pair<ArenaVector<T*>, ParseIndex>;
 
+//! Creates a node in 'arena' and pairs it with the index following it
 template <typename T, typename... Args>
-auto MakeParsed(ParseIndex next, Args&&... args)
+auto MakeParsed(Arena& arena, ParseIndex next, Args&&... args)
 {
-    return std::make_pair(std::make_unique<T>(std::forward<Args>(args)...), next);
+    return std::make_pair(arena.create<T>(std::forward<Args>(args)...), next);
 }
 
 template <typename T, typename... Args>
-auto MakeParsedList(ParseIndex next, Args&&... args)
+auto MakeParsedList(Arena& arena, ParseIndex next, Args&&... args)
 {
-    return std::pair<std::vector<std::unique_ptr<T>>, ParseIndex>{std::forward<Args>(args)..., next};
+    return ParsedList<T>{ArenaVector<T*>{std::forward<Args>(args)..., ArenaAllocator<T*>{ &arena }}, next};
 }
 
 
@@ -44,9 +48,9 @@ public:
     std::string	m_message;
 };
 
-inline ParsedList<FunctionArgDeclExpr> parse_argument_decls(ParseIndex it_begin)
+inline ParsedList<FunctionArgDeclExpr> parse_argument_decls(Arena& arena, ParseIndex it_begin)
 {
-    std::vector<std::unique_ptr<FunctionArgDeclExpr>> arg_decl;
+    ArenaVector<FunctionArgDeclExpr*> arg_decl{ &arena };
 
     auto it = it_begin;
     while (1)
@@ -61,39 +65,148 @@ inline ParsedList<FunctionArgDeclExpr> parse_argument_decls(ParseIndex it_begin)
             throw ParseException(it, "Expected , or ) after function argument declaration");
         }
     }
-    return MakeParsedList<FunctionArgDeclExpr>(it, std::move(arg_decl));
+    return MakeParsedList<FunctionArgDeclExpr>(arena, it, std::move(arg_decl));
 }
 
-inline Parsed<ReturnExpr> parse_return_expr(ParseIndex it_begin)
-{
+inline Parsed<Expr> parse_expression(Arena& arena, ParseIndex it_begin);
 
-    for (auto it = it_begin; ; it++)
+//! primary := NUM | '-' NUM | ID | ID '(' ')' | '(' expression ')'
+inline Parsed<Expr> parse_primary(Arena& arena, ParseIndex it)
+{
+    auto const at = static_cast<uint32_t>(it.index());
+    if (it->type == LexItem::Type::NUM
+        || (it->type == LexItem::Type::MINUS && (it + 1)->type == LexItem::Type::NUM))
+    {
+        // A negated literal is one literal, so the most negative value stays in range
+        auto const negative = it->type == LexItem::Type::MINUS;
+        auto const digits = *(negative ? it + 1 : it);
+        auto const size = static_cast<size_t>(digits.end - digits.begin);
+        auto* text = static_cast<char*>(arena.allocate(size + negative + 1, 1));
+        text[0] = '-';
+        std::memcpy(text + negative, digits.begin, size);
+        text[size + negative] = '\0';
+        auto lit = MakeParsed<Int32LiteralExpr>(arena, it + 1 + negative, text, Global<TypeContext>().i32());
+        lit.first->set_token(at);
+        return lit;
+    }
+    if (it->type == LexItem::Type::ID)
     {
-        if (it->type == LexItem::Type::NUM)
+        auto const name = it->symbol;
+        if ((it + 1)->type != LexItem::Type::PAREN_OPEN)
         {
-            auto s = std::make_unique<Int32LiteralExpr>(it->as_lexeme());
-            it++;
-            if (it->type != LexItem::Type::BRACE_CLOSE)
-            {
-                throw ParseException(it, "Expected }");
-            }
-            return MakeParsed<ReturnExpr>(it + 1, std::move(s));
+            auto sym = MakeParsed<SymbolExpr>(arena, it + 1, name);
+            sym.first->set_token(at);
+            return sym;
         }
+        if ((it + 2)->type != LexItem::Type::PAREN_CLOSE)
+        {
+            throw ParseException(it + 2, "Expected ) after function call");
+        }
+        auto call = MakeParsed<FunctionCallExpr>(arena, it + 3, name, ArenaVector<Expr*>{ &arena });
+        call.first->set_token(at);
+        return call;
+    }
+    if (it->type == LexItem::Type::PAREN_OPEN)
+    {
+        auto inner = parse_expression(arena, it + 1);
+        if (inner.second->type != LexItem::Type::PAREN_CLOSE)
+        {
+            throw ParseException(inner.second, "Expected )");
+        }
+        return Parsed<Expr>{ inner.first, inner.second + 1 };
+    }
+    throw ParseException(it, "Expected expression");
+}
+
+//! expression := primary (('+' | '-') primary)*, left-associative
+inline Parsed<Expr> parse_expression(Arena& arena, ParseIndex it_begin)
+{
+    auto lhs = parse_primary(arena, it_begin);
+    while (lhs.second->type == LexItem::Type::PLUS || lhs.second->type == LexItem::Type::MINUS)
+    {
+        auto const op = lhs.second;
+        auto rhs = parse_primary(arena, op + 1);
+        Expr* e = op->type == LexItem::Type::PLUS
+            ? static_cast<Expr*>(arena.create<AddExpr>(lhs.first, rhs.first))
+            : static_cast<Expr*>(arena.create<SubExpr>(lhs.first, rhs.first));
+        e->set_token(static_cast<uint32_t>(op.index()));
+        lhs = Parsed<Expr>{ e, rhs.second };
+    }
+    return lhs;
+}
+
+//! Parses 'expression }', the body of a single-item function or of a value definition
+//! \returns the expression and the index following the '}'
+inline Parsed<Expr> parse_braced_expression(Arena& arena, ParseIndex it_begin)
+{
+    auto e = parse_expression(arena, it_begin);
+    if (e.second->type != LexItem::Type::BRACE_CLOSE)
+    {
+        throw ParseException(e.second, "Expected }");
     }
-    return MakeParsed<ReturnExpr>(it_begin, nullptr);
+    return Parsed<Expr>{ e.first, e.second + 1 };
+}
+
+inline Parsed<ReturnExpr> parse_return_expr(Arena& arena, ParseIndex it_begin)
+{
+    auto e = parse_braced_expression(arena, it_begin);
+    return MakeParsed<ReturnExpr>(arena, e.second, e.first);
 }
 
 struct ParseContext
 {
+    //! Owns every node of the tree, including nested contexts; only set on the top-level
+    //! context. Declared first so it is released last, in one step.
+    std::shared_ptr<Arena>              owned_arena;
+
+    //! Arenas of parse_parallel() workers, owned alongside owned_arena
+    std::vector<std::shared_ptr<Arena>> worker_arenas;
+
+    //! Arena this context's containers and nodes are allocated from
+    Arena*                              arena;
+
     ParseIndex                          begin;
     ParseIndex                          end;
-    SymbolTable                         symbols;
+
+    //! Table shared by every context of one compilation. Nested contexts bind their
+    //! definitions in a scope that is closed once they are parsed, so afterwards it
+    //! holds just the top-level definitions.
+    SymbolTable*                        symbols;
     ExprList                            exprs;
 
+    //! Names of every SymbolId in the tree; only set on the top-level context
+    std::shared_ptr<StringInterner const> interner;
+
+    explicit ParseContext(Arena* a = nullptr, SymbolTable* table = nullptr)
+        : arena{ a }, symbols{ table }, exprs{ ArenaAllocator<Expr*>{ a } }
+    {}
+
+    //! Number of objects (nodes, nested contexts, types) allocated for this compile
+    size_t node_count() const noexcept
+    {
+        auto n = arena ? arena->object_count() : 0;
+        for (auto const& a : worker_arenas)
+        {
+            n += a->object_count();
+        }
+        return n;
+    }
+
+    //! Bytes allocated for this compile's tree, including container storage
+    size_t allocated_bytes() const noexcept
+    {
+        auto n = arena ? arena->bytes_allocated() : 0;
+        for (auto const& a : worker_arenas)
+        {
+            n += a->bytes_allocated();
+        }
+        return n;
+    }
+
     template <typename ExitPredicate>
-    static ParseContext parse_statements(ParseIndex it_begin, ExitPredicate finished)
+    static ParseContext parse_statements(Arena& arena, SymbolTable& table, ParseIndex it_begin, ExitPredicate finished)
     {
-        ParseContext ctx;
+        ParseContext ctx{ &arena, &table };
 
         ctx.begin = it_begin;
 
@@ -102,15 +215,7 @@ struct ParseContext
         {
             if (it->type == LexItem::Type::DEFN)
             {
-                auto const prev = it - 1;
-                if (prev->type != LexItem::Type::ID)
-                {
-                    throw ParseException(prev, "Expected ID before '=' token");
-                }
-                auto expr = ctx.parse_definition(std::string{ prev->begin, prev->end }, it + 1);
-                ctx.symbols.add_expr(expr.first->id(), expr.first.get());
-                ctx.exprs.emplace_back(std::move(expr.first));
-                it = expr.second;
+                it = ctx.parse_statement(it);
             }
             else
             {
@@ -121,21 +226,45 @@ struct ParseContext
         return ctx;
     }
 
+    //! Parses the definition whose '=' is at 'it', binds it in the innermost scope and appends it to exprs
+    //! \returns the index following the definition
+    ParseIndex parse_statement(ParseIndex it)
+    {
+        if (it.index() == 0)
+        {
+            throw ParseException(it, "Expected ID before '=' token");
+        }
+        auto const prev = it - 1;
+        if (prev->type != LexItem::Type::ID)
+        {
+            throw ParseException(prev, "Expected ID before '=' token");
+        }
+        auto expr = parse_definition(prev->symbol, it + 1);
+        expr.first->set_token(static_cast<uint32_t>(prev.index()));
+        if (symbols->expr_at(expr.first->id()))
+        {
+            throw ParseException(prev, "Duplicate definition");
+        }
+        symbols->add_expr(expr.first->id(), expr.first);
+        exprs.emplace_back(expr.first);
+        return expr.second;
+    }
+
+    //! Parses a nested block in a new scope of this context's table
     template <typename ExitPredicate>
     ParseContext parse_statements_local(ParseIndex it_begin, ExitPredicate finished)
     {
-        auto ctx = ParseContext::parse_statements(it_begin, std::move(finished));
-        ctx.symbols.set_parent(&symbols);
-        return ctx;
+        SymbolTable::Scope scope{ *symbols };
+        return ParseContext::parse_statements(*arena, *symbols, it_begin, std::move(finished));
     }
 
     inline Parsed<Expr> parse_function(ParseIndex it_begin)
     {
-        std::vector<std::unique_ptr<FunctionArgDeclExpr>> argument_decls;
-        std::unique_ptr<ParseContext> body;
+        ArenaVector<FunctionArgDeclExpr*> argument_decls{ arena };
+        ParseContext* body = nullptr;
 
-        // ! Non-owning pointers to return expressions inside of m_body
-        std::vector<ReturnExpr*>                  returns;
+        // ! Return expressions inside of m_body
+        ArenaVector<ReturnExpr*>          returns{ arena };
 
         bool single_item = false;
         bool done = false;
@@ -157,7 +286,7 @@ struct ParseContext
                 {
                     throw ParseException(it, "Unexpected character (");
                 }
-                auto arg_decls = parse_argument_decls(it + 1);
+                auto arg_decls = parse_argument_decls(*arena, it + 1);
                 argument_decls = std::move(arg_decls.first);
                 it = arg_decls.second;
             }
@@ -170,72 +299,247 @@ struct ParseContext
             {
                 if (single_item)
                 {
-                    body = std::make_unique<ParseContext>();
+                    body = arena->create<ParseContext>(arena, symbols);
 
-                    auto r = parse_return_expr(it + 1);
-                    returns.emplace_back(r.first.get());
-                    body->exprs.emplace_back(std::move(r.first));
+                    auto r = parse_return_expr(*arena, it + 1);
+                    returns.emplace_back(r.first);
+                    body->exprs.emplace_back(r.first);
                     it = r.second;
+                    break;
                 }
                 else
                 {
-                    auto stmts = it;
-                    while(1)
+                    body = arena->create<ParseContext>(parse_statements_local(it + 1, [](ParseIndex i)
                     {
-                        body = std::make_unique<ParseContext>(parse_statements_local(it, [](ParseIndex i) { return i->type != LexItem::Type::BRACE_CLOSE; }));
-                        stmts = body->end;
-                        if (stmts->type == LexItem::Type::BRACE_CLOSE)
-                        {
-                            it = stmts + 1;
-                            break;
-                        }
+                        return i->type == LexItem::Type::BRACE_CLOSE || i->type == LexItem::Type::eof;
+                    }));
+                    if (body->end->type != LexItem::Type::BRACE_CLOSE)
+                    {
+                        throw ParseException(body->end, "Expected }");
                     }
+                    it = body->end + 1;
+                    break;
                 }
             }
+            else
+            {
+                throw ParseException(it, "Expected (, -> or { in function definition");
+            }
         }
-        return MakeParsed<FunctionDefnExpr>(it, std::move(argument_decls), std::move(body), std::move(returns));
+        if (!body)
+        {
+            throw ParseException(it, "Expected function body");
+        }
+        return MakeParsed<FunctionDefnExpr>(*arena, it, std::move(argument_decls), body, std::move(returns));
     }
 
-    inline Parsed<Expr> parse_definition(std::string name, ParseIndex it)
+    inline Parsed<Expr> parse_definition(SymbolId name, ParseIndex it)
     {
         if (it->type == LexItem::Type::param)
         {
-            return parse_function(it);
+            auto fn = parse_function(it);
+            fn.first->set_id(name);
+            return fn;
+        }
+        if (it->type == LexItem::Type::BRACE_OPEN)
+        {
+            auto value = parse_braced_expression(*arena, it + 1);
+            auto data = MakeParsed<DataDefnExpr>(*arena, value.second, value.first);
+            data.first->set_id(name);
+            return data;
         }
-        throw ParseException(it, "Expected function definition");
+        throw ParseException(it, "Expected function or value definition");
     }
 
 };
 
-inline auto parse(TokenList const& tlist)
+enum class ParseMode
+{
+    serial,     //!< parse_serial()
+    parallel,   //!< parse_parallel() on Global<ThreadPool>()
+    iterative   //!< parse_iterative()
+};
+
+//! Process-wide parser configuration
+struct ParseSettings : public TyObject<Attribute::HasGlobal>
+{
+    ParseMode mode = ParseMode::serial;
+};
+
+//! Parses every top-level definition in order
+//! \throws ParseException on the first error
+inline ParseContext parse_serial(TokenList const& tlist)
+{
+    auto arena = std::make_shared<Arena>();
+    auto ctx = ParseContext::parse_statements(*arena, *arena->create<SymbolTable>(arena.get()), tlist.begin(), [&](ParseIndex i) { return i == tlist.end() || i->type == LexItem::Type::eof; });
+    ctx.owned_arena = std::move(arena);
+    ctx.interner = tlist.interner();
+    return ctx;
+}
+
+//! Parses top-level definitions concurrently on 'pool' and merges them in source order.
+//! Produces the same tree, and throws the same ParseException, as parse_serial().
+ParseContext parse_parallel(TokenList const& tlist, ThreadPool& pool);
+
+//! Parses like parse_serial(), but keeps the nesting of function bodies and parentheses on
+//! heap-allocated stacks instead of the call stack, so machine-generated input nested
+//! thousands of levels deep can't overflow it; memory grows with the nesting depth.
+//! Produces the same tree, and throws the same ParseException, as parse_serial().
+ParseContext parse_iterative(TokenList const& tlist);
+
+//! ParseContext::parse_statement() without recursion, see parse_iterative()
+ParseIndex parse_statement_iterative(ParseContext& ctx, ParseIndex it);
+
+struct ReparseStats
 {
-    try
+    size_t reparsed = 0;    //!< Top-level definitions parsed again
+    size_t reused = 0;      //!< Top-level definitions kept from the previous tree
+};
+
+//! Brings 'ctx', the tree of 'tlist' before relex() edited it, up to date with 'tlist'.
+//! Only the top-level definitions whose tokens 'edit' touched are parsed again, starting
+//! with the one enclosing edit.first and stopping at the first old definition boundary
+//! after the edit. Every other FunctionDefnExpr subtree and SymbolTable entry is kept, so
+//! the parsing done grows with the size of the edit rather than of the file. The nodes of
+//! kept definitions after the edit still have their token indices moved, so diagnostics
+//! point where a fresh parse would; that is a pass over those nodes, without parsing. Replaced nodes
+//! stay in ctx's arena until ctx is released, so memory grows with the number of edits;
+//! long-lived callers parse from scratch now and then (see CompileServer::max_incremental_edits).
+//! A context from a failed parse() is rebuilt.
+//! \throws ParseException as parse_serial(tlist) would; 'ctx' is left unchanged
+ReparseStats reparse(ParseContext& ctx, TokenList const& tlist, TokenEdit const& edit);
+
+//! Reports 'e' to 'diagnostics', underlining the token it was thrown at
+inline void report(Diagnostics& diagnostics, TokenList const& tlist, ParseException const& e)
+{
+    auto const i = e.m_position.index();
+    diagnostics.error(tlist.offset(i), tlist.length(i), e.m_message);
+}
+
+//! Reports 'e' to 'diagnostics', pointing at the character that doesn't start a token
+inline void report(Diagnostics& diagnostics, TokenException const& e)
+{
+    diagnostics.error(e.offset, 1, e.what());
+}
+
+//! Returns the first top-level '=' after 'it', the '=' of a definition that failed to parse.
+//! Braces are counted from 'it' on, so definitions nested in the failed one are skipped.
+inline ParseIndex skip_definition(ParseIndex it, ParseIndex end)
+{
+    int depth = 0;
+    for (++it; it != end && it->type != LexItem::Type::eof; ++it)
     {
-        return ParseContext::parse_statements(tlist.begin(), [&](ParseIndex i) { return i == tlist.end() || i->type == LexItem::Type::eof; });
+        switch (it->type)
+        {
+        case LexItem::Type::BRACE_OPEN: ++depth; break;
+        case LexItem::Type::BRACE_CLOSE: depth = depth > 0 ? depth - 1 : 0; break;
+        case LexItem::Type::DEFN: if (depth == 0) { return it; } break;
+        default: break;
+        }
     }
-    catch (ParseException const& e)
+    return it;
+}
+
+//! Braces and parentheses nesting deeper than this are parsed with parse_iterative() by
+//! parse() and parse_recovering(), whatever the mode: the recursive parser spends several
+//! call frames per level, and 50k nested bodies overflow an 8 MB stack
+constexpr size_t max_recursive_nesting = 1024;
+
+//! True if braces and parentheses in 'tlist' nest deeper than 'limit'
+inline bool nests_deeper_than(TokenList const& tlist, size_t limit)
+{
+    size_t depth = 0;
+    for (size_t i = 0, n = tlist.size(); i < n; ++i)
     {
-        fprintf(stderr, "Fatal error during parse\n");
-        fprintf(stderr, "'%s'\n", tlist.buffer().c_str());
-        fputc(' ', stderr);
-        for (auto const& c : tlist.buffer())
+        switch (tlist.kind(i))
         {
-            if (&c >= e.m_position->begin && &c < e.m_position->end)
+        case LexItem::Type::BRACE_OPEN:
+        case LexItem::Type::PAREN_OPEN:
+            if (++depth > limit)
             {
-                fputc('^', stderr);
+                return true;
             }
-            else
+            break;
+        case LexItem::Type::BRACE_CLOSE:
+        case LexItem::Type::PAREN_CLOSE:
+            depth = depth > 0 ? depth - 1 : 0;
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+//! Parses like parse_serial(), or parse_iterative() if that is the Global<ParseSettings>()
+//! mode or the input nests deeper than max_recursive_nesting, but reports each error to 'diagnostics' and resumes at the next top-level
+//! definition instead of throwing, until diagnostics.full(). Valid input
+//! gives the same tree as parse_serial() and never throws; an error unwinds only out of the
+//! definition it is in.
+//! \returns the definitions that parsed; the tree is only complete if no error was reported
+inline ParseContext parse_recovering(TokenList const& tlist, Diagnostics& diagnostics)
+{
+    auto arena = std::make_shared<Arena>();
+    ParseContext ctx{ arena.get(), arena->create<SymbolTable>(arena.get()) };
+    ctx.begin = tlist.begin();
+
+    auto const iterative = Global<ParseSettings>().mode == ParseMode::iterative
+        || nests_deeper_than(tlist, max_recursive_nesting);
+    auto const end = tlist.end();
+    auto it = tlist.begin();
+    while (it != end && it->type != LexItem::Type::eof && !diagnostics.full())
+    {
+        if (it->type != LexItem::Type::DEFN)
+        {
+            ++it;
+            continue;
+        }
+        try
+        {
+            it = iterative ? parse_statement_iterative(ctx, it) : ctx.parse_statement(it);
+        }
+        catch (ParseException const& e)
+        {
+            report(diagnostics, tlist, e);
+            it = skip_definition(it, end);
+        }
+    }
+    ctx.end = it;
+
+    ctx.owned_arena = std::move(arena);
+    ctx.interner = tlist.interner();
+    return ctx;
+}
+
+//! Parses as selected by Global<ParseSettings>(), or with parse_iterative() if the input
+//! nests deeper than max_recursive_nesting, printing every error to stderr
+//! \returns an empty context (no arena) if there were errors
+inline ParseContext parse(TokenList const& tlist, char const* source_name = "<source>")
+{
+    auto const mode = nests_deeper_than(tlist, max_recursive_nesting) ? ParseMode::iterative : Global<ParseSettings>().mode;
+    if (mode != ParseMode::serial)
+    {
+        try
+        {
+            if (mode == ParseMode::iterative)
             {
-                fputc(' ', stderr);
+                return parse_iterative(tlist);
             }
+            return parse_parallel(tlist, Global<ThreadPool>());
         }
-        if (e.m_position->type == LexItem::Type::eof)
+        catch (ParseException const&)
         {
-            fputc('^', stderr);
+            // Parse again to find every error, not just the first
         }
-        fprintf(stderr, "\n%s", e.m_message.c_str());
-        return ParseContext{};
     }
+    Diagnostics diagnostics{ tlist.buffer().data(), tlist.buffer().size() };
+    auto ctx = parse_recovering(tlist, diagnostics);
+    if (diagnostics.empty())
+    {
+        return ctx;
+    }
+    diagnostics.render(stderr, source_name);
+    return ParseContext{};
 }
 
 }; // namespace ty
@@ -0,0 +1,201 @@
+#include "Parse.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace ty
+{
+
+namespace
+{
+
+//! Moves the token index of every node of a kept definition by the edit's shift. Walks with
+//! an explicit stack, as expression trees can be as deep as a definition is long.
+class TokenShifter : public Generator
+{
+public:
+    explicit TokenShifter(std::ptrdiff_t shift)
+        : m_shift{ shift }
+    {}
+
+    void shift(Expr* root)
+    {
+        m_pending.push_back(root);
+        while (!m_pending.empty())
+        {
+            auto* e = m_pending.back();
+            m_pending.pop_back();
+            e->generate(*this);
+        }
+    }
+
+    void generate(FunctionDefnExpr const& expr) override
+    {
+        move(expr);
+        // Return expressions are in m_body->exprs too
+        m_pending.insert(m_pending.end(), expr.m_arguments.begin(), expr.m_arguments.end());
+        m_pending.insert(m_pending.end(), expr.m_body->exprs.begin(), expr.m_body->exprs.end());
+    }
+
+    void generate(Int32LiteralExpr const& expr) override { move(expr); }
+
+    void generate(ReturnExpr const& expr) override { push(expr.sub_expr()); }
+
+    void generate(DataDefnExpr const& expr) override
+    {
+        move(expr);
+        push(expr.value());
+    }
+
+    void generate(SymbolExpr const& expr) override { move(expr); }
+
+    void generate(FunctionCallExpr const& expr) override
+    {
+        move(expr);
+        for (auto const* a : expr.arguments())
+        {
+            push(a);
+        }
+    }
+
+    void generate(AddExpr const& expr) override { binary(expr); }
+
+    void generate(SubExpr const& expr) override { binary(expr); }
+
+private:
+    void binary(BinaryOpExpr const& expr)
+    {
+        move(expr);
+        push(expr.left());
+        push(expr.right());
+    }
+
+    //! The tree is the caller's to modify; Generator only hands out const nodes
+    void move(Expr const& expr)
+    {
+        const_cast<Expr&>(expr).set_token(static_cast<uint32_t>(std::ptrdiff_t(expr.token()) + m_shift));
+    }
+
+    void push(Expr const* expr)
+    {
+        m_pending.push_back(const_cast<Expr*>(expr));
+    }
+
+    std::ptrdiff_t      m_shift;
+    std::vector<Expr*>  m_pending;
+};
+
+} // namespace
+
+ReparseStats reparse(ParseContext& ctx, TokenList const& tlist, TokenEdit const& edit)
+{
+    if (!ctx.arena)
+    {
+        ctx = parse_serial(tlist);
+        return ReparseStats{ ctx.exprs.size(), 0 };
+    }
+
+    auto& exprs = ctx.exprs;
+    auto const count = exprs.size();
+    auto const shift = edit.shift();
+
+    // Definition k reads no further than the ID of definition k + 1, so the definitions
+    // before the last one starting at or before edit.first are untouched
+    auto const starts_before = static_cast<size_t>(std::partition_point(exprs.begin(), exprs.end(),
+        [&](Expr const* e) { return e->token() <= edit.first; }) - exprs.begin());
+    auto const first = starts_before ? starts_before - 1 : 0;
+    auto const start = starts_before ? size_t(exprs[first]->token()) : size_t(0);
+
+    // Same loop as parse_statements, until it reaches an old definition past the edit.
+    // New definitions are bound in a scope of their own, with the old definitions from
+    // 'start' on hidden, so every lookup sees what the serial parser would.
+    auto& table = *ctx.symbols;
+    ParseContext window{ ctx.arena, &table };
+    auto last = first;
+    bool in_step = false;
+
+    auto it = tlist.begin() + start;
+    table.hide_from(static_cast<uint32_t>(start));
+    try
+    {
+        SymbolTable::Scope scope{ table };
+        while (it != tlist.end() && it->type != LexItem::Type::eof)
+        {
+            if (it.index() >= edit.new_end)
+            {
+                auto const old_index = size_t(std::ptrdiff_t(it.index()) - shift);
+                while (last < count && exprs[last]->token() < old_index)
+                {
+                    ++last;
+                }
+                if (last < count && exprs[last]->token() == old_index)
+                {
+                    in_step = true;
+                    break;
+                }
+            }
+
+            if (it->type == LexItem::Type::DEFN)
+            {
+                it = window.parse_statement(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    }
+    catch (...)
+    {
+        table.show_all();
+        throw;
+    }
+    table.show_all();
+    if (!in_step)
+    {
+        last = count;
+    }
+    auto const& fresh = window.exprs;
+
+    // A new definition may clash with a kept one after it, which is then the one reported
+    size_t clash = SIZE_MAX;
+    for (auto const* e : fresh)
+    {
+        auto const* existing = table.expr_at(e->id());
+        if (existing && last < count && existing->token() >= exprs[last]->token())
+        {
+            clash = std::min(clash, size_t(std::ptrdiff_t(existing->token()) + shift));
+        }
+    }
+    if (clash != SIZE_MAX)
+    {
+        throw ParseException(tlist.begin() + clash, "Duplicate definition");
+    }
+
+    // Nothing can fail from here on
+    for (auto k = first; k < last; ++k)
+    {
+        table.remove_expr(exprs[k]->id());
+    }
+    for (auto* e : fresh)
+    {
+        table.add_expr(e->id(), e);
+    }
+    if (shift != 0)
+    {
+        TokenShifter shifter{ shift };
+        for (auto k = last; k < count; ++k)
+        {
+            shifter.shift(exprs[k]);
+        }
+    }
+    exprs.erase(exprs.begin() + first, exprs.begin() + last);
+    exprs.insert(exprs.begin() + first, fresh.begin(), fresh.end());
+
+    ctx.begin = tlist.begin();
+    ctx.end = in_step ? tlist.begin() + (std::ptrdiff_t(ctx.end.index()) + shift) : it;
+    ctx.interner = tlist.interner();
+    return ReparseStats{ fresh.size(), count - (last - first) };
+}
+
+} // namespace ty
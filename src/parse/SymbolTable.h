@@ -1,9 +1,12 @@
 #pragma once
 
-#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 #include "common/TyObject.h"
+#include "common/Arena.h"
 #include "Expr.h"
 
 namespace ty
@@ -11,47 +14,138 @@ namespace ty
 
 class SymbolTable;
 
-//! Table of symbols for a given scope
+//! Symbols of one compilation, kept as a stack of scopes.
+//! Each SymbolId maps directly to its innermost binding, so expr_at() is one array
+//! access at any nesting depth. Bindings made in a scope are recorded in an undo
+//! log and unwound by pop_scope(). Once parsing is done only the outermost scope,
+//! the module's top-level definitions, is left.
 class SymbolTable : public TyObject<Attribute::HasGlobal>
 {
 public: // member virtual
 
-	explicit SymbolTable(SymbolTable const* parent = nullptr)
-		: m_parent{ parent } {}
+	//! Opens a scope on construction and closes it on destruction, also during stack unwinding
+	class Scope
+	{
+	public:
+		explicit Scope(SymbolTable& table) : m_table{ table } { m_table.push_scope(); }
+		~Scope() { m_table.pop_scope(); }
+
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+
+	private:
+		SymbolTable& m_table;
+	};
 
-	//! Binds a symbol to a Expr.
-	//! \pre	'name' must not already be in the SymbolTable
-	void add_expr(std::string name, Expr* expr)
+	//! Storage is drawn from 'arena' if given, so tables inside an Arena need no destructor
+	explicit SymbolTable(Arena* arena = nullptr)
+		: m_bindings{ ArenaAllocator<Binding>{ arena } }
+		, m_undo{ ArenaAllocator<Undo>{ arena } }
+		, m_scopes{ ArenaAllocator<size_t>{ arena } } {}
+
+	//! Binds a symbol to a Expr in the innermost scope.
+	//! \pre	'name' must not already be visible in the SymbolTable
+	void add_expr(SymbolId name, Expr* expr)
 	{
 		CCT_CHECK(expr_at(name) == nullptr);
-		
-		using pair_t = std::decay_t<decltype(m_definitions)::value_type>;
 
-		m_definitions.emplace(pair_t{ std::move(name), std::move(expr)});
+		if (name >= m_bindings.size())
+		{
+			m_bindings.resize(std::max<size_t>(name + 1, m_bindings.size() * 2));
+		}
+		auto& b = m_bindings[name];
+		if (!m_scopes.empty())
+		{
+			m_undo.push_back(Undo{ name, b });
+		}
+		else if (b.expr)
+		{
+			--m_count; // hidden binding replaced, see hide_from()
+		}
+		b = Binding{ expr, static_cast<uint32_t>(m_scopes.size()) };
+		++m_count;
 	}
 
-    void set_parent(SymbolTable const* parent)
-    {
-        m_parent = parent;
-    }
+	//! Unbinds 'name' from the outermost scope
+	//! \pre	no inner scope is open
+	void remove_expr(SymbolId name)
+	{
+		CCT_CHECK(m_scopes.empty());
+		if (name < m_bindings.size() && m_bindings[name].expr)
+		{
+			m_bindings[name] = Binding{};
+			--m_count;
+		}
+	}
 
-	//! Search for the definition with 'name' in this SymbolList
+	//! Search for the innermost visible definition with 'name'
 	//!		\returns	pointer to definition, if found
 	//!					nullptr, otherwise
-	virtual Expr* expr_at(std::string const& name) const
+	virtual Expr* expr_at(SymbolId name) const
 	{
-		auto const it = m_definitions.find(name);
-		if (it != m_definitions.end())
+		if (name >= m_bindings.size())
+		{
+			return nullptr;
+		}
+		auto const& b = m_bindings[name];
+		if (b.depth == 0 && b.expr && b.expr->token() >= m_hidden_from)
 		{
-			return it->second;
+			return nullptr;
 		}
-		return m_parent ? m_parent->expr_at(name) : nullptr;
+		return b.expr;
 	}
 
-	auto count() const { return m_definitions.size(); }
-private:	
-	std::unordered_map<std::string, Expr*>	                        m_definitions;
-	SymbolTable const*												m_parent = nullptr;
+	void push_scope()
+	{
+		m_scopes.push_back(m_undo.size());
+	}
+
+	//! Drops every binding made since the matching push_scope()
+	void pop_scope()
+	{
+		CCT_CHECK(!m_scopes.empty());
+		auto const mark = m_scopes.back();
+		m_scopes.pop_back();
+		while (m_undo.size() > mark)
+		{
+			auto const& u = m_undo.back();
+			m_bindings[u.name] = u.previous;
+			--m_count;
+			m_undo.pop_back();
+		}
+	}
+
+	//! Number of open scopes inside the outermost one
+	size_t depth() const noexcept { return m_scopes.size(); }
+
+	//! Makes outermost bindings to definitions at or after token 'index' invisible to
+	//! expr_at() until show_all(). Lets reparse() parse new definitions while the ones
+	//! they replace are still bound.
+	void hide_from(uint32_t index) noexcept { m_hidden_from = index; }
+
+	void show_all() noexcept { m_hidden_from = UINT32_MAX; }
+
+	//! Number of bindings, visible or not
+	auto count() const { return m_count; }
+
+private:
+	struct Binding
+	{
+		Expr*		expr = nullptr;
+		uint32_t	depth = 0;		//!< Scope the binding was made in, 0 for the outermost
+	};
+
+	struct Undo
+	{
+		SymbolId	name;
+		Binding		previous;
+	};
+
+	ArenaVector<Binding>	m_bindings;		//!< Indexed by SymbolId
+	ArenaVector<Undo>		m_undo;
+	ArenaVector<size_t>		m_scopes;		//!< Undo log size at each push_scope()
+	size_t					m_count = 0;
+	uint32_t				m_hidden_from = UINT32_MAX;
 };
 
 //! List of symbols chosen for export to outside of the module
@@ -66,4 +160,3 @@ public:
 };
 
 } // namespace ty
-
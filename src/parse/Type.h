@@ -1,6 +1,14 @@
 #pragma once
 
 #include "common/TyObject.h"
+#include "common/Arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace ty
 {
@@ -18,8 +26,9 @@ inline auto const* to_string(NativeType const n)
     switch (n)
     {
     case NativeType::I_32:		return "i32";
-    default:	
-        std::abort(); 
+    case NativeType::I_64:		return "i64";
+    default:
+        std::abort();
         return "";
     }
 }
@@ -30,41 +39,57 @@ inline auto alignment_of(NativeType const n)
     switch (n)
     {
     case NativeType::I_32:		return 4;
-    default:	
-        std::abort(); 
+    case NativeType::I_64:		return 8;
+    default:
+        std::abort();
         return 0;
     }
 }
 
+//! Discriminates Type subclasses without a dynamic_cast
+enum class TypeKind : uint8_t
+{
+    System,
+    Function
+};
+
+class TypeContext;
+
+//! Base of all types. Every distinct type has exactly one instance, owned by a
+//! TypeContext, so two types are equal exactly when they are the same object.
 class Type : public TyObject<>
 {
 public:
-    virtual bool operator==(Type const&) const = 0;
+    bool operator==(Type const& t) const noexcept { return this == &t; }
 
-    virtual bool operator!=(Type const& t) const { return !(*this == t); }
+    bool operator!=(Type const& t) const noexcept { return this != &t; }
+
+    TypeKind kind() const noexcept { return m_kind; }
 
     virtual ~Type() = default;
+
+protected:
+    explicit Type(TypeKind kind) : m_kind{ kind } {}
+
+    Type(Type const&) = delete;
+    Type& operator=(Type const&) = delete;
+
+private:
+    TypeKind    m_kind;
 };
 
 class SystemType : public Type
 {
 public:
-    explicit SystemType(NativeType nt, int align)
-        : m_native_type{ nt }, m_alignment{ align }
-    {}
-
-    bool operator==(Type const& other) const override {
-        if (auto* o = dynamic_cast<SystemType const*>(&other))
-        {
-            return native_type() == o->native_type();
-        }
-        return false;
-    }
-
     NativeType native_type() const { return m_native_type; }
 
     int alignment() const { return m_alignment; }
 
+protected:
+    explicit SystemType(NativeType nt, int align)
+        : Type{ TypeKind::System }, m_native_type{ nt }, m_alignment{ align }
+    {}
+
 private:
     NativeType	m_native_type{ NativeType::I_32 };
 
@@ -73,7 +98,7 @@ private:
 
 class NumericType : public SystemType
 {
-public:
+protected:
     template <typename... Args>
     explicit NumericType(Args&&... args)
         : SystemType(std::forward<Args>(args)...) {}
@@ -81,10 +106,135 @@ public:
 
 class Int32Type : public NumericType
 {
-public:
+    friend class TypeContext;
+
     explicit Int32Type()
         : NumericType{ NativeType::I_32, alignment_of(NativeType::I_32) }
     {}
 };
 
+class Int64Type : public NumericType
+{
+    friend class TypeContext;
+
+    explicit Int64Type()
+        : NumericType{ NativeType::I_64, alignment_of(NativeType::I_64) }
+    {}
+};
+
+//! Type of a function: its result type followed by its parameter types
+class FunctionType : public Type
+{
+    friend class TypeContext;
+
+public:
+    Type const* return_type() const noexcept { return m_return; }
+
+    size_t parameter_count() const noexcept { return m_parameter_count; }
+
+    Type const* parameter(size_t i) const noexcept { return m_parameters[i]; }
+
+private:
+    FunctionType(Type const* ret, Type const* const* parameters, size_t count)
+        : Type{ TypeKind::Function }, m_return{ ret }, m_parameters{ parameters }, m_parameter_count{ count }
+    {}
+
+    Type const*         m_return;
+    Type const* const*  m_parameters;   //!< Owned by the TypeContext's arena
+    size_t              m_parameter_count;
+};
+
+//! Hands out the one canonical instance of every type.
+//! Native types are created up front. Composite types are hash-consed on their
+//! (already canonical) component pointers, so building the same structure twice
+//! returns the same object. Types live as long as the context; lookups of native
+//! types are lock-free, composite lookups may come from several threads.
+class TypeContext : public TyObject<Attribute::HasGlobal>
+{
+public:
+    TypeContext()
+        : m_i32{ make<Int32Type>() }
+        , m_i64{ make<Int64Type>() }
+    {}
+
+    TypeContext(TypeContext const&) = delete;
+    TypeContext& operator=(TypeContext const&) = delete;
+
+    Int32Type const* i32() const noexcept { return m_i32; }
+
+    Int64Type const* i64() const noexcept { return m_i64; }
+
+    SystemType const* native(NativeType n) const
+    {
+        switch (n)
+        {
+        case NativeType::I_32:  return m_i32;
+        case NativeType::I_64:  return m_i64;
+        default:
+            std::abort();
+            return nullptr;
+        }
+    }
+
+    //! Returns the function type taking 'parameters' and returning 'ret'
+    //! \pre every type passed in comes from this context
+    FunctionType const* function(Type const* ret, std::vector<Type const*> const& parameters)
+    {
+        Key key;
+        key.reserve(parameters.size() + 2);
+        key.push_back(reinterpret_cast<Type const*>(uintptr_t(TypeKind::Function)));
+        key.push_back(ret);
+        key.insert(key.end(), parameters.begin(), parameters.end());
+
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        auto& slot = m_composites[key];
+        if (!slot)
+        {
+            auto** params = static_cast<Type const**>(m_arena.allocate(sizeof(Type const*) * (parameters.size() + 1), alignof(Type const*)));
+            std::copy(parameters.begin(), parameters.end(), params);
+            slot = make<FunctionType>(ret, params, parameters.size());
+        }
+        return static_cast<FunctionType const*>(slot);
+    }
+
+    //! Number of distinct composite types created so far
+    size_t composite_count() const
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        return m_composites.size();
+    }
+
+private:
+    //! Constructs a type in the arena; Arena::create can't reach the private constructors
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        return new (m_arena.allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    //! Structural key of a composite type: its kind, then its component types
+    using Key = std::vector<Type const*>;
+
+    struct KeyHash
+    {
+        size_t operator()(Key const& k) const noexcept
+        {
+            uint64_t h = 14695981039346656037ull;
+            for (auto const* t : k)
+            {
+                h = (h ^ uint64_t(uintptr_t(t))) * 1099511628211ull;
+            }
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    // Types are created in the arena and never destroyed: none owns outside resources
+    Arena                                               m_arena;
+    Int32Type const*                                    m_i32;
+    Int64Type const*                                    m_i64;
+
+    mutable std::mutex                                  m_mutex;
+    std::unordered_map<Key, Type const*, KeyHash>       m_composites;
+};
+
 } // namespace ty
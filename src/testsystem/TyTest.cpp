@@ -0,0 +1,783 @@
+#include "TyTest.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+#include "parse/FlatAst.h"
+#include "cgen/BitcodeGenerator.h"
+#include "cgen/ElfGenerator.h"
+#include "cgen/LLVM_IR_Generator.h"
+#include "vm/BytecodeCompiler.h"
+#include "vm/Interpreter.h"
+#include "token/TokenList.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace ty
+{
+
+namespace
+{
+
+//! Changes whenever the way artefacts are built changes, orphaning old entries
+constexpr char const* artefact_salt = "tytest 1";
+
+std::string read_file(std::string const& path)
+{
+    auto* f = std::fopen(path.c_str(), "rb");
+    if (!f)
+    {
+        throw TestException("Cannot read " + path);
+    }
+    std::string text;
+    char chunk[4096];
+    size_t n = 0;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+    {
+        text.append(chunk, n);
+    }
+    std::fclose(f);
+    return text;
+}
+
+void write_file(std::string const& path, std::string const& text)
+{
+    auto* f = std::fopen(path.c_str(), "wb");
+    auto ok = f && std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = f && std::fclose(f) == 0 && ok;
+    if (!ok)
+    {
+        throw TestException("Cannot write " + path);
+    }
+}
+
+//! Replaces the XML entities .tytest files use to escape C++ source
+std::string decode_entities(std::string const& text)
+{
+    static char const* const names[] = { "lt;", "gt;", "amp;", "quot;", "apos;" };
+    static char const chars[] = { '<', '>', '&', '"', '\'' };
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (text[i] != '&')
+        {
+            out.push_back(text[i]);
+            continue;
+        }
+        auto const end = text.find(';', i);
+        if (end == std::string::npos)
+        {
+            throw TestException("Unterminated entity");
+        }
+        auto const entity = text.substr(i + 1, end - i);
+        size_t k = 0;
+        while (k < 5 && entity != names[k])
+        {
+            ++k;
+        }
+        if (k < 5)
+        {
+            out.push_back(chars[k]);
+        }
+        else if (entity.size() > 2 && entity[0] == '#')
+        {
+            auto const hex = entity[1] == 'x';
+            out.push_back(static_cast<char>(std::strtoul(entity.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10)));
+        }
+        else
+        {
+            throw TestException("Unknown entity '&" + entity + "'");
+        }
+        i = end;
+    }
+    return out;
+}
+
+//! Position after the comments and whitespace at 'i'
+size_t skip_misc(std::string const& text, size_t i)
+{
+    while (i < text.size())
+    {
+        if (text[i] == ' ' || text[i] == '\t' || text[i] == '\r' || text[i] == '\n')
+        {
+            ++i;
+        }
+        else if (text.compare(i, 4, "<!--") == 0)
+        {
+            auto const end = text.find("-->", i + 4);
+            if (end == std::string::npos)
+            {
+                throw TestException("Unterminated comment");
+            }
+            i = end + 3;
+        }
+        else if (text.compare(i, 2, "<?") == 0)
+        {
+            auto const end = text.find("?>", i + 2);
+            if (end == std::string::npos)
+            {
+                throw TestException("Unterminated declaration");
+            }
+            i = end + 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+//! Reads '<name>' at 'i' and returns 'name'
+std::string open_tag(std::string const& text, size_t& i)
+{
+    auto const end = text.find('>', i);
+    if (text.compare(i, 1, "<") != 0 || end == std::string::npos || text[i + 1] == '/')
+    {
+        throw TestException("Expected an element at offset " + std::to_string(i));
+    }
+    auto const name = text.substr(i + 1, end - i - 1);
+    i = end + 1;
+    return name;
+}
+
+//! Reads up to and including '</name>' and returns the decoded text before it
+std::string element_text(std::string const& text, size_t& i, std::string const& name)
+{
+    auto const close = "</" + name + ">";
+    auto const end = text.find(close, i);
+    if (end == std::string::npos)
+    {
+        throw TestException("Missing " + close);
+    }
+    auto const content = text.substr(i, end - i);
+    i = end + close.size();
+    if (content.find('<') != std::string::npos)
+    {
+        throw TestException("Unexpected markup in <" + name + ">");
+    }
+    return decode_entities(content);
+}
+
+//! Non-empty lines without surrounding whitespace
+std::vector<std::string> output_lines(std::string const& text)
+{
+    std::vector<std::string> lines;
+    size_t begin = 0;
+    while (begin < text.size())
+    {
+        auto end = text.find('\n', begin);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        auto const first = text.find_first_not_of(" \t\r", begin);
+        if (first < end)
+        {
+            auto last = end;
+            while (text[last - 1] == ' ' || text[last - 1] == '\t' || text[last - 1] == '\r')
+            {
+                --last;
+            }
+            lines.push_back(text.substr(first, last - first));
+        }
+        begin = end + 1;
+    }
+    return lines;
+}
+
+std::string quote(std::string const& path)
+{
+    return "\"" + path + "\"";
+}
+
+//! Runs 'command' through the shell, appending whatever it prints to stderr to 'log'
+int run_command(std::string const& command, std::string const& log)
+{
+    auto const line = command + " 2>>" + quote(log);
+#ifdef _WIN32
+    // cmd.exe strips the first and last quote of the line
+    return std::system(("\"" + line + "\"").c_str());
+#else
+    return std::system(line.c_str());
+#endif
+}
+
+std::string make_test_directory(std::string root)
+{
+    if (root.empty())
+    {
+#ifdef _WIN32
+        char path[MAX_PATH + 1];
+        root = GetTempPathA(sizeof(path), path) ? path : ".";
+#else
+        auto const* tmp = std::getenv("TMPDIR");
+        root = tmp && *tmp ? tmp : "/tmp";
+#endif
+    }
+    while (root.size() > 1 && (root.back() == '/' || root.back() == '\\'))
+    {
+        root.pop_back();
+    }
+#ifdef _WIN32
+    static std::atomic<unsigned> counter{ 0 };
+    for (unsigned attempt = 0; attempt < 100; ++attempt)
+    {
+        auto const path = root + "\\tytest-" + std::to_string(_getpid()) + "-" + std::to_string(counter++);
+        if (_mkdir(path.c_str()) == 0)
+        {
+            return path;
+        }
+    }
+#else
+    auto path = root + "/tytest-XXXXXX";
+    if (mkdtemp(&path[0]))
+    {
+        return path;
+    }
+#endif
+    throw TestException("Cannot create a directory in " + root);
+}
+
+//! Deletes 'path' and the files in it; tests don't create subdirectories
+void remove_test_directory(std::string const& path)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    auto const handle = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (handle != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            std::remove((path + "\\" + data.cFileName).c_str());
+        } while (FindNextFileA(handle, &data));
+        FindClose(handle);
+    }
+    _rmdir(path.c_str());
+#else
+    if (auto* dir = opendir(path.c_str()))
+    {
+        while (auto const* d = readdir(dir))
+        {
+            std::remove((path + "/" + d->d_name).c_str());
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+#endif
+}
+
+//! Tokenizes and parses the sample, reporting errors as TestExceptions
+std::unique_ptr<ParseContext> parse_sample(TestCase const& test, std::unique_ptr<TokenList>& tokens)
+{
+    try
+    {
+        tokens = std::make_unique<TokenList>(tokenize(test.sample));
+        return std::make_unique<ParseContext>(parse_serial(*tokens));
+    }
+    catch (TokenException const& e)
+    {
+        throw TestException(std::string{ "sample: " } + e.what() + " at offset " + std::to_string(e.offset));
+    }
+    catch (ParseException const& e)
+    {
+        throw TestException("sample: " + e.m_message + " at token " + std::to_string(e.m_position.index()));
+    }
+}
+
+//! Generates the IR of 'ast' from the tree and from its flat form, which must give the
+//! same bytes or fail with the same message
+//! \throws TestException if they don't
+void check_flat_ir(ParseContext const& ast)
+{
+    StringSink tree_out;
+    StringSink flat_out;
+    std::string tree_error;
+    std::string flat_error;
+    try
+    {
+        generate_serial(ast, tree_out);
+    }
+    catch (EvalException const& e)
+    {
+        tree_error = e.what();
+    }
+    try
+    {
+        generate_serial(flatten(ast), flat_out);
+    }
+    catch (FlatCodegenException const& e)
+    {
+        flat_error = e.what();
+    }
+    if (flat_error != tree_error)
+    {
+        throw TestException("IR from the flat AST failed with '" + flat_error + "' instead of '" + tree_error + "'");
+    }
+    if (tree_error.empty() && flat_out.str() != tree_out.str())
+    {
+        throw TestException("IR from the flat AST differs:\n" + flat_out.str() + "instead of:\n" + tree_out.str());
+    }
+}
+
+//! Compiles 'ast' as 'mode' does, discarding the output
+void compile_sample(ParseContext const& ast, TestMode mode)
+{
+    check_flat_ir(ast);
+    StringSink out;
+    switch (mode)
+    {
+    case TestMode::vm: compile_bytecode(ast, false); break;
+    case TestMode::llvm: generate_bitcode(ast, out); break;
+    case TestMode::ir: generate_module(ast, out); break;
+    default: generate_elf(ast, out); break;
+    }
+}
+
+//! Compiles the sample as 'mode' does and renders its errors as tyx does, for a source
+//! named 'sample'. If 'incremental', the tree is parsed from <before> and brought up to date
+//! with relex() and reparse(), or parsed again from scratch where the compile server would.
+//! \returns an empty string if the sample compiled
+std::string sample_errors(TestCase const& test, TestMode mode, bool incremental)
+{
+    std::unique_ptr<TokenList> before;
+    ParseContext ast;
+    if (incremental)
+    {
+        try
+        {
+            before = std::make_unique<TokenList>(tokenize(test.before));
+            ast = parse_serial(*before);
+        }
+        catch (TokenException const&)
+        {
+            throw TestException("<before> doesn't compile");
+        }
+        catch (ParseException const&)
+        {
+            throw TestException("<before> doesn't compile");
+        }
+    }
+
+    Diagnostics diagnostics{ test.sample.data(), test.sample.size() };
+    try
+    {
+        std::unique_ptr<TokenList> tokens;
+        auto parsed = false;
+        if (incremental)
+        {
+            auto const& text = before->buffer();
+            auto const edit = text_edit(text.data(), text.size(), test.sample.data(), test.sample.size());
+            TokenEdit changed;
+            relex(*before, edit, changed);
+            tokens = std::move(before);
+            try
+            {
+                reparse(ast, *tokens, changed);
+                parsed = true;
+            }
+            catch (ParseException const&)
+            {
+                // Parsed from scratch below, as the compile server does
+            }
+        }
+        else
+        {
+            tokens = std::make_unique<TokenList>(tokenize(test.sample));
+        }
+        if (!parsed)
+        {
+            ast = parse_recovering(*tokens, diagnostics);
+        }
+        if (diagnostics.empty())
+        {
+            try
+            {
+                compile_sample(ast, mode);
+            }
+            catch (EvalException const& e)
+            {
+                report(diagnostics, *tokens, e);
+            }
+        }
+    }
+    catch (TokenException const& e)
+    {
+        report(diagnostics, e);
+    }
+    std::string out;
+    diagnostics.render(out, "sample");
+    return out;
+}
+
+} // namespace
+
+TestCase load_test(std::string const& path)
+{
+    TestCase test;
+    test.path = path;
+    auto const text = read_file(path);
+    try
+    {
+        auto i = skip_misc(text, 0);
+        if (open_tag(text, i) != "tytest")
+        {
+            throw TestException("Root element isn't <tytest>");
+        }
+        bool has_sample = false, has_expected = false, has_checker = false;
+        while ((i = skip_misc(text, i)) < text.size() && text.compare(i, 2, "</") != 0)
+        {
+            auto const name = open_tag(text, i);
+            auto content = element_text(text, i, name);
+            if (name == "sample")
+            {
+                test.sample = std::move(content);
+                has_sample = true;
+            }
+            else if (name == "expected")
+            {
+                test.expected = std::move(content);
+                has_expected = true;
+            }
+            else if (name == "checker")
+            {
+                test.checker = std::move(content);
+                has_checker = true;
+            }
+            else if (name == "run")
+            {
+                test.run = std::move(content);
+                test.has_run = true;
+            }
+            else if (name == "error")
+            {
+                test.error = std::move(content);
+                test.has_error = true;
+            }
+            else if (name == "before")
+            {
+                test.before = std::move(content);
+                test.has_before = true;
+            }
+        }
+        if (text.compare(i, 9, "</tytest>") != 0)
+        {
+            throw TestException("Missing </tytest>");
+        }
+        if (!has_sample || (!test.has_error && (!has_expected || !has_checker)))
+        {
+            throw TestException("Missing <sample>, <expected> or <checker>");
+        }
+        if (test.has_before && !test.has_error)
+        {
+            throw TestException("<before> needs an <error> section");
+        }
+    }
+    catch (TestException const& e)
+    {
+        throw TestException(path + ": " + e.m_message);
+    }
+    return test;
+}
+
+//! State of one test running external tools
+struct TestRunner::Context
+{
+    TestResult&     result;
+    std::string     directory;
+    std::string     log;
+
+    std::string file(char const* name) const { return directory + "/" + name; }
+
+    //! Runs 'command', failing the test with 'what' if it doesn't succeed
+    void run(std::string const& command, char const* what) const
+    {
+        if (run_command(command, log) != 0)
+        {
+            throw TestException(std::string{ what } + " failed, see " + log);
+        }
+    }
+};
+
+TestRunner::TestRunner(TestOptions options, CompileCache* cache)
+    : m_options{ std::move(options) }, m_cache{ cache }
+{
+    if (m_options.cxx.empty())
+    {
+        m_options.cxx = m_options.mode == TestMode::obj ? "c++" : "clang++";
+    }
+}
+
+CompileCache::Stats TestRunner::cache_stats()
+{
+    std::lock_guard<std::mutex> lock{ m_cache_mutex };
+    return m_cache ? m_cache->stats() : CompileCache::Stats{};
+}
+
+template <typename F>
+void TestRunner::artefact(CacheKey const& key, std::string& data, Context& context, F&& build)
+{
+    if (m_cache)
+    {
+        std::lock_guard<std::mutex> lock{ m_cache_mutex };
+        if (m_cache->load(key, data))
+        {
+            ++context.result.cached;
+            return;
+        }
+    }
+    // Built outside the lock: two tests may both build an artefact, but never wait for each other
+    data = build();
+    if (m_cache)
+    {
+        std::lock_guard<std::mutex> lock{ m_cache_mutex };
+        m_cache->store(key, data);
+        m_cache->trim();
+    }
+}
+
+TestResult TestRunner::run(TestCase const& test)
+{
+    auto const start = std::chrono::steady_clock::now();
+    TestResult result;
+    if (test.has_error)
+    {
+        run_error(test, result);
+    }
+    else if (m_options.mode == TestMode::vm)
+    {
+        run_vm(test, result);
+    }
+    else
+    {
+        Context context{ result, std::string{}, std::string{} };
+        try
+        {
+            context.directory = make_test_directory(m_options.temp_root);
+            context.log = context.file("build.log");
+            run_tools(test, context);
+        }
+        catch (TestException const& e)
+        {
+            result.status = TestStatus::fail;
+            result.message = e.m_message;
+        }
+        if (!context.directory.empty())
+        {
+            if (result.status == TestStatus::fail || m_options.keep)
+            {
+                result.directory = context.directory;
+            }
+            else
+            {
+                remove_test_directory(context.directory);
+            }
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void TestRunner::run_vm(TestCase const& test, TestResult& result)
+{
+    if (!test.has_run)
+    {
+        result.status = TestStatus::skip;
+        result.message = "no <run> section";
+        return;
+    }
+    try
+    {
+        std::unique_ptr<TokenList> tokens;
+        auto const ast = parse_sample(test, tokens);
+        check_flat_ir(*ast);
+        // Unfolded first, so the interpreter executes the calls, loads and arithmetic
+        // itself; folded code must print the same
+        for (auto const fold : { false, true })
+        {
+            auto const module = compile_bytecode(*ast, fold);
+            Interpreter vm{ module };
+            std::string output;
+            for (size_t i = 0; i < module.functions.size(); ++i)
+            {
+                output += std::string{ ast->interner->name(module.functions[i].name) } + "() = "
+                    + std::to_string(static_cast<long long>(vm.call(i))) + "\n";
+            }
+            if (output_lines(output) != output_lines(test.run))
+            {
+                result.message = std::string{ fold ? "folded" : "unfolded" } + " code printed:\n" + output;
+                return;
+            }
+        }
+        result.status = TestStatus::pass;
+    }
+    catch (TestException const& e)
+    {
+        result.message = e.m_message;
+    }
+    catch (EvalException const& e)
+    {
+        result.message = std::string{ "sample: " } + e.what();
+    }
+    catch (VmException const& e)
+    {
+        result.message = std::string{ "sample: " } + e.what();
+    }
+}
+
+void TestRunner::run_error(TestCase const& test, TestResult& result)
+{
+    auto const expected = output_lines(test.error);
+    auto const message = sample_errors(test, m_options.mode, false);
+    if (message.empty())
+    {
+        result.message = "sample compiled, expected an error";
+        return;
+    }
+    if (test.has_before)
+    {
+        try
+        {
+            auto const incremental = sample_errors(test, m_options.mode, true);
+            if (incremental != message)
+            {
+                result.message = "after reparsing from <before>:\n" + incremental + "instead of:\n" + message;
+                return;
+            }
+        }
+        catch (TestException const& e)
+        {
+            result.message = e.m_message;
+            return;
+        }
+    }
+    for (auto const& line : expected)
+    {
+        if (message.find(line) == std::string::npos)
+        {
+            result.message = "error '" + message + "' doesn't contain '" + line + "'";
+            return;
+        }
+    }
+    result.status = TestStatus::pass;
+}
+
+void TestRunner::run_tools(TestCase const& test, Context& context)
+{
+    auto const ir = m_options.mode == TestMode::ir;
+    auto const llvm = m_options.mode == TestMode::llvm || ir;
+    auto const* const ext = llvm ? ".bc" : ".o";
+    auto const& cxx = m_options.cxx;
+
+    // The sample, in-process; textual IR is assembled by llvm-as below. Objects are also
+    // generated without folding, so the relocations and the code for every expression
+    // are linked and run too.
+    std::unique_ptr<TokenList> tokens;
+    auto const ast = parse_sample(test, tokens);
+    check_flat_ir(*ast);
+    auto const sample = context.directory + "/sample" + ext;
+    auto const unfolded = context.directory + "/sample-unfolded.o";
+    auto const generated = ir ? context.directory + "/sample.ll" : sample;
+    try
+    {
+        FileSink out{ generated.c_str() };
+        switch (m_options.mode)
+        {
+        case TestMode::llvm: generate_bitcode(*ast, out); break;
+        case TestMode::ir: generate_module(*ast, out); break;
+        default: generate_elf(*ast, out); break;
+        }
+        out.flush();
+        if (!llvm)
+        {
+            FileSink unfolded_out{ unfolded.c_str() };
+            generate_elf(*ast, unfolded_out, false);
+            unfolded_out.flush();
+        }
+    }
+    catch (EvalException const& e)
+    {
+        throw TestException(std::string{ "sample: " } + e.what());
+    }
+    catch (OutputException const& e)
+    {
+        throw TestException(e.what());
+    }
+    if (ir)
+    {
+        context.run("llvm-as " + quote(generated) + " -o " + quote(sample), "llvm-as");
+    }
+
+    auto const compile = [&](char const* name, std::string const& source)
+    {
+        auto const path = context.directory + "/" + name;
+        write_file(path + ".c", source);
+        context.run(cxx + (llvm ? " -emit-llvm" : "") + " -c -x c++ " + quote(path + ".c") + " -o " + quote(path + ext),
+            (std::string{ "compiling the " } + name).c_str());
+        return path + ext;
+    };
+    // Links 'objects' and runs the result, returning what it printed
+    auto const execute = [&](char const* name, std::string const& a, std::string const& b)
+    {
+        auto const program = context.directory + "/" + name;
+        auto const output = program + ".out";
+        if (llvm)
+        {
+            context.run("llvm-link " + quote(a) + " " + quote(b) + " -o " + quote(program + ".bc"), "llvm-link");
+            context.run("lli " + quote(program + ".bc") + " > " + quote(output), (std::string{ "running the " } + name).c_str());
+        }
+        else
+        {
+            context.run(cxx + " " + quote(a) + " " + quote(b) + " -o " + quote(program), "linking");
+            context.run(quote(program) + " > " + quote(output), (std::string{ "running the " } + name).c_str());
+        }
+        return read_file(output);
+    };
+
+    CacheHasher checker_hash;
+    checker_hash.field(artefact_salt, std::char_traits<char>::length(artefact_salt))
+        .field(ext, std::char_traits<char>::length(ext))
+        .field(cxx.data(), cxx.size())
+        .field(test.checker.data(), test.checker.size());
+    std::string checker_object;
+    artefact(checker_hash.digest(), checker_object, context, [&] { return read_file(compile("checker", test.checker)); });
+    auto const checker = context.file(llvm ? "checker.bc" : "checker.o");
+    write_file(checker, checker_object);
+
+    auto expected_hash = checker_hash;
+    expected_hash.field(test.expected.data(), test.expected.size());
+    std::string expected_output;
+    artefact(expected_hash.digest(), expected_output, context, [&] { return execute("expected", compile("expected", test.expected), checker); });
+
+    auto const actual_output = execute("actual", sample, checker);
+    if (actual_output != expected_output)
+    {
+        context.result.message = "printed '" + actual_output + "' instead of '" + expected_output + "'";
+        return;
+    }
+    if (!llvm)
+    {
+        auto const unfolded_output = execute("actual-unfolded", unfolded, checker);
+        if (unfolded_output != expected_output)
+        {
+            context.result.message = "unfolded code printed '" + unfolded_output + "' instead of '" + expected_output + "'";
+            return;
+        }
+    }
+    context.result.status = TestStatus::pass;
+}
+
+} // namespace ty
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "cgen/CompileCache.h"
+
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <string>
+
+namespace ty
+{
+
+struct TestException : public std::exception
+{
+    explicit TestException(std::string msg) : m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    std::string m_message;
+};
+
+//! Sections of a .tytest file:
+//!     <tytest>
+//!         <sample>   tylang source under test </sample>
+//!         <expected> C++ equivalent of the sample </expected>
+//!         <checker>  C++ main() printing what both must agree on </checker>
+//!         <run>      optional: what 'tyx run' prints for the sample </run>
+//!     </tytest>
+//! A sample that must not compile has an <error> section with text its error message
+//! contains, instead of <expected> and <checker>. Such a test may also have a <before>
+//! section: the sample is then compiled a second time, relexed and reparsed from <before>
+//! as the compile server does after an edit, and must report exactly the same errors.
+struct TestCase
+{
+    std::string path;
+    std::string sample;
+    std::string expected;
+    std::string checker;
+    std::string run;
+    bool        has_run = false;
+    std::string error;
+    bool        has_error = false;
+    std::string before;
+    bool        has_before = false;
+};
+
+//! \throws TestException if 'path' can't be read or isn't a well-formed .tytest
+TestCase load_test(std::string const& path);
+
+enum class TestMode
+{
+    obj,    //!< Sample as an ELF object, linked with the checker by the system C++ compiler
+    llvm,   //!< Sample as bitcode, linked with the checker's bitcode and run by lli
+    ir,     //!< Sample as textual IR, assembled by llvm-as, then run as for 'llvm'
+    vm      //!< Sample run on the bytecode VM and compared with <run>; no external tools
+};
+
+struct TestOptions
+{
+    TestMode    mode = TestMode::obj;
+    std::string cxx;            //!< C++ compiler; empty: c++ for obj, clang++ for llvm and ir
+    std::string temp_root;      //!< Parent of the per-test directories; empty: the system's
+    bool        keep = false;   //!< Keep the directories of passing tests too
+};
+
+enum class TestStatus
+{
+    pass,
+    fail,
+    skip
+};
+
+struct TestResult
+{
+    TestStatus  status = TestStatus::fail;
+    double      seconds = 0;
+    size_t      cached = 0;     //!< Artefacts taken from the cache rather than built
+    std::string message;        //!< Why it failed or was skipped
+    std::string directory;      //!< Kept for inspection when the test failed
+};
+
+//! Runs tests the way run_test.py does, except that the sample is compiled in-process and
+//! every test gets its own directory, so any number of tests can run concurrently.
+//! The checker's object and the output of the expected program only depend on their source
+//! and the compiler, so they are kept in the artefact cache and built once.
+class TestRunner
+{
+public:
+    //! 'cache' may be null; it is shared by all threads running tests
+    TestRunner(TestOptions options, CompileCache* cache);
+
+    //! Never throws for a failing test; the failure is in the result
+    TestResult run(TestCase const& test);
+
+    CompileCache::Stats cache_stats();
+
+private:
+    struct Context;
+
+    void run_vm(TestCase const& test, TestResult& result);
+    void run_error(TestCase const& test, TestResult& result);
+    void run_tools(TestCase const& test, Context& context);
+
+    //! Loads the artefact 'key' into 'data', or calls 'build' to make it and stores it
+    template <typename F>
+    void artefact(CacheKey const& key, std::string& data, Context& context, F&& build);
+
+    TestOptions     m_options;
+    std::mutex      m_cache_mutex;  //!< Guards 'm_cache', which isn't thread-safe
+    CompileCache*   m_cache;
+};
+
+} // namespace ty
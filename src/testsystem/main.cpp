@@ -0,0 +1,279 @@
+#include "testsystem/TyTest.h"
+#include "common/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+
+using namespace ty;
+
+struct Options
+{
+    TestOptions                 test;
+    std::vector<std::string>    paths;
+    unsigned                    jobs = 0;
+    std::string                 cache_directory = "tytest-cache";
+    uint64_t                    cache_bytes = uint64_t(64) << 20;
+};
+
+bool ends_with(std::string const& s, char const* suffix)
+{
+    auto const n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+//! Adds the .tytest files under 'path', or 'path' itself if it is a file
+//! \returns false if 'path' doesn't exist
+bool find_tests(std::string const& path, std::vector<std::string>& tests)
+{
+#ifdef _WIN32
+    auto const attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES)
+    {
+        return false;
+    }
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        tests.push_back(path);
+        return true;
+    }
+    WIN32_FIND_DATAA data;
+    auto const handle = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return true;
+    }
+    do
+    {
+        std::string const name = data.cFileName;
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || ends_with(name, ".tytest"))
+        {
+            find_tests(path + "\\" + name, tests);
+        }
+    } while (FindNextFileA(handle, &data));
+    FindClose(handle);
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return false;
+    }
+    if (!S_ISDIR(info.st_mode))
+    {
+        tests.push_back(path);
+        return true;
+    }
+    auto* dir = opendir(path.c_str());
+    if (!dir)
+    {
+        return true;
+    }
+    while (auto const* d = readdir(dir))
+    {
+        std::string const name = d->d_name;
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        auto const child = path + "/" + name;
+        if (ends_with(name, ".tytest") || (stat(child.c_str(), &info) == 0 && S_ISDIR(info.st_mode)))
+        {
+            find_tests(child, tests);
+        }
+    }
+    closedir(dir);
+#endif
+    return true;
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto const* arg = argv[i];
+        auto const value = [&](char const* prefix) -> char const*
+        {
+            auto const n = std::strlen(prefix);
+            return std::strncmp(arg, prefix, n) == 0 ? arg + n : nullptr;
+        };
+        char const* v = nullptr;
+        if (std::string("--obj") == arg)
+        {
+            options.test.mode = TestMode::obj;
+        }
+        else if (std::string("--llvm") == arg)
+        {
+            options.test.mode = TestMode::llvm;
+        }
+        else if (std::string("--ir") == arg)
+        {
+            options.test.mode = TestMode::ir;
+        }
+        else if (std::string("--vm") == arg)
+        {
+            options.test.mode = TestMode::vm;
+        }
+        else if (std::string("--keep") == arg)
+        {
+            options.test.keep = true;
+        }
+        else if (std::string("--no-cache") == arg)
+        {
+            options.cache_directory.clear();
+        }
+        else if ((v = value("--cache=")))
+        {
+            options.cache_directory = v;
+        }
+        else if ((v = value("--cxx=")))
+        {
+            options.test.cxx = v;
+        }
+        else if ((v = value("--temp=")))
+        {
+            options.test.temp_root = v;
+        }
+        else if ((v = value("--jobs=")) || (v = value("-j")))
+        {
+            if (*v == '\0' && i + 1 < argc)
+            {
+                v = argv[++i];
+            }
+            char* end = nullptr;
+            options.jobs = static_cast<unsigned>(std::strtoul(v, &end, 10));
+            if (end == v || *end != '\0')
+            {
+                fprintf(stderr, "Invalid job count '%s'\n", v);
+                return false;
+            }
+        }
+        else if (arg[0] != '-')
+        {
+            options.paths.push_back(arg);
+        }
+        else
+        {
+            options.paths.clear();
+            break;
+        }
+    }
+    if (options.paths.empty())
+    {
+        fprintf(stderr, "usage: tytest [--obj | --llvm | --ir | --vm] [-j N] [--cxx=<compiler>] [--cache=<dir> | --no-cache]\n"
+                        "              [--temp=<dir>] [--keep] <file.tytest | directory>...\n");
+        return false;
+    }
+    return true;
+}
+
+char const* to_string(TestStatus status)
+{
+    switch (status)
+    {
+    case TestStatus::pass:  return "PASS";
+    case TestStatus::skip:  return "SKIP";
+    default:                return "FAIL";
+    }
+}
+
+} // namespace
+
+//! Runs .tytest files on all cores, compiling each sample in-process and building the
+//! checker and expected program with the external toolchain only when they aren't cached.
+//! Prints one line per test as it finishes and exits with 1 if any test failed.
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+    std::vector<std::string> paths;
+    for (auto const& path : options.paths)
+    {
+        if (!find_tests(path, paths))
+        {
+            fprintf(stderr, "[ERROR] Not a file or directory: %s\n", path.c_str());
+            return 1;
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::unique_ptr<CompileCache> cache;
+    if (!options.cache_directory.empty() && options.test.mode != TestMode::vm)
+    {
+        try
+        {
+            // Objects, bitcode and program output alike, so no format-specific extension
+            cache = std::make_unique<CompileCache>(options.cache_directory, options.cache_bytes, ".bin");
+        }
+        catch (CacheException const& e)
+        {
+            fprintf(stderr, "[ERROR] %s\n", e.what());
+            return 1;
+        }
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    auto const jobs = options.jobs ? options.jobs : ThreadPool::default_threads() + 1;
+    TestRunner runner{ options.test, cache.get() };
+    std::vector<TestResult> results(paths.size());
+    std::mutex print_mutex;
+    ThreadPool pool{ jobs - 1 };
+    pool.parallel_for(paths.size(), [&](size_t i, unsigned)
+    {
+        auto& result = results[i];
+        try
+        {
+            result = runner.run(load_test(paths[i]));
+        }
+        catch (TestException const& e)
+        {
+            result.message = e.m_message;
+        }
+        std::lock_guard<std::mutex> lock{ print_mutex };
+        printf("[%s] %s (%.1f ms, %zu cached)\n", to_string(result.status), paths[i].c_str(), result.seconds * 1e3, result.cached);
+        if (!result.message.empty())
+        {
+            printf("       %s\n", result.message.c_str());
+        }
+        if (!result.directory.empty())
+        {
+            printf("       kept %s\n", result.directory.c_str());
+        }
+        fflush(stdout);
+    }, 1);
+
+    size_t counts[3] = {};
+    for (auto const& result : results)
+    {
+        ++counts[static_cast<int>(result.status)];
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto const c = runner.cache_stats();
+    printf("; %zu passed, %zu failed, %zu skipped in %.1f ms on %u threads; cache: %zu hits, %zu misses\n",
+        counts[static_cast<int>(TestStatus::pass)], counts[static_cast<int>(TestStatus::fail)],
+        counts[static_cast<int>(TestStatus::skip)], elapsed * 1e3, jobs, c.hits, c.misses);
+    return counts[static_cast<int>(TestStatus::fail)] ? 1 : 0;
+}
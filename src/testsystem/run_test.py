@@ -2,7 +2,7 @@ import sys, os
 import xml.etree.ElementTree as ET
 import shutil, subprocess, filecmp
 
-assert sys.version_info >= (3,1)
+assert sys.version_info >= (3,5)
 assert len(sys.argv) >= 2
 
 include_dir0 = "F:\\Microsoft visual Studio 2014\\VC\\include"
@@ -28,6 +28,8 @@ def run_test_from_file(test_file):
 	sample = {}
 	expected = {}
 	checker = {}
+	run = None
+	error = None
 	for child in root:
 		if child.tag == 'sample':
 			sample = child.text
@@ -35,10 +37,21 @@ def run_test_from_file(test_file):
 			expected = child.text
 		if child.tag == 'checker':
 			checker = child.text
+		if child.tag == 'run':
+			run = child.text
+		if child.tag == 'error':
+			error = child.text
 	assert sample
+	if error is not None:
+		return run_test_expecting_error(test_file, sample, error)
 	assert expected
 	assert checker
 
+	if use_vm:
+		return run_test_on_vm(test_file, sample, run)
+	if use_obj:
+		return run_test_with_objects(test_file, sample, expected, checker)
+
 	if not os.path.isdir('tmp'):
 		os.mkdir('tmp')
 	with open('tmp/sample.ty', 'w') as text_file:
@@ -64,10 +77,15 @@ def run_test_from_file(test_file):
 	# subprocess.call(['clang++', '-emit-llvm', '-I', include_dir0, '-I', include_dir1, '-S', 'tmp/expected.c', '-o', 'tmp/expected.s'])
 	subprocess.call(['llvm-as', 'tmp/expected.s', '-o', 'tmp/expected.bc'])
 
-	print("[OK] Executing " + compilerpath + " tmp/sample.ty > sample.s")
-	with open('tmp/sample.s', 'w') as outfile:
-		subprocess.call([compilerpath, 'tmp/sample.ty'], stdout=outfile)
-	subprocess.call(['llvm-as', 'tmp/sample.s', '-o', 'tmp/sample.bc'])
+	if use_bc:
+		print("[OK] Executing " + compilerpath + " --emit=bc tmp/sample.ty > sample.bc")
+		with open('tmp/sample.bc', 'wb') as outfile:
+			subprocess.call([compilerpath, '--emit=bc', 'tmp/sample.ty'], stdout=outfile)
+	else:
+		print("[OK] Executing " + compilerpath + " tmp/sample.ty > sample.s")
+		with open('tmp/sample.s', 'w') as outfile:
+			subprocess.call([compilerpath, 'tmp/sample.ty'], stdout=outfile)
+		subprocess.call(['llvm-as', 'tmp/sample.s', '-o', 'tmp/sample.bc'])
 
 	subprocess.call(['llvm-link', 'tmp/sample.bc', 'tmp/checker.bc', '-o', 'tmp/actual.bc'])
 	subprocess.call(['llvm-link', 'tmp/expected.bc', 'tmp/checker.bc', '-o', 'tmp/expected.bc'])
@@ -89,6 +107,91 @@ def run_test_from_file(test_file):
 
 	return 0
 
+def output_lines(text):
+	return [line.strip() for line in (text or '').splitlines() if line.strip()]
+
+# Runs the sample on tyx's bytecode VM and compares what it prints with the <run> section,
+# without invoking clang or the LLVM tools
+def run_test_on_vm(test_file, sample, run):
+	if run is None:
+		print('[SKIP] ' + test_file + ' (no <run> section)')
+		return 0
+
+	if not os.path.isdir('tmp'):
+		os.mkdir('tmp')
+	with open('tmp/sample.ty', 'w') as text_file:
+		text_file.write(sample)
+
+	compilerpath = find_compiler("..")
+	if compilerpath == '':
+		compilerpath = find_compiler("../..")
+	assert compilerpath != ''
+
+	result = subprocess.run([compilerpath, 'run', 'tmp/sample.ty'], stdout=subprocess.PIPE, universal_newlines=True)
+	if result.returncode == 0 and output_lines(result.stdout) == output_lines(run):
+		print('[PASS] ' + test_file)
+		shutil.rmtree('tmp')
+	else:
+		print('[FAIL] ' + test_file)
+		print(result.stdout)
+	return 0
+
+# Compiles a sample that must fail, with every line of the <error> section in tyx's messages
+def run_test_expecting_error(test_file, sample, error):
+	if not os.path.isdir('tmp'):
+		os.mkdir('tmp')
+	with open('tmp/sample.ty', 'w') as text_file:
+		text_file.write(sample)
+
+	compilerpath = find_compiler("..")
+	if compilerpath == '':
+		compilerpath = find_compiler("../..")
+	assert compilerpath != ''
+
+	result = subprocess.run([compilerpath, 'tmp/sample.ty'], stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+	if result.returncode != 0 and all(line in result.stderr for line in output_lines(error)):
+		print('[PASS] ' + test_file)
+		shutil.rmtree('tmp')
+	else:
+		print('[FAIL] ' + test_file)
+		print(result.stderr)
+	return 0
+
+# Links the sample's ELF object and the expected code each with the checker using the
+# system C++ compiler, which also builds them in the LLVM path, and compares the outputs
+def run_test_with_objects(test_file, sample, expected, checker):
+	if not os.path.isdir('tmp'):
+		os.mkdir('tmp')
+	with open('tmp/sample.ty', 'w') as text_file:
+		text_file.write(sample)
+	with open('tmp/expected.c', 'w') as text_file:
+		text_file.write(expected)
+	with open('tmp/checker.c', 'w') as text_file:
+		text_file.write(checker)
+
+	compilerpath = find_compiler("..")
+	if compilerpath == '':
+		compilerpath = find_compiler("../..")
+	assert compilerpath != ''
+
+	with open('tmp/sample.o', 'wb') as outfile:
+		subprocess.call([compilerpath, '--emit=obj', 'tmp/sample.ty'], stdout=outfile)
+	subprocess.call(['c++', '-x', 'c++', 'tmp/checker.c', '-x', 'none', 'tmp/sample.o', '-o', 'tmp/actual'])
+	subprocess.call(['c++', '-x', 'c++', 'tmp/checker.c', 'tmp/expected.c', '-o', 'tmp/expected'])
+
+	with open('tmp/expected.out', 'w') as outfile:
+		subprocess.call(['tmp/expected'], stdout=outfile)
+	with open('tmp/actual.out', 'w') as outfile:
+		subprocess.call(['tmp/actual'], stdout=outfile)
+
+	if filecmp.cmp('tmp/actual.out', 'tmp/expected.out', shallow=False):
+		print('[PASS] ' + test_file)
+		shutil.rmtree('tmp')
+	else:
+		print('[FAIL] ' + test_file)
+		subprocess.call(['diff', 'tmp/actual.out', 'tmp/expected.out'])
+	return 0
+
 def run_test_from_dir(test_dir):
 	print("[OK] Emumerating test directory: " + str(input))
 	for subdir, dirs, files in os.walk(test_dir):
@@ -98,8 +201,15 @@ def run_test_from_dir(test_dir):
 				run_test_from_file(filepath)
 	return 0
 
+# --vm: run samples with 'tyx run' instead of compiling them with clang
+use_vm = '--vm' in sys.argv
+# --obj: link samples compiled with 'tyx --emit=obj' with the system toolchain
+use_obj = '--obj' in sys.argv
+# --bc: have tyx emit bitcode with --emit=bc instead of assembling its textual IR
+use_bc = '--bc' in sys.argv
+
 if __name__ == '__main__':
-	input = sys.argv[1]
+	input = [arg for arg in sys.argv[1:] if arg not in ('--vm', '--obj', '--bc')][0]
 
 	if os.path.isfile(input):
 		run_test_from_file(input)
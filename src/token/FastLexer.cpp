@@ -0,0 +1,457 @@
+#include "FastLexer.h"
+#include "LexerDfa.h"
+
+#include <cstring>
+#include <cppcoretools/print.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TY_LEXER_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define TY_LEXER_X86 0
+#endif
+
+#if TY_LEXER_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TY_TARGET_AVX2 __attribute__((target("avx2")))
+#define TY_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define TY_TARGET_AVX2
+#define TY_FORCE_INLINE __forceinline
+#else
+#define TY_TARGET_AVX2
+#define TY_FORCE_INLINE inline
+#endif
+
+namespace ty
+{
+
+namespace
+{
+
+struct CharClassTable
+{
+    uint8_t         cls[256];
+    LexItem::Type   punct[256];
+
+    CharClassTable()
+    {
+        std::memset(cls, CC_INVALID, sizeof(cls));
+        for (auto& p : punct) { p = LexItem::Type::UNKNOWN; }
+
+        for (char const* c = " \t\n\v\f\r"; *c; ++c) { cls[uint8_t(*c)] = CC_SPACE; }
+        for (int c = '0'; c <= '9'; ++c) { cls[c] = CC_DIGIT; }
+        for (int c = 'a'; c <= 'z'; ++c) { cls[c] = CC_ALPHA; }
+        for (int c = 'A'; c <= 'Z'; ++c) { cls[c] = CC_ALPHA; }
+
+        // A lexeme no other one extends is a CC_PUNCT byte; the rest start at CC_OPERATOR bytes
+        for (auto const& t : token_spec)
+        {
+            if (t.lexeme && t.lexeme[0] && !t.lexeme[1])
+            {
+                add_punct(t.lexeme[0], t.type);
+            }
+        }
+        for (auto const& t : token_spec)
+        {
+            if (t.lexeme && t.lexeme[0] && t.lexeme[1])
+            {
+                cls[uint8_t(t.lexeme[0])] = CC_OPERATOR;
+            }
+        }
+    }
+
+    void add_punct(char c, LexItem::Type t)
+    {
+        cls[uint8_t(c)] = CC_PUNCT;
+        punct[uint8_t(c)] = t;
+    }
+};
+
+CharClassTable const& table()
+{
+    static CharClassTable const t;
+    return t;
+}
+
+inline unsigned first_set_bit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+//! Run scanners return the first byte at or after 'p' that is not in the run.
+//! They may read up to source_padding bytes past the end of the source.
+struct ScalarScanner
+{
+    static char const* skip_space(char const* p) { return skip(p, CC_SPACE); }
+    static char const* skip_digits(char const* p) { return skip(p, CC_DIGIT); }
+    static char const* skip_alnum(char const* p) { return skip(p, CC_ALNUM); }
+
+    static char const* skip(char const* p, uint8_t mask)
+    {
+        auto const* cls = table().cls;
+        while (cls[uint8_t(*p)] & mask) { ++p; }
+        return p;
+    }
+};
+
+#if TY_LEXER_X86
+
+struct Sse2Scanner
+{
+    static __m128i space_mask(__m128i v)
+    {
+        auto const blank = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        auto const ctrl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+        return _mm_or_si128(blank, ctrl);
+    }
+
+    static __m128i digit_mask(__m128i v)
+    {
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    }
+
+    static __m128i alnum_mask(__m128i v)
+    {
+        auto const lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        auto const alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+        return _mm_or_si128(alpha, digit_mask(v));
+    }
+
+    template <typename Predicate>
+    static char const* skip(char const* p, Predicate pred)
+    {
+        while (1)
+        {
+            auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+            auto const outside = ~uint32_t(_mm_movemask_epi8(pred(v))) & 0xFFFFu;
+            if (outside)
+            {
+                return p + first_set_bit(outside);
+            }
+            p += 16;
+        }
+    }
+
+    static char const* skip_space(char const* p) { return skip(p, space_mask); }
+    static char const* skip_digits(char const* p) { return skip(p, digit_mask); }
+    static char const* skip_alnum(char const* p) { return skip(p, alnum_mask); }
+};
+
+struct Avx2Scanner
+{
+    TY_TARGET_AVX2 static __m256i digit_mask(__m256i v)
+    {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    }
+
+    TY_TARGET_AVX2 static char const* skip_space(char const* p)
+    {
+        while (1)
+        {
+            auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+            auto const blank = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+            auto const ctrl = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+            auto const outside = ~uint32_t(_mm256_movemask_epi8(_mm256_or_si256(blank, ctrl)));
+            if (outside)
+            {
+                return p + first_set_bit(outside);
+            }
+            p += 32;
+        }
+    }
+
+    TY_TARGET_AVX2 static char const* skip_digits(char const* p)
+    {
+        while (1)
+        {
+            auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+            auto const outside = ~uint32_t(_mm256_movemask_epi8(digit_mask(v)));
+            if (outside)
+            {
+                return p + first_set_bit(outside);
+            }
+            p += 32;
+        }
+    }
+
+    TY_TARGET_AVX2 static char const* skip_alnum(char const* p)
+    {
+        while (1)
+        {
+            auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+            auto const lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+            auto const alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+            auto const outside = ~uint32_t(_mm256_movemask_epi8(_mm256_or_si256(alpha, digit_mask(v))));
+            if (outside)
+            {
+                return p + first_set_bit(outside);
+            }
+            p += 32;
+        }
+    }
+};
+
+bool cpu_supports_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool const osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // TY_LEXER_X86
+
+constexpr LexerDfaTable lexer_dfa{ lexer_dfa_builder };
+
+//! Walks the DFA from 'p' and stops at the end of the longest token, for lexemes sharing
+//! a prefix where the last state reached is not a token of its own
+//! \returns the end of the token, whose accept code is in 'code', or null if no token starts at 'p'
+char const* longest_match(char const* p, uint8_t& code)
+{
+    char const* last = nullptr;
+    for (auto state = lexer_dfa.next[dfa_start][uint8_t(*p)]; state != dfa_dead; state = lexer_dfa.next[state][uint8_t(*p)])
+    {
+        ++p;
+        if (lexer_dfa.accept[state] != dfa_reject)
+        {
+            code = lexer_dfa.accept[state];
+            last = p;
+        }
+    }
+    return last;
+}
+
+//! Lexes [begin, end) with the DFA alone: a token ends at the first byte its state has no
+//! transition for, which '\0' never has. Only the slow path, longest_match(), backtracks.
+void lex_dfa(TokenList& list, char const* const begin, char const* const end)
+{
+    auto const* p = begin;
+    while (1)
+    {
+        auto const* b = p;
+        auto state = lexer_dfa.next[dfa_start][uint8_t(*p)];
+        if (state == dfa_dead)
+        {
+            if (p == end)
+            {
+                break;
+            }
+            throw TokenException{ size_t(p - begin) };
+        }
+        ++p;
+        while (auto const s = lexer_dfa.next[state][uint8_t(*p)])
+        {
+            state = s;
+            ++p;
+        }
+        auto code = lexer_dfa.accept[state];
+        if (code == dfa_skip)
+        {
+            continue;
+        }
+        if (code == dfa_reject && !(p = longest_match(b, code)))
+        {
+            throw TokenException{ size_t(b - begin) };
+        }
+        list.emplace_back(static_cast<LexItem::Type>(code), b, p);
+    }
+}
+
+//! Lexes [begin, end) into 'list'. *end and the following source_padding bytes must be '\0'.
+template <typename Scanner>
+TY_FORCE_INLINE void lex_runs(TokenList& list, char const* const begin, char const* const end)
+{
+    auto const& t = table();
+    auto const* p = begin;
+    while (1)
+    {
+        auto const c = uint8_t(*p);
+        auto const cls = t.cls[c];
+        if (cls & CC_SPACE)
+        {
+            p = Scanner::skip_space(p + 1);
+        }
+        else if (cls & CC_ALPHA)
+        {
+            auto const* b = p;
+            p = Scanner::skip_alnum(p + 1);
+            list.emplace_back(LexItem::Type::ID, b, p);
+        }
+        else if (cls & CC_DIGIT)
+        {
+            auto const* b = p;
+            p = Scanner::skip_digits(p + 1);
+            list.emplace_back(LexItem::Type::NUM, b, p);
+        }
+        else if (cls & CC_PUNCT)
+        {
+            list.emplace_back(t.punct[c], p, p + 1);
+            ++p;
+        }
+        else if (cls & CC_OPERATOR)
+        {
+            auto const* b = p;
+            uint8_t code = dfa_reject;
+            p = longest_match(p, code);
+            if (!p)
+            {
+                throw TokenException{ size_t(b - begin) };
+            }
+            list.emplace_back(static_cast<LexItem::Type>(code), b, p);
+        }
+        else if (p == end)
+        {
+            break;
+        }
+        else
+        {
+            throw TokenException{ size_t(p - begin) };
+        }
+    }
+}
+
+#if TY_LEXER_X86
+
+void lex_sse2(TokenList& list, char const* begin, char const* end)
+{
+    lex_runs<Sse2Scanner>(list, begin, end);
+}
+
+//! Compiled for AVX2 as a whole so the scanners inline into the token loop
+TY_TARGET_AVX2 void lex_avx2(TokenList& list, char const* begin, char const* end)
+{
+    lex_runs<Avx2Scanner>(list, begin, end);
+}
+
+#endif // TY_LEXER_X86
+
+} // namespace
+
+uint8_t const* char_class_table()
+{
+    return table().cls;
+}
+
+LexItem::Type punct_type(unsigned char c)
+{
+    return table().punct[c];
+}
+
+bool is_engine_supported(LexerEngine engine)
+{
+    switch (engine)
+    {
+#if TY_LEXER_X86
+    case LexerEngine::sse2: return true;
+    case LexerEngine::avx2: return cpu_supports_avx2();
+#else
+    case LexerEngine::sse2:
+    case LexerEngine::avx2: return false;
+#endif
+    default: return true;
+    }
+}
+
+LexerEngine resolve_engine(LexerEngine engine)
+{
+    if (engine != LexerEngine::automatic)
+    {
+        return engine;
+    }
+    // tylang runs are a few bytes long, so a 16 or 32-byte vector load rarely skips more
+    // than the table loop would; on tybench's corpus table beats sse2 and avx2 by 5-20%
+    return LexerEngine::table;
+}
+
+char const* to_string(LexerEngine engine)
+{
+    switch (engine)
+    {
+    case LexerEngine::reference: return "reference";
+    case LexerEngine::table: return "table";
+    case LexerEngine::sse2: return "sse2";
+    case LexerEngine::avx2: return "avx2";
+    case LexerEngine::dfa: return "dfa";
+    case LexerEngine::automatic: return "auto";
+    case LexerEngine::checked: return "checked";
+    default: return "unknown";
+    }
+}
+
+bool engine_from_string(char const* name, LexerEngine& engine)
+{
+    for (auto e : { LexerEngine::reference, LexerEngine::table, LexerEngine::sse2, LexerEngine::avx2, LexerEngine::dfa, LexerEngine::automatic, LexerEngine::checked })
+    {
+        if (std::strcmp(name, to_string(e)) == 0)
+        {
+            engine = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+void lex_into(TokenList& list, LexerEngine engine)
+{
+    CCT_CHECK(is_engine_supported(engine));
+
+    auto const* begin = list.buffer().begin();
+    auto const* end = list.buffer().end();
+
+    switch (engine)
+    {
+#if TY_LEXER_X86
+    case LexerEngine::sse2: lex_sse2(list, begin, end); break;
+    case LexerEngine::avx2: lex_avx2(list, begin, end); break;
+#endif
+    case LexerEngine::dfa: lex_dfa(list, begin, end); break;
+    default: lex_runs<ScalarScanner>(list, begin, end); break;
+    }
+
+    list.emplace_back(LexItem::Type::eof, "", "" + 1);
+}
+
+long long first_token_mismatch(TokenList const& a, TokenList const& b)
+{
+    auto const n = a.size() < b.size() ? a.size() : b.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto const& x = a[i];
+        auto const& y = b[i];
+        if (x.type != y.type)
+        {
+            return static_cast<long long>(i);
+        }
+        if (x.type == LexItem::Type::eof)
+        {
+            continue;
+        }
+        auto const len = x.end - x.begin;
+        if (len != y.end - y.begin || std::memcmp(x.begin, y.begin, len) != 0)
+        {
+            return static_cast<long long>(i);
+        }
+    }
+    return a.size() == b.size() ? -1 : static_cast<long long>(n);
+}
+
+} // namespace ty
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "TokenList.h"
+#include <cstdint>
+
+namespace ty
+{
+
+//! Bit flags describing what a byte can start or continue
+enum CharClass : uint8_t
+{
+    CC_INVALID  = 0x00,
+    CC_SPACE    = 0x01,
+    CC_DIGIT    = 0x02,
+    CC_ALPHA    = 0x04,
+    CC_PUNCT    = 0x08,     //!< Single-character token, see punct_type()
+    CC_OPERATOR = 0x10,     //!< First byte of a lexeme of two or more bytes, such as '->'; matched with the lexer DFA
+    CC_ALNUM    = CC_DIGIT | CC_ALPHA
+};
+
+//! 256-entry table mapping each byte to its CharClass flags.
+//! Only ASCII is classified; every byte >= 0x80 is CC_INVALID.
+uint8_t const* char_class_table();
+
+//! Returns the token type for a byte whose class is CC_PUNCT
+LexItem::Type punct_type(unsigned char c);
+
+//! Returns true if the running CPU (and OS) support the given engine
+bool is_engine_supported(LexerEngine engine);
+
+//! Resolves LexerEngine::automatic to the fastest engine measured, which is table
+LexerEngine resolve_engine(LexerEngine engine);
+
+//! Parses a name such as "avx2" into an engine.
+//! \returns false if 'name' is not a known engine
+bool engine_from_string(char const* name, LexerEngine& engine);
+
+char const* to_string(LexerEngine engine);
+
+//! Appends the tokens of list.buffer(), followed by eof, using the character-class
+//! table and the run scanner of 'engine'. The sentinel padding of SourceBuffer
+//! ('\0' is CC_INVALID) terminates every run without bounds checks.
+//! \pre engine is one of table, sse2, avx2 or dfa and is supported by the CPU
+void lex_into(TokenList& list, LexerEngine engine);
+
+//! Compares two token lists by type and lexeme.
+//! \returns the index of the first mismatching token, or -1 if they are identical
+long long first_token_mismatch(TokenList const& a, TokenList const& b);
+
+//! Thrown by LexerEngine::checked when the fast path disagrees with tokenize_reference
+struct TokenMismatchException : public TokenException
+{
+    long long index;
+
+    TokenMismatchException(long long i, size_t at) : TokenException{ at }, index{ i } {}
+
+    char const* what() const override
+    {
+        return "Token mismatch between fast and reference lexers";
+    }
+};
+
+} // namespace ty
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "TokenList.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace ty
+{
+
+//! Reserved states and accept codes of the lexer DFA
+constexpr uint8_t dfa_dead = 0;         //!< Every missing transition leads here: the token ends
+constexpr uint8_t dfa_start = 1;
+constexpr uint8_t dfa_reject = 0xFF;    //!< accept code of a state inside a lexeme that isn't a token itself
+constexpr uint8_t dfa_skip = 0xFE;      //!< accept code of whitespace, which makes no token
+
+constexpr bool dfa_space(unsigned c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+constexpr bool dfa_digit(unsigned c) { return c >= '0' && c <= '9'; }
+constexpr bool dfa_alpha(unsigned c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+
+//! Builds the DFA of TY_TOKEN_SPEC at compile time: one state per character class rule
+//! (whitespace, NUM, ID), then a trie of the fixed lexemes, then merges states whose accept
+//! codes and transitions are identical until none are left, which makes the trie, and so
+//! the DFA, minimal.
+struct LexerDfaBuilder
+{
+    //! Bound while building; LexerDfa keeps only the states left after merging
+    static constexpr size_t max_states = 64;
+
+    uint8_t next[max_states][256];
+    uint8_t accept[max_states];
+    bool    merged[max_states];
+    size_t  size;
+    bool    valid;      //!< False if a lexeme is empty, repeated or not punctuation, or there are too many
+
+    constexpr LexerDfaBuilder()
+        : next{}, accept{}, merged{}, size{ 2 }, valid{ true }
+    {
+        accept[dfa_dead] = dfa_reject;
+        accept[dfa_start] = dfa_reject;
+        auto const space = add_state(dfa_skip);
+        auto const num = add_state(static_cast<uint8_t>(LexItem::Type::NUM));
+        auto const id = add_state(static_cast<uint8_t>(LexItem::Type::ID));
+        for (unsigned c = 0; c < 256; ++c)
+        {
+            if (dfa_space(c))
+            {
+                next[dfa_start][c] = space;
+                next[space][c] = space;
+            }
+            if (dfa_digit(c))
+            {
+                next[dfa_start][c] = num;
+                next[num][c] = num;
+                next[id][c] = id;
+            }
+            if (dfa_alpha(c))
+            {
+                next[dfa_start][c] = id;
+                next[id][c] = id;
+            }
+        }
+        for (auto const& t : token_spec)
+        {
+            if (t.lexeme)
+            {
+                add_lexeme(t.lexeme, static_cast<uint8_t>(t.type));
+            }
+        }
+        minimize();
+    }
+
+    constexpr size_t live_states() const
+    {
+        size_t n = 0;
+        for (size_t s = 0; s < size; ++s)
+        {
+            n += !merged[s];
+        }
+        return n;
+    }
+
+private:
+    constexpr uint8_t add_state(uint8_t code)
+    {
+        if (size == max_states)
+        {
+            valid = false;
+            return dfa_dead;
+        }
+        accept[size] = code;
+        return static_cast<uint8_t>(size++);
+    }
+
+    constexpr void add_lexeme(char const* lexeme, uint8_t code)
+    {
+        auto s = dfa_start;
+        for (auto const* p = lexeme; *p; ++p)
+        {
+            auto const c = static_cast<uint8_t>(*p);
+            if (c <= ' ' || c >= 0x7F || dfa_digit(c) || dfa_alpha(c))
+            {
+                valid = false;
+                return;
+            }
+            if (next[s][c] == dfa_dead)
+            {
+                auto const t = add_state(dfa_reject);
+                if (t == dfa_dead)
+                {
+                    return;
+                }
+                next[s][c] = t;
+            }
+            s = next[s][c];
+        }
+        if (s == dfa_start || accept[s] != dfa_reject)
+        {
+            valid = false;
+            return;
+        }
+        accept[s] = code;
+    }
+
+    constexpr bool equivalent(size_t a, size_t b) const
+    {
+        if (accept[a] != accept[b])
+        {
+            return false;
+        }
+        for (unsigned c = 0; c < 256; ++c)
+        {
+            if (next[a][c] != next[b][c])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr void minimize()
+    {
+        for (auto changed = true; changed; )
+        {
+            changed = false;
+            for (size_t a = dfa_start + 1; a < size; ++a)
+            {
+                for (size_t b = a + 1; b < size && !merged[a]; ++b)
+                {
+                    if (merged[b] || !equivalent(a, b))
+                    {
+                        continue;
+                    }
+                    merged[b] = true;
+                    changed = true;
+                    for (size_t s = 0; s < size; ++s)
+                    {
+                        for (unsigned c = 0; c < 256; ++c)
+                        {
+                            if (next[s][c] == b)
+                            {
+                                next[s][c] = static_cast<uint8_t>(a);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+//! The DFA of LexerDfaBuilder with its merged states removed. accept[s] is the
+//! LexItem::Type of the token ending in state s, dfa_skip or dfa_reject.
+template <size_t N>
+struct LexerDfa
+{
+    uint8_t next[N][256];
+    uint8_t accept[N];
+
+    constexpr explicit LexerDfa(LexerDfaBuilder const& b)
+        : next{}, accept{}
+    {
+        uint8_t id[LexerDfaBuilder::max_states]{};
+        size_t n = 0;
+        for (size_t s = 0; s < b.size; ++s)
+        {
+            if (!b.merged[s])
+            {
+                id[s] = static_cast<uint8_t>(n++);
+            }
+        }
+        for (size_t s = 0; s < b.size; ++s)
+        {
+            if (b.merged[s])
+            {
+                continue;
+            }
+            accept[id[s]] = b.accept[s];
+            for (unsigned c = 0; c < 256; ++c)
+            {
+                next[id[s]][c] = id[b.next[s][c]];
+            }
+        }
+    }
+};
+
+constexpr LexerDfaBuilder lexer_dfa_builder{};
+static_assert(lexer_dfa_builder.valid, "TY_TOKEN_SPEC lexemes must be distinct, non-empty and punctuation only");
+
+using LexerDfaTable = LexerDfa<lexer_dfa_builder.live_states()>;
+
+} // namespace ty
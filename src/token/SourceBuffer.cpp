@@ -0,0 +1,192 @@
+#include "SourceBuffer.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ty
+{
+
+namespace
+{
+
+size_t page_size()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+//! Returns the size of the regular file at 'path'
+//! \throws SourceException if there is none (e.g. 'path' names a directory)
+size_t file_size(char const* path)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attributes))
+    {
+        throw SourceException{ std::string{ "Cannot open " } + path };
+    }
+    if (attributes.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_DEVICE))
+    {
+        throw SourceException{ std::string{ path } + " is not a regular file" };
+    }
+    return static_cast<size_t>((static_cast<unsigned long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow);
+#else
+    struct stat st;
+    if (::stat(path, &st) != 0)
+    {
+        throw SourceException{ std::string{ "Cannot open " } + path };
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        throw SourceException{ std::string{ path } + " is not a regular file" };
+    }
+    return static_cast<size_t>(st.st_size);
+#endif
+}
+
+//! Reads 'path' up to its end; 'size' is only the expected size, the file may
+//! have changed since it was taken
+std::string read_file(char const* path, size_t size)
+{
+    std::string text;
+    text.reserve(size + source_padding);
+
+    auto* f = std::fopen(path, "rb");
+    if (!f)
+    {
+        throw SourceException{ std::string{ "Cannot open " } + path };
+    }
+    char chunk[65536];
+    size_t read;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+    {
+        text.append(chunk, read);
+    }
+    auto const failed = std::ferror(f) != 0;
+    std::fclose(f);
+    if (failed)
+    {
+        throw SourceException{ std::string{ "Cannot read " } + path };
+    }
+    return text;
+}
+
+} // namespace
+
+bool MappedSource::can_map(size_t size)
+{
+    // The OS zero-fills the remainder of the last mapped page, which provides the padding
+    auto const tail = size % page_size();
+    return size > 0 && tail != 0 && page_size() - tail >= source_padding;
+}
+
+#ifdef _WIN32
+
+MappedSource::MappedSource(char const* path)
+{
+    auto const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw SourceException{ std::string{ "Cannot open " } + path };
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || !can_map(static_cast<size_t>(size.QuadPart)))
+    {
+        CloseHandle(file);
+        throw SourceException{ std::string{ "Cannot map " } + path };
+    }
+
+    auto const mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        throw SourceException{ std::string{ "Cannot map " } + path };
+    }
+
+    // The view keeps the mapping object alive
+    auto const* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view)
+    {
+        throw SourceException{ std::string{ "Cannot map " } + path };
+    }
+
+    m_data = static_cast<char const*>(view);
+    m_size = static_cast<size_t>(size.QuadPart);
+}
+
+MappedSource::~MappedSource()
+{
+    UnmapViewOfFile(m_data);
+}
+
+#else
+
+MappedSource::MappedSource(char const* path)
+{
+    auto const fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        throw SourceException{ std::string{ "Cannot open " } + path };
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || !can_map(static_cast<size_t>(st.st_size)))
+    {
+        ::close(fd);
+        throw SourceException{ std::string{ "Cannot map " } + path };
+    }
+
+    auto const size = static_cast<size_t>(st.st_size);
+    auto* view = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        throw SourceException{ std::string{ "Cannot map " } + path };
+    }
+    ::madvise(view, size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<char const*>(view);
+    m_size = size;
+}
+
+MappedSource::~MappedSource()
+{
+    ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+#endif
+
+std::unique_ptr<SourceBuffer const> load_source(char const* path)
+{
+    auto const size = file_size(path);
+    if (MappedSource::can_map(size))
+    {
+        try
+        {
+            return std::make_unique<MappedSource>(path);
+        }
+        catch (SourceException const&)
+        {
+            // The file changed since file_size() or can't be mapped; reading still works
+        }
+    }
+    return std::make_unique<StringSource>(read_file(path, size));
+}
+
+} // namespace ty
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+
+namespace ty
+{
+
+//! Number of '\0' bytes every SourceBuffer guarantees to be readable past its end.
+//! Lexers use them as sentinels so run scanning never needs a bounds check.
+constexpr size_t source_padding = 64;
+
+struct SourceException : public std::exception
+{
+    explicit SourceException(std::string msg) : m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    std::string m_message;
+};
+
+//! Read-only source text, followed by at least source_padding '\0' bytes
+class SourceBuffer
+{
+public:
+    virtual ~SourceBuffer() = default;
+
+    char const* data() const noexcept { return m_data; }
+    size_t size() const noexcept { return m_size; }
+
+    char const* begin() const noexcept { return m_data; }
+    char const* end() const noexcept { return m_data + m_size; }
+
+protected:
+    SourceBuffer() = default;
+    SourceBuffer(SourceBuffer const&) = delete;
+    SourceBuffer& operator=(SourceBuffer const&) = delete;
+
+    char const* m_data = nullptr;
+    size_t      m_size = 0;
+};
+
+//! Owning source buffer, used for text that doesn't come from a file (e.g. command-line input)
+class StringSource : public SourceBuffer
+{
+public:
+    explicit StringSource(std::string text)
+        : m_text{ std::move(text) }
+    {
+        m_size = m_text.size();
+        m_text.append(source_padding, '\0');
+        m_data = m_text.data();
+    }
+
+    //! Replaces [offset, offset + removed) of the text with [text, text + size), keeping the padding
+    void replace(size_t offset, size_t removed, char const* text, size_t size)
+    {
+        m_text.replace(offset, removed, text, size);
+        m_size = m_size - removed + size;
+        m_data = m_text.data();
+    }
+
+private:
+    std::string m_text;
+};
+
+//! Read-only memory mapping of a file. The text is never copied.
+//! \pre the file must not end within source_padding bytes of a page boundary,
+//!      see load_source() for the general case
+class MappedSource : public SourceBuffer
+{
+public:
+    //! \throws SourceException if the file can't be opened or mapped
+    explicit MappedSource(char const* path);
+
+    ~MappedSource() override;
+
+    //! Returns true if a file of 'size' bytes can be mapped with the padding guarantee
+    static bool can_map(size_t size);
+};
+
+//! Loads 'path' as a MappedSource where possible, falling back to a single
+//! read into a StringSource for empty files, files ending too close to a page boundary,
+//! or files that can't be mapped.
+//! \throws SourceException if 'path' isn't a regular file or can't be read
+std::unique_ptr<SourceBuffer const> load_source(char const* path);
+
+} // namespace ty
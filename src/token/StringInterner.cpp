@@ -0,0 +1,116 @@
+#include "StringInterner.h"
+
+namespace ty
+{
+
+namespace
+{
+
+constexpr size_t chunk_size = 64 * 1024;
+
+constexpr size_t initial_slots = 1024;
+
+} // namespace
+
+StringInterner::StringInterner()
+    : m_slots(initial_slots, invalid_symbol)
+{
+    m_entries.reserve(initial_slots / 2);
+}
+
+uint32_t StringInterner::hash(char const* data, size_t size)
+{
+    // FNV-1a; identifiers are short so a simple byte loop is hard to beat
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+    return h;
+}
+
+size_t StringInterner::probe(char const* data, size_t size, uint32_t h) const
+{
+    auto const mask = m_slots.size() - 1;
+    for (auto slot = h & mask; ; slot = (slot + 1) & mask)
+    {
+        auto const id = m_slots[slot];
+        if (id == invalid_symbol)
+        {
+            return slot;
+        }
+        auto const& e = m_entries[id];
+        if (e.hash == h && e.size == size && std::memcmp(e.data, data, size) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+SymbolId StringInterner::find(char const* data, size_t size) const
+{
+    return m_slots[probe(data, size, hash(data, size))];
+}
+
+SymbolId StringInterner::intern(char const* data, size_t size)
+{
+    auto const h = hash(data, size);
+    auto const slot = probe(data, size, h);
+    if (m_slots[slot] != invalid_symbol)
+    {
+        return m_slots[slot];
+    }
+
+    auto const id = static_cast<SymbolId>(m_entries.size());
+    m_entries.push_back(Entry{ store(data, size), static_cast<uint32_t>(size), h });
+    m_slots[slot] = id;
+
+    // Keep the load factor at or below 1/2
+    if (m_entries.size() * 2 > m_slots.size())
+    {
+        rehash();
+    }
+    return id;
+}
+
+char const* StringInterner::store(char const* data, size_t size)
+{
+    auto const needed = size + 1;
+    if (needed > m_chunk_left)
+    {
+        auto const bytes = needed > chunk_size ? needed : chunk_size;
+        m_chunks.emplace_back(new char[bytes]);
+        m_chunk_pos = m_chunks.back().get();
+        m_chunk_left = bytes;
+        m_arena_bytes += bytes;
+    }
+    auto* out = m_chunk_pos;
+    std::memcpy(out, data, size);
+    out[size] = '\0';
+    m_chunk_pos += needed;
+    m_chunk_left -= needed;
+    return out;
+}
+
+void StringInterner::rehash()
+{
+    std::vector<SymbolId> slots(m_slots.size() * 2, invalid_symbol);
+    auto const mask = slots.size() - 1;
+    for (SymbolId id = 0; id < m_entries.size(); ++id)
+    {
+        auto slot = m_entries[id].hash & mask;
+        while (slots[slot] != invalid_symbol)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+    m_slots = std::move(slots);
+}
+
+size_t StringInterner::memory_bytes() const noexcept
+{
+    return m_arena_bytes + m_entries.capacity() * sizeof(Entry) + m_slots.capacity() * sizeof(SymbolId);
+}
+
+} // namespace ty
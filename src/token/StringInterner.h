@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ty
+{
+
+//! Dense identifier for an interned string. Ids are assigned 0, 1, 2... in order of first appearance.
+using SymbolId = uint32_t;
+
+constexpr SymbolId invalid_symbol = UINT32_MAX;
+
+//! Maps each distinct lexeme of a compilation to a SymbolId.
+//! Characters are copied once into large arena chunks and never move, so the
+//! returned names stay valid for the lifetime of the interner.
+class StringInterner
+{
+public:
+    StringInterner();
+
+    StringInterner(StringInterner const&) = delete;
+    StringInterner& operator=(StringInterner const&) = delete;
+
+    //! Returns the id of [data, data + size), adding it if it isn't interned yet
+    SymbolId intern(char const* data, size_t size);
+
+    SymbolId intern(std::string const& s) { return intern(s.data(), s.size()); }
+
+    //! Returns the id of [data, data + size), or invalid_symbol if it was never interned
+    SymbolId find(char const* data, size_t size) const;
+
+    SymbolId find(std::string const& s) const { return find(s.data(), s.size()); }
+
+    //! Null-terminated name of 'id'
+    char const* name(SymbolId id) const { return m_entries[id].data; }
+
+    size_t size(SymbolId id) const { return m_entries[id].size; }
+
+    //! Number of distinct strings interned
+    size_t count() const noexcept { return m_entries.size(); }
+
+    //! Bytes held by the arena, the entry array and the hash table
+    size_t memory_bytes() const noexcept;
+
+private:
+    struct Entry
+    {
+        char const* data;
+        uint32_t    size;
+        uint32_t    hash;
+    };
+
+    static uint32_t hash(char const* data, size_t size);
+
+    //! Returns the slot holding 'data', or the empty slot where it belongs
+    size_t probe(char const* data, size_t size, uint32_t h) const;
+
+    char const* store(char const* data, size_t size);
+
+    void rehash();
+
+    std::vector<Entry>                      m_entries;
+
+    //! Open-addressing table of indices into m_entries; invalid_symbol marks an empty slot
+    std::vector<SymbolId>                   m_slots;
+
+    std::vector<std::unique_ptr<char[]>>    m_chunks;
+    char*                                   m_chunk_pos = nullptr;
+    size_t                                  m_chunk_left = 0;
+    size_t                                  m_arena_bytes = 0;
+};
+
+} // namespace ty
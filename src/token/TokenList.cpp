@@ -1 +1,203 @@
 #include "TokenList.h"
+#include "FastLexer.h"
+
+namespace ty
+{
+
+namespace
+{
+
+//! Lexes list.buffer() with a fast engine, or with both engines if 'engine' is checked
+TokenList lex(TokenList list, LexerEngine engine)
+{
+    if (engine != LexerEngine::checked)
+    {
+        lex_into(list, resolve_engine(engine));
+        return list;
+    }
+
+    auto expected = tokenize_reference(std::string{ list.buffer().begin(), list.buffer().end() });
+    lex_into(list, resolve_engine(LexerEngine::automatic));
+    auto const mismatch = first_token_mismatch(list, expected);
+    if (mismatch >= 0)
+    {
+        throw TokenMismatchException{ mismatch, list.offset(size_t(mismatch)) };
+    }
+    return list;
+}
+
+} // namespace
+
+TokenList tokenize(std::string s, LexerEngine engine)
+{
+    if (engine == LexerEngine::reference)
+    {
+        return tokenize_reference(std::move(s));
+    }
+
+    // Keep the reference lexer's buffer contents (a trailing whitespace byte) so
+    // offsets agree between engines; StringSource pads in place instead of copying.
+    s.reserve(s.size() + 1 + source_padding);
+    if (s.empty() || !(char_class_table()[uint8_t(s.back())] & CC_SPACE))
+    {
+        s.push_back(' ');
+    }
+    return lex(TokenList{ std::move(s) }, engine);
+}
+
+TokenList tokenize(std::string s)
+{
+    return tokenize(std::move(s), Global<LexerSettings>().engine);
+}
+
+TokenList tokenize(SourceBuffer const& source, LexerEngine engine)
+{
+    if (engine == LexerEngine::reference)
+    {
+        // The reference lexer needs its own copy with trailing whitespace
+        return tokenize_reference(std::string{ source.begin(), source.end() });
+    }
+    return lex(TokenList{ source }, engine);
+}
+
+TokenList tokenize(SourceBuffer const& source)
+{
+    return tokenize(source, Global<LexerSettings>().engine);
+}
+
+TokenList tokenize(std::unique_ptr<SourceBuffer const> source)
+{
+    auto const engine = Global<LexerSettings>().engine;
+    if (engine == LexerEngine::reference)
+    {
+        return tokenize(*source, engine);
+    }
+    return lex(TokenList{ std::move(source) }, engine);
+}
+
+TextEdit text_edit(char const* old_text, size_t old_size, char const* text, size_t size)
+{
+    auto const limit = std::min(old_size, size);
+    size_t prefix = 0;
+    while (prefix < limit && old_text[prefix] == text[prefix])
+    {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < limit - prefix && old_text[old_size - 1 - suffix] == text[size - 1 - suffix])
+    {
+        ++suffix;
+    }
+    return TextEdit{ prefix, old_size - prefix - suffix, std::string{ text + prefix, size - prefix - suffix } };
+}
+
+void relex(TokenList& list, TextEdit const& edit, TokenEdit& changed)
+{
+    auto const& old = list.buffer();
+    CCT_CHECK(!list.empty() && list.kind(list.size() - 1) == LexItem::Type::eof);
+    CCT_CHECK(edit.offset + edit.removed <= old.size());
+
+    // The edited text is old[0, offset) + inserted + old[offset + removed, end), plus a space
+    // if it doesn't end in whitespace, as tokenize() makes it. Only the window is built here:
+    // 'list' isn't touched until the window has lexed.
+    auto const tail = edit.offset + edit.removed;
+    auto const unpadded = old.size() - edit.removed + edit.inserted.size();
+    auto const last_char = tail < old.size() ? old.data()[old.size() - 1]
+        : !edit.inserted.empty() ? edit.inserted.back()
+        : edit.offset > 0 ? old.data()[edit.offset - 1] : '\0';
+    auto const pad = size_t(unpadded == 0 || !(char_class_table()[uint8_t(last_char)] & CC_SPACE));
+    auto const edited = [&](size_t b, size_t e)
+    {
+        std::string text;
+        text.reserve(e - b + 1 + source_padding);
+        auto const take = [&](size_t at, char const* part, size_t size)
+        {
+            auto const lo = std::max(b, at);
+            auto const hi = std::min(e, at + size);
+            if (lo < hi)
+            {
+                text.append(part + (lo - at), hi - lo);
+            }
+        };
+        take(0, old.data(), edit.offset);
+        take(edit.offset, edit.inserted.data(), edit.inserted.size());
+        take(edit.offset + edit.inserted.size(), old.data() + tail, old.size() - tail);
+        take(unpadded, " ", pad);
+        return text;
+    };
+
+    auto const delta = std::ptrdiff_t(edit.inserted.size()) - std::ptrdiff_t(edit.removed);
+    auto const count = list.size() - 1;
+    auto const end_of = [&](size_t i) { return size_t(list.offset(i)) + list.length(i); };
+
+    // The lexer looks one character past a token, so every token ending before the
+    // edit is lexed the same way again
+    size_t first = 0;
+    for (size_t n = count; n > 0; )
+    {
+        auto const half = n / 2;
+        if (end_of(first + half) < edit.offset) { first += half + 1; n -= half + 1; }
+        else { n = half; }
+    }
+
+    // First old token starting past the edit, and a candidate to fall back in step on
+    auto last = first;
+    for (size_t n = count - first; n > 0; )
+    {
+        auto const half = n / 2;
+        if (list.offset(last + half) <= tail) { last += half + 1; n -= half + 1; }
+        else { n = half; }
+    }
+
+    auto const window_begin = first ? end_of(first - 1) : size_t(0);
+    while (1)
+    {
+        auto const to_eof = last >= count;
+        auto const window_end = to_eof ? unpadded + pad : size_t(list.offset(last) + delta) + list.length(last);
+
+        // Tokens of the edited window, with offsets relative to window_begin
+        auto window = [&]
+        {
+            try
+            {
+                return lex(TokenList{ edited(window_begin, window_end) + ' ', list.interner() }, Global<LexerSettings>().engine);
+            }
+            catch (TokenException& e)
+            {
+                // Point into the edited text rather than the window
+                e.offset += window_begin;
+                throw;
+            }
+        }();
+        auto const n = window.size() - 1;
+
+        // The lexer is back in step if its last token is the old token 'last', in its shifted place.
+        // Every old token after it was lexed from the same text, so it is kept as is.
+        if (!to_eof
+            && (n == 0
+                || window.kind(n - 1) != list.kind(last)
+                || std::ptrdiff_t(window.offset(n - 1) + window_begin) != list.offset(last) + delta
+                || window.length(n - 1) != list.length(last)))
+        {
+            last = std::min(count, last + (last - first) + 1);
+            continue;
+        }
+
+        auto const fresh = to_eof ? n : n - 1;
+        auto const old_end = to_eof ? count : last;
+        list.reserve(first + fresh + (count - old_end) + 1);
+        list.edit_text(edit.offset, edit.removed, edit.inserted.data(), edit.inserted.size());
+        if (pad)
+        {
+            list.edit_text(unpadded, 0, " ", 1);
+        }
+        list.splice(first, old_end, window, fresh, window_begin, delta);
+
+        changed.first = first;
+        changed.old_end = old_end;
+        changed.new_end = first + fresh;
+        return;
+    }
+}
+
+} // namespace ty
@@ -2,6 +2,16 @@
 #include <vector>
 #include <string>
 #include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <cppcoretools/print.h>
+#include "common/TyObject.h"
+#include "SourceBuffer.h"
+#include "StringInterner.h"
+#include "TokenSpec.h"
 
 /*! 
  *-- Example Input ---
@@ -25,44 +35,38 @@ namespace ty
 {
     struct TokenException : public std::exception
     {
+        explicit TokenException(size_t at = 0) : offset{ at } {}
 
         char const* what() const override
         {
-            return "Token exception ";
+            return "Unexpected character";
         }
+
+        size_t offset;  //!< Into the text being tokenized, of the character that doesn't start a token
     };
 
     struct LexItem
     {
-        enum class Type { UNKNOWN, BRACE_OPEN, COMMA, BRACE_CLOSE, PAREN_OPEN, PAREN_CLOSE, ID, DEFN, DECL, NUM, param, PLUS, MINUS, ARROW, eof };
+#define TY_TOKEN_ENUMERATOR(type, name, lexeme) type,
+        enum class Type { TY_TOKEN_SPEC(TY_TOKEN_ENUMERATOR) };
+#undef TY_TOKEN_ENUMERATOR
 
         Type		type;
         char const* begin;
         char const* end;
+        SymbolId    symbol;     //!< Interned lexeme of an ID token, invalid_symbol otherwise
 
-        LexItem(Type t, char const* b, char const* e)
-            : type{ t }, begin{ b }, end{ e } {}
+        LexItem(Type t, char const* b, char const* e, SymbolId sym = invalid_symbol)
+            : type{ t }, begin{ b }, end{ e }, symbol{ sym } {}
 
         static auto as_string(Type t)
         {
             switch (t)
             {
-            case Type::BRACE_OPEN: return "brace_open";
-            case Type::BRACE_CLOSE: return "brace_close";
-            case Type::PAREN_OPEN: return "paren_open";
-            case Type::PAREN_CLOSE: return "paren_close";
-            case Type::ID: return "id";
-            case Type::DEFN: return "defn";
-            case Type::DECL: return "decl";
-            case Type::param: return "param";
-            case Type::PLUS: return "plus";
-            case Type::MINUS: return "minus";
-            case Type::ARROW: return "arrow";
-            case Type::NUM: return "num";
-            case Type::COMMA: return "comma";
-            case Type::eof: return "eof";
-            default:
-            case Type::UNKNOWN: return "unknown";
+#define TY_TOKEN_NAME(type, name, lexeme) case Type::type: return name;
+            TY_TOKEN_SPEC(TY_TOKEN_NAME)
+#undef TY_TOKEN_NAME
+            default: return "unknown";
             }
         }
 
@@ -77,24 +81,331 @@ namespace ty
         }
     };
 
-    class TokenList : public std::vector<LexItem> 
+    //! A token with a fixed lexeme, from TY_TOKEN_SPEC
+    struct FixedToken
+    {
+        char const*     lexeme;
+        LexItem::Type   type;
+    };
+
+    //! Every token of TY_TOKEN_SPEC; 'lexeme' is nullptr for the ones without a fixed lexeme
+    constexpr FixedToken token_spec[] =
+    {
+#define TY_FIXED_TOKEN(type, name, lexeme) FixedToken{ lexeme, LexItem::Type::type },
+        TY_TOKEN_SPEC(TY_FIXED_TOKEN)
+#undef TY_FIXED_TOKEN
+    };
+
+    //! Structure-of-arrays token storage.
+    //! Each token costs 9 bytes (a one-byte kind plus a 32-bit offset into buffer()
+    //! and a 32-bit payload) instead of the 24 of a LexItem. The payload of an ID token
+    //! is its SymbolId, interned at lex time; for every other token it is the lexeme length. Iterators yield LexItem values, so
+    //! `it->type`, `it->begin` etc. keep working and scans that only read the type
+    //! touch just the kind array once inlined.
+    class TokenList
     {
-        std::string m_buffer;
+        StringSource*                       m_editable = nullptr;   //!< m_owned if it can be edited in place
+        std::unique_ptr<SourceBuffer const> m_owned;
+        SourceBuffer const*                 m_source;
+        std::shared_ptr<StringInterner>     m_interner;
+
+        std::unique_ptr<uint8_t[]>          m_kinds;
+        std::unique_ptr<uint32_t[]>         m_offsets;
+        std::unique_ptr<uint32_t[]>         m_payloads;
+        size_t                              m_size = 0;
+        size_t                              m_capacity = 0;
 
     public:
-        TokenList(std::string data) : 
-            std::vector<LexItem>{}, m_buffer{ std::move(data) } 
+        class const_iterator
+        {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = LexItem;
+            using difference_type = std::ptrdiff_t;
+            using reference = LexItem;
+
+            //! Stand-in for LexItem const*, since there is no LexItem object to point at
+            struct pointer
+            {
+                LexItem item;
+                LexItem const* operator->() const { return &item; }
+            };
+
+            const_iterator() = default;
+            const_iterator(TokenList const* list, size_t index) : m_list{ list }, m_index{ index } {}
+
+            LexItem::Type type() const { return m_list->kind(m_index); }
+            size_t index() const { return m_index; }
+
+            LexItem operator*() const { return (*m_list)[m_index]; }
+            pointer operator->() const { return pointer{ **this }; }
+            LexItem operator[](difference_type n) const { return (*m_list)[m_index + n]; }
+
+            const_iterator& operator++() { ++m_index; return *this; }
+            const_iterator& operator--() { --m_index; return *this; }
+            const_iterator operator++(int) { auto r = *this; ++m_index; return r; }
+            const_iterator operator--(int) { auto r = *this; --m_index; return r; }
+            const_iterator& operator+=(difference_type n) { m_index += n; return *this; }
+            const_iterator& operator-=(difference_type n) { m_index -= n; return *this; }
+            const_iterator operator+(difference_type n) const { return { m_list, m_index + n }; }
+            const_iterator operator-(difference_type n) const { return { m_list, m_index - n }; }
+            difference_type operator-(const_iterator const& o) const { return difference_type(m_index) - difference_type(o.m_index); }
+
+            bool operator==(const_iterator const& o) const { return m_index == o.m_index; }
+            bool operator!=(const_iterator const& o) const { return m_index != o.m_index; }
+            bool operator<(const_iterator const& o) const { return m_index < o.m_index; }
+            bool operator>(const_iterator const& o) const { return m_index > o.m_index; }
+            bool operator<=(const_iterator const& o) const { return m_index <= o.m_index; }
+            bool operator>=(const_iterator const& o) const { return m_index >= o.m_index; }
+
+        private:
+            TokenList const*    m_list = nullptr;
+            size_t              m_index = 0;
+        };
+
+        using iterator = const_iterator;
+        using value_type = LexItem;
+
+        //! Takes ownership of 'data'.
+        //! Identifiers are interned into 'interner', or into a new one if it is null.
+        TokenList(std::string data, std::shared_ptr<StringInterner> interner = nullptr) :
+            TokenList(std::make_unique<StringSource>(std::move(data)), std::move(interner))
         {}
 
-        auto& buffer() { return m_buffer; }
-        auto const& buffer() const { return m_buffer; }
+        //! Takes ownership of 'source' (e.g. a MappedSource from load_source())
+        explicit TokenList(std::unique_ptr<SourceBuffer const> source, std::shared_ptr<StringInterner> interner = nullptr) :
+            m_owned{ std::move(source) }, m_source{ m_owned.get() }, m_interner{ std::move(interner) }
+        {
+            init();
+        }
+
+        //! Borrows 'source', which must outlive this list and every LexItem in it
+        explicit TokenList(SourceBuffer const& source, std::shared_ptr<StringInterner> interner = nullptr) :
+            m_source{ &source }, m_interner{ std::move(interner) }
+        {
+            init();
+        }
+
+        auto const& buffer() const { return *m_source; }
+
+        //! Interner holding the names of all ID tokens. Shared so ASTs can outlive the tokens.
+        auto const& interner() const { return m_interner; }
+
+        //! Appends a token whose lexeme is [b, e) inside buffer().
+        //! An eof token is stored as an empty lexeme at the end of buffer().
+        void emplace_back(LexItem::Type t, char const* b, char const* e)
+        {
+            if (m_size == m_capacity)
+            {
+                reserve(m_capacity ? m_capacity * 2 : 16);
+            }
+            m_kinds[m_size] = static_cast<uint8_t>(t);
+            if (t == LexItem::Type::eof)
+            {
+                m_offsets[m_size] = static_cast<uint32_t>(m_source->size());
+                m_payloads[m_size] = 0;
+            }
+            else
+            {
+                m_offsets[m_size] = static_cast<uint32_t>(b - m_source->data());
+                m_payloads[m_size] = t == LexItem::Type::ID
+                    ? m_interner->intern(b, e - b)
+                    : static_cast<uint32_t>(e - b);
+            }
+            ++m_size;
+        }
+
+        //! Replaces [offset, offset + removed) of buffer() with [text, text + size). Tokens
+        //! aren't touched; see splice(). A list that doesn't own its text as a string (a borrowed
+        //! or mapped source) takes a copy on the first edit, later edits are in place.
+        void edit_text(size_t offset, size_t removed, char const* text, size_t size)
+        {
+            CCT_CHECK(offset + removed <= m_source->size() && m_source->size() - removed + size < UINT32_MAX);
+            if (!m_editable)
+            {
+                auto copy = std::make_unique<StringSource>(std::string{ m_source->begin(), m_source->end() });
+                m_editable = copy.get();
+                m_source = m_editable;
+                m_owned = std::move(copy);
+            }
+            m_editable->replace(offset, removed, text, size);
+        }
+
+        //! Replaces tokens [first, last) with tokens [0, count) of 'window', whose offsets are
+        //! relative to 'base', and moves the tokens from 'last' on by 'shift' bytes, in place.
+        //! The eof token ends up at the end of buffer(), which must already hold the edited text.
+        //! \pre 'window' shares this list's interner, [0, count) holds no eof token and
+        //!      this list ends with its eof token at or after 'last'
+        void splice(size_t first, size_t last, TokenList const& window, size_t count, size_t base, std::ptrdiff_t shift)
+        {
+            CCT_CHECK(window.m_interner == m_interner && first <= last && last < m_size && count <= window.m_size);
+            auto const tail = m_size - last;
+            reserve(first + count + tail);
+            std::memmove(m_kinds.get() + first + count, m_kinds.get() + last, tail * sizeof(uint8_t));
+            std::memmove(m_payloads.get() + first + count, m_payloads.get() + last, tail * sizeof(uint32_t));
+            std::memmove(m_offsets.get() + first + count, m_offsets.get() + last, tail * sizeof(uint32_t));
+            m_size = first + count + tail;
+            std::transform(m_offsets.get() + first + count, m_offsets.get() + m_size, m_offsets.get() + first + count,
+                [shift](uint32_t o) { return static_cast<uint32_t>(o + shift); });
+
+            std::copy(window.m_kinds.get(), window.m_kinds.get() + count, m_kinds.get() + first);
+            std::copy(window.m_payloads.get(), window.m_payloads.get() + count, m_payloads.get() + first);
+            std::transform(window.m_offsets.get(), window.m_offsets.get() + count, m_offsets.get() + first,
+                [base](uint32_t o) { return static_cast<uint32_t>(o + base); });
+            m_offsets[m_size - 1] = static_cast<uint32_t>(m_source->size());
+        }
+
+        void reserve(size_t n)
+        {
+            if (n <= m_capacity)
+            {
+                return;
+            }
+            grow(m_kinds, n);
+            grow(m_offsets, n);
+            grow(m_payloads, n);
+            m_capacity = n;
+        }
+
+        size_t size() const noexcept { return m_size; }
+        bool empty() const noexcept { return m_size == 0; }
+
+        LexItem::Type kind(size_t i) const { return static_cast<LexItem::Type>(m_kinds[i]); }
+        uint32_t offset(size_t i) const { return m_offsets[i]; }
+        uint32_t length(size_t i) const
+        {
+            return kind(i) == LexItem::Type::ID ? static_cast<uint32_t>(m_interner->size(m_payloads[i])) : m_payloads[i];
+        }
+
+        SymbolId symbol(size_t i) const
+        {
+            return kind(i) == LexItem::Type::ID ? m_payloads[i] : invalid_symbol;
+        }
+
+        LexItem operator[](size_t i) const
+        {
+            auto const* b = m_source->data() + m_offsets[i];
+            return LexItem{ kind(i), b, b + length(i), symbol(i) };
+        }
+
+        LexItem back() const { return (*this)[size() - 1]; }
+
+        const_iterator begin() const { return { this, 0 }; }
+        const_iterator end() const { return { this, size() }; }
+
+        //! Bytes held by the token arrays (excluding the source buffer)
+        size_t memory_bytes() const noexcept
+        {
+            return m_capacity * (sizeof(uint8_t) + 2 * sizeof(uint32_t));
+        }
+
+    private:
+        TokenList(std::unique_ptr<StringSource> source, std::shared_ptr<StringInterner> interner) :
+            m_editable{ source.get() }, m_owned{ std::move(source) }, m_source{ m_owned.get() }, m_interner{ std::move(interner) }
+        {
+            init();
+        }
+
+        template <typename T>
+        void grow(std::unique_ptr<T[]>& array, size_t n)
+        {
+            std::unique_ptr<T[]> bigger{ new T[n] };
+            std::copy(array.get(), array.get() + m_size, bigger.get());
+            array = std::move(bigger);
+        }
+
+        //! Creates the interner if none was shared and pre-sizes the arrays from the
+        //! source length. Dense tylang averages around one token per 3 bytes;
+        //! underestimates just fall back to doubling.
+        void init()
+        {
+            if (!m_interner)
+            {
+                m_interner = std::make_shared<StringInterner>();
+            }
+            CCT_CHECK(m_source->size() < UINT32_MAX);
+            reserve(m_source->size() / 3 + 16);
+        }
+    };
+
+    //! Selects the implementation used by tokenize()
+    enum class LexerEngine
+    {
+        reference,  //!< Hand-written switch-based lexer, independent of TY_TOKEN_SPEC (tokenize_reference)
+        table,      //!< Character-class table lookups, scalar run scanning
+        sse2,       //!< Character-class table plus 16-byte SSE2 run scanning
+        avx2,       //!< Character-class table plus 32-byte AVX2 run scanning
+        dfa,        //!< One transition-table lookup per byte, with the table generated from TY_TOKEN_SPEC
+        automatic,  //!< Fastest engine on tybench's corpus, see resolve_engine()
+        checked     //!< Runs 'automatic' and 'reference' and compares them token-for-token
     };
 
-    inline TokenList tokenize(std::string s)
+    //! Process-wide lexer configuration
+    struct LexerSettings : public TyObject<Attribute::HasGlobal>
+    {
+        LexerEngine engine = LexerEngine::automatic;
+    };
+
+    //! Tokenizes 's' using the given engine
+    //! \throws TokenException if 's' contains a character that doesn't start a token
+    TokenList tokenize(std::string s, LexerEngine engine);
+
+    //! Tokenizes 's' using the engine in Global<LexerSettings>()
+    TokenList tokenize(std::string s);
+
+    //! Tokenizes 'source' without copying it. Tokens point directly into 'source',
+    //! which must outlive the returned list.
+    TokenList tokenize(SourceBuffer const& source, LexerEngine engine);
+
+    //! Tokenizes 'source' without copying it, using the engine in Global<LexerSettings>()
+    TokenList tokenize(SourceBuffer const& source);
+
+    //! Tokenizes 'source' without copying it; the returned list owns 'source'
+    TokenList tokenize(std::unique_ptr<SourceBuffer const> source);
+
+    //! A change to source text: 'removed' bytes at 'offset' are replaced by 'inserted'
+    struct TextEdit
+    {
+        size_t      offset = 0;
+        size_t      removed = 0;
+        std::string inserted;
+    };
+
+    //! The edit turning [old_text, old_text + old_size) into [text, text + size): the span
+    //! between their common prefix and their common suffix
+    TextEdit text_edit(char const* old_text, size_t old_size, char const* text, size_t size);
+
+    //! Tokens changed by relex(): [first, old_end) of the list before the edit became
+    //! [first, new_end) after it. Tokens after them are the same apart from their offsets.
+    struct TokenEdit
+    {
+        size_t first = 0;
+        size_t old_end = 0;
+        size_t new_end = 0;
+
+        //! Index shift of the tokens following the change
+        std::ptrdiff_t shift() const { return std::ptrdiff_t(new_end) - std::ptrdiff_t(old_end); }
+    };
+
+    //! Applies 'edit' to list.buffer() and brings the tokens up to date in place, lexing only
+    //! the text between the last token that ends before the edit and the first old token the
+    //! lexer falls back in step with. The text and token arrays are spliced where they are:
+    //! nothing before the edit is touched, and the text and tokens after it are moved once,
+    //! without reallocating unless they grow past their capacity.
+    //! The list and its interner stay the same objects, so SymbolIds and ParseIndex stay valid.
+    //! \pre 'list' ends with its eof token and edit.offset + edit.removed <= list.buffer().size()
+    //! \throws TokenException if the edited text contains a character that doesn't start a token;
+    //!         'list' is left unchanged then
+    void relex(TokenList& list, TextEdit const& edit, TokenEdit& changed);
+
+    //! The lexer the other engines are checked against. Its lexemes are written out by hand
+    //! rather than taken from TY_TOKEN_SPEC, so a mistake in the spec or in the DFA built
+    //! from it shows up as a mismatch; a token added to the spec must be added here too.
+    inline TokenList tokenize_reference(std::string s)
     {
         if (!::isspace(s.back()))
         {
-            return tokenize(s + " ");
+            return tokenize_reference(s + " ");
         }
         
         TokenList list{ std::move(s) };
@@ -124,7 +435,7 @@ namespace ty
                     it++;
                 }
             }
-            break;
+            continue;
             }
             if (::isdigit(*it))
             {
@@ -141,7 +452,7 @@ namespace ty
                 continue;
             }
             else if (::isspace(*it)) { it++; }
-            else throw TokenException{};
+            else throw TokenException{ size_t(it - list.buffer().begin()) };
         }
         list.emplace_back(LexItem::Type::eof, "", "" + 1);
         return list;
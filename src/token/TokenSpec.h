@@ -0,0 +1,29 @@
+#pragma once
+
+//! The token set of tylang, the one place tokens are declared:
+//!     X(enumerator, name, lexeme)
+//! 'enumerator' becomes a LexItem::Type and 'name' its as_string(). Tokens with a fixed
+//! 'lexeme' are lexed by the fast engines from this list alone: the DFA of LexerDfa.h is
+//! built from it at compile time, and longest match decides between lexemes sharing a prefix
+//! ('-' and '->'). tokenize_reference() spells them out by hand so it can check the others,
+//! so a new lexeme goes there too. Tokens with a nullptr lexeme are either character classes
+//! with hand-written rules (ID, NUM) or not produced by the lexer at all.
+//! Lexemes may only use punctuation, i.e. no letters, digits or whitespace.
+//! The order is the numbering of LexItem::Type, which compile cache keys hash, so new
+//! tokens are added just before eof.
+#define TY_TOKEN_SPEC(X) \
+    X(UNKNOWN,      "unknown",      nullptr)    \
+    X(BRACE_OPEN,   "brace_open",   "{")        \
+    X(COMMA,        "comma",        nullptr)    \
+    X(BRACE_CLOSE,  "brace_close",  "}")        \
+    X(PAREN_OPEN,   "paren_open",   "(")        \
+    X(PAREN_CLOSE,  "paren_close",  ")")        \
+    X(ID,           "id",           nullptr)    \
+    X(DEFN,         "defn",         "=")        \
+    X(DECL,         "decl",         ":")        \
+    X(NUM,          "num",          nullptr)    \
+    X(param,        "param",        "@")        \
+    X(PLUS,         "plus",         "+")        \
+    X(MINUS,        "minus",        "-")        \
+    X(ARROW,        "arrow",        "->")       \
+    X(eof,          "eof",          nullptr)
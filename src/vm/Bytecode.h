@@ -0,0 +1,67 @@
+#pragma once
+
+#include "token/StringInterner.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace ty
+{
+
+//! Operations of the register VM. Every value is an i32 kept in a 64-bit register.
+enum class Op : uint8_t
+{
+    LoadI32,        //!< dst = int32(operand)
+    LoadGlobal,     //!< dst = globals[operand]
+    Call,           //!< dst = functions[operand]()
+    AddI32,         //!< dst = a + b, wrapping
+    SubI32,         //!< dst = a - b, wrapping
+    Ret,            //!< returns register a
+    Count
+};
+
+//! One fixed-size instruction; 'operand' is either an index/immediate or two registers
+struct Instruction
+{
+    Op          op;
+    uint8_t     reserved;
+    uint16_t    dst;
+    uint32_t    operand;
+
+    uint16_t a() const noexcept { return static_cast<uint16_t>(operand); }
+    uint16_t b() const noexcept { return static_cast<uint16_t>(operand >> 16); }
+
+    static uint32_t registers(uint16_t a, uint16_t b) noexcept { return a | (uint32_t(b) << 16); }
+};
+
+static_assert(sizeof(Instruction) == 8, "Instructions are packed to 8 bytes");
+
+struct BytecodeFunction
+{
+    SymbolId                    name = invalid_symbol;
+    std::vector<Instruction>    code;
+    uint16_t                    register_count = 0;
+};
+
+//! Lowered module: functions and the folded values of the globals, both in source order
+struct BytecodeModule
+{
+    std::vector<BytecodeFunction>   functions;
+    std::vector<int64_t>            globals;
+    std::vector<SymbolId>           global_names;
+
+    //! Index of the function named 'name', or -1
+    int find_function(SymbolId name) const noexcept
+    {
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            if (functions[i].name == name)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+};
+
+} // namespace ty
@@ -0,0 +1,159 @@
+#include "BytecodeCompiler.h"
+#include "parse/Parse.h"
+#include "parse/ConstantEvaluator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+namespace ty
+{
+
+void BytecodeCompiler::generate(FunctionDefnExpr const& expr)
+{
+    // Checked first: the definitions of a block body would be compiled into this function
+    if (expr.m_returns.empty())
+    {
+        throw EvalException(&expr, std::string("Function '") + m_interner->name(expr.id()) + "' doesn't return a value");
+    }
+    m_functions[expr.id()] = static_cast<uint32_t>(m_module.functions.size());
+    m_module.functions.emplace_back();
+    m_function = &m_module.functions.back();
+    m_function->name = expr.id();
+    m_next_register = 0;
+    for (auto const& a : expr.m_body->exprs)
+    {
+        a->generate(*this);
+    }
+    m_function = nullptr;
+}
+
+void BytecodeCompiler::generate(Int32LiteralExpr const& expr)
+{
+    errno = 0;
+    auto const value = std::strtoll(expr.text(), nullptr, 10);
+    if (errno == ERANGE || value < INT32_MIN || value > INT32_MAX)
+    {
+        throw EvalException(&expr, std::string("Literal ") + expr.text() + " out of range for i32");
+    }
+    m_result = allocate_register();
+    emit(Op::LoadI32, m_result, static_cast<uint32_t>(value));
+}
+
+void BytecodeCompiler::generate(ReturnExpr const& expr)
+{
+    auto const r = value_of(*expr.sub_expr());
+    emit(Op::Ret, 0, Instruction::registers(r, 0));
+    m_next_register = r;
+}
+
+void BytecodeCompiler::generate(DataDefnExpr const& expr)
+{
+    auto const* c = m_evaluator ? m_evaluator->evaluate(expr) : nullptr;
+    if (!c)
+    {
+        throw EvalException(&expr, std::string("Initializer of '") + m_interner->name(expr.id()) + "' is not a compile-time constant");
+    }
+    m_globals[expr.id()] = static_cast<uint32_t>(m_module.globals.size());
+    m_module.globals.push_back(c->value);
+    m_module.global_names.push_back(expr.id());
+}
+
+void BytecodeCompiler::generate(SymbolExpr const& expr)
+{
+    m_result = allocate_register();
+    m_fixups.push_back(Fixup{ m_module.functions.size() - 1, m_function->code.size(), expr.name(), &expr });
+    emit(Op::LoadGlobal, m_result, 0);
+}
+
+void BytecodeCompiler::generate(FunctionCallExpr const& expr)
+{
+    m_result = allocate_register();
+    m_fixups.push_back(Fixup{ m_module.functions.size() - 1, m_function->code.size(), expr.callee(), &expr });
+    emit(Op::Call, m_result, 0);
+}
+
+void BytecodeCompiler::generate(AddExpr const& expr)
+{
+    generate_binary<Op::AddI32>(expr);
+}
+
+void BytecodeCompiler::generate(SubExpr const& expr)
+{
+    generate_binary<Op::SubI32>(expr);
+}
+
+template <Op op>
+void BytecodeCompiler::generate_binary(BinaryOpExpr const& expr)
+{
+    auto const lhs = value_of(*expr.left());
+    auto const rhs = value_of(*expr.right());
+    emit(op, lhs, Instruction::registers(lhs, rhs));
+    m_next_register = lhs + 1;
+    m_result = lhs;
+}
+
+uint16_t BytecodeCompiler::value_of(Expr const& expr)
+{
+    if (auto const* c = folder() ? folder()->evaluate(expr) : nullptr)
+    {
+        auto const r = allocate_register();
+        emit(Op::LoadI32, r, static_cast<uint32_t>(c->value));
+        return r;
+    }
+    expr.generate(*this);
+    return m_result;
+}
+
+uint16_t BytecodeCompiler::allocate_register()
+{
+    CCT_CHECK(m_function && m_next_register < UINT16_MAX);
+    auto const r = m_next_register++;
+    m_function->register_count = std::max(m_function->register_count, m_next_register);
+    return r;
+}
+
+void BytecodeCompiler::emit(Op op, uint16_t dst, uint32_t operand)
+{
+    CCT_CHECK(m_function);
+    m_function->code.push_back(Instruction{ op, 0, dst, operand });
+}
+
+BytecodeModule BytecodeCompiler::finish()
+{
+    for (auto const& f : m_fixups)
+    {
+        auto& instruction = m_module.functions[f.function].code[f.instruction];
+        auto const is_call = instruction.op == Op::Call;
+        auto const& targets = is_call ? m_functions : m_globals;
+        auto const found = targets.find(f.name);
+        if (found == targets.end())
+        {
+            auto const* name = m_interner->name(f.name);
+            if ((is_call ? m_globals : m_functions).count(f.name))
+            {
+                throw EvalException(f.use, std::string("'") + name + (is_call ? "' is not a function" : "' is not a value"));
+            }
+            throw EvalException(f.use, std::string("Undefined symbol '") + name + "'");
+        }
+        instruction.operand = found->second;
+    }
+    m_fixups.clear();
+    return std::move(m_module);
+}
+
+BytecodeModule compile_bytecode(ParseContext const& ast, bool fold)
+{
+    ConstantEvaluator evaluator{ *ast.symbols, ast.interner.get() };
+    BytecodeCompiler c;
+    c.set_interner(ast.interner.get());
+    c.set_evaluator(&evaluator);
+    c.set_folding(fold);
+    for (auto const* defn : ast.exprs)
+    {
+        defn->generate(c);
+    }
+    return c.finish();
+}
+
+} // namespace ty
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Bytecode.h"
+#include "cgen/Generator.h"
+
+#include <unordered_map>
+
+namespace ty
+{
+
+struct ParseContext;
+
+//! Lowers the AST to register bytecode.
+//! Registers are allocated like a stack: an expression's result goes to the lowest free
+//! register and its operands' registers are released once it's computed, so a function
+//! needs as many registers as its deepest expression. Constants are folded by the
+//! evaluator, when one is set and folding isn't turned off, as in LLVM_IR_Generator.
+class BytecodeCompiler : public Generator
+{
+public:
+    void generate(FunctionDefnExpr const& expr) override;
+
+    void generate(Int32LiteralExpr const& expr) override;
+
+    void generate(ReturnExpr const& expr) override;
+
+    //! Adds a global; its initializer must fold to a constant
+    void generate(DataDefnExpr const& expr) override;
+
+    void generate(SymbolExpr const& expr) override;
+
+    void generate(FunctionCallExpr const& expr) override;
+
+    void generate(AddExpr const& expr) override;
+
+    void generate(SubExpr const& expr) override;
+
+    //! Resolves the names used by the functions and returns the module
+    //! \throws EvalException if a name isn't defined as a value or function
+    BytecodeModule finish();
+
+private:
+    //! Emits code leaving the value of 'expr' in a new register and returns that register
+    uint16_t value_of(Expr const& expr);
+
+    uint16_t allocate_register();
+
+    void emit(Op op, uint16_t dst, uint32_t operand);
+
+    template <Op op>
+    void generate_binary(BinaryOpExpr const& expr);
+
+    //! Instruction whose operand is the index of a global or function named by 'use'
+    struct Fixup
+    {
+        size_t      function;
+        size_t      instruction;
+        SymbolId    name;
+        Expr const* use;
+    };
+
+    BytecodeModule                              m_module;
+    std::unordered_map<SymbolId, uint32_t>      m_globals;      //!< Index in m_module.globals
+    std::unordered_map<SymbolId, uint32_t>      m_functions;    //!< Index in m_module.functions
+    std::vector<Fixup>                          m_fixups;
+    BytecodeFunction*                           m_function = nullptr;
+    uint16_t                                    m_next_register = 0;
+    uint16_t                                    m_result = 0;   //!< Register of the last expression generated
+};
+
+//! Lowers every top-level definition of 'ast'. With 'fold', function bodies that are
+//! compile-time constants become a single load; without, every call, global load and
+//! arithmetic instruction is kept, so the interpreter actually executes them.
+//! \throws EvalException on the first definition that can't be lowered
+BytecodeModule compile_bytecode(ParseContext const& ast, bool fold = true);
+
+} // namespace ty
@@ -0,0 +1,113 @@
+#include "Interpreter.h"
+
+#include <cstdlib>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TY_VM_COMPUTED_GOTO 1
+#else
+#define TY_VM_COMPUTED_GOTO 0
+#endif
+
+namespace ty
+{
+
+namespace
+{
+
+//! i32 arithmetic wraps like two's complement hardware
+int64_t wrap_i32(uint64_t v)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(v));
+}
+
+} // namespace
+
+int64_t Interpreter::call(size_t index)
+{
+    auto const* function = &m_module.functions[index];
+    size_t base = 0;
+    m_frames.clear();
+    if (m_registers.size() < function->register_count)
+    {
+        m_registers.resize(function->register_count);
+    }
+    auto* regs = m_registers.data();
+    auto const* pc = function->code.data();
+
+#if TY_VM_COMPUTED_GOTO
+    // Same order as Op
+    static void* const dispatch[] = { &&op_LoadI32, &&op_LoadGlobal, &&op_Call, &&op_AddI32, &&op_SubI32, &&op_Ret };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == size_t(Op::Count), "Every Op needs a label");
+#define TY_VM_CASE(name) op_##name:
+#define TY_VM_JUMP() goto *dispatch[static_cast<size_t>(pc->op)]
+#define TY_VM_NEXT() ++pc; TY_VM_JUMP()
+    TY_VM_JUMP();
+#else
+#define TY_VM_CASE(name) case Op::name:
+#define TY_VM_JUMP() continue
+#define TY_VM_NEXT() ++pc; continue
+    for (;;) switch (pc->op)
+#endif
+    {
+    TY_VM_CASE(LoadI32)
+        regs[pc->dst] = static_cast<int32_t>(pc->operand);
+        TY_VM_NEXT();
+
+    TY_VM_CASE(LoadGlobal)
+        regs[pc->dst] = m_module.globals[pc->operand];
+        TY_VM_NEXT();
+
+    TY_VM_CASE(Call)
+    {
+        if (m_frames.size() == max_call_depth)
+        {
+            throw VmException("Call stack overflow: more than " + std::to_string(max_call_depth) + " nested calls");
+        }
+        m_frames.push_back(Frame{ function, pc + 1, base, pc->dst });
+        base += function->register_count;
+        function = &m_module.functions[pc->operand];
+        if (m_registers.size() < base + function->register_count)
+        {
+            m_registers.resize((base + function->register_count) * 2);
+        }
+        regs = m_registers.data() + base;
+        pc = function->code.data();
+        TY_VM_JUMP();
+    }
+
+    TY_VM_CASE(AddI32)
+        regs[pc->dst] = wrap_i32(uint64_t(regs[pc->a()]) + uint64_t(regs[pc->b()]));
+        TY_VM_NEXT();
+
+    TY_VM_CASE(SubI32)
+        regs[pc->dst] = wrap_i32(uint64_t(regs[pc->a()]) - uint64_t(regs[pc->b()]));
+        TY_VM_NEXT();
+
+    TY_VM_CASE(Ret)
+    {
+        auto const result = regs[pc->a()];
+        if (m_frames.empty())
+        {
+            return result;
+        }
+        auto const& caller = m_frames.back();
+        function = caller.function;
+        base = caller.base;
+        regs = m_registers.data() + base;
+        regs[caller.dst] = result;
+        pc = caller.return_pc;
+        m_frames.pop_back();
+        TY_VM_JUMP();
+    }
+
+#if !TY_VM_COMPUTED_GOTO
+    default:
+        std::abort();
+#endif
+    }
+#undef TY_VM_CASE
+#undef TY_VM_JUMP
+#undef TY_VM_NEXT
+}
+
+} // namespace ty
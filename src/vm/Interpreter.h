@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Bytecode.h"
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace ty
+{
+
+struct VmException : public std::exception
+{
+    explicit VmException(std::string msg) : m_message{ std::move(msg) } {}
+
+    char const* what() const override
+    {
+        return m_message.c_str();
+    }
+
+    std::string m_message;
+};
+
+//! Executes a BytecodeModule in-process.
+//! Dispatch uses computed goto where the compiler supports it (GCC, Clang) and a
+//! switch otherwise. Calls don't recurse on the C++ stack: frames live in an explicit
+//! stack and all registers in one array, each frame using a window of it.
+class Interpreter
+{
+public:
+    //! Calls nested deeper than this stop execution with a VmException
+    static constexpr size_t max_call_depth = 1 << 16;
+
+    explicit Interpreter(BytecodeModule const& module) : m_module{ module } {}
+
+    //! Runs function 'index' of the module and returns its result
+    //! \throws VmException if the call stack overflows
+    int64_t call(size_t index);
+
+private:
+    struct Frame
+    {
+        BytecodeFunction const* function;
+        Instruction const*      return_pc;
+        size_t                  base;       //!< First register of the frame
+        uint16_t                dst;        //!< Caller's register receiving the result
+    };
+
+    BytecodeModule const&   m_module;
+    std::vector<int64_t>    m_registers;
+    std::vector<Frame>      m_frames;
+};
+
+} // namespace ty